@@ -0,0 +1,142 @@
+// Decode benchmark for the web server's image loader. Decodes every file given on the command
+// line with the default decoder (libjpeg-turbo for JPEGs when built with STEGONINJA_JPEG_TURBO)
+// and with stb_image, and prints throughput, speedup and the largest per-channel difference
+// between the two outputs as JSON.
+//
+//   stegoninja-decode-bench [--iterations 20] photo1.jpg photo2.jpg ...
+//
+// Built alongside the server from the same sources:
+//   g++ -O2 -std=c++17 -Iinclude -DSTEGONINJA_JPEG_TURBO -o stegoninja-decode-bench
+//       bench/decodeBench.cpp web/imageIO.cpp web/requestArena.cpp -lz -ljpeg
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "../include/imageIO.h"
+#include "../include/requestArena.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct Timing {
+    double seconds = 0;
+    std::vector<RGB> pixels;
+    int width = 0;
+    int height = 0;
+};
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& data) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Best of the iterations, so a page fault or a context switch doesn't skew the comparison
+static Timing timeDecoder(const std::vector<uint8_t>& data, ImageDecoder decoder, int iterations) {
+    Timing timing;
+    for (int i = 0; i < iterations; ++i) {
+        Clock::time_point start = Clock::now();
+        std::vector<RGB> pixels = decodeImage(data.data(), data.size(), timing.width, timing.height, decoder);
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (i == 0 || seconds < timing.seconds) timing.seconds = seconds;
+        if (i + 1 == iterations) timing.pixels = std::move(pixels);
+        else releasePixels(std::move(pixels));
+    }
+    return timing;
+}
+
+static int maxDifference(const std::vector<RGB>& a, const std::vector<RGB>& b) {
+    if (a.size() != b.size()) return -1;
+    const uint8_t* pa = reinterpret_cast<const uint8_t*>(a.data());
+    const uint8_t* pb = reinterpret_cast<const uint8_t*>(b.data());
+    int worst = 0;
+    for (size_t i = 0; i < a.size() * sizeof(RGB); ++i) {
+        int diff = std::abs(static_cast<int>(pa[i]) - static_cast<int>(pb[i]));
+        if (diff > worst) worst = diff;
+    }
+    return worst;
+}
+
+static std::string jsonEscape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [--iterations N] IMAGE...\n";
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = 20;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--iterations" && i + 1 < argc) iterations = std::atoi(argv[++i]);
+        else paths.push_back(arg);
+    }
+    if (paths.empty() || iterations < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Decode at any size; the server's stream threshold doesn't apply here
+    setStreamThreshold(UINT64_MAX);
+
+    std::string out = "{\"decoder\":\"";
+    out += jpegDecoderName();
+    out += "\",\"iterations\":" + std::to_string(iterations) + ",\"images\":[";
+
+    double totalDefault = 0, totalStb = 0, totalMegapixels = 0;
+    bool first = true;
+    for (const std::string& path : paths) {
+        std::vector<uint8_t> data;
+        if (!readFile(path, data)) {
+            std::cerr << "Failed to read " << path << std::endl;
+            return 1;
+        }
+
+        Timing fast, stb;
+        try {
+            fast = timeDecoder(data, ImageDecoder::Auto, iterations);
+            stb = timeDecoder(data, ImageDecoder::Stb, iterations);
+        } catch (const std::exception& e) {
+            std::cerr << path << ": " << e.what() << std::endl;
+            return 1;
+        }
+
+        double megapixels = static_cast<double>(fast.width) * fast.height / 1e6;
+        totalDefault += fast.seconds;
+        totalStb += stb.seconds;
+        totalMegapixels += megapixels;
+
+        out += first ? "{\"file\":\"" : ",{\"file\":\"";
+        out += jsonEscape(path);
+        char buf[512];
+        std::snprintf(buf, sizeof(buf), "\",\"size\":\"%dx%d\",\"bytes\":%zu,\"defaultMs\":%.3f,\"stbMs\":%.3f,"
+                      "\"defaultMegapixelsPerSecond\":%.1f,\"stbMegapixelsPerSecond\":%.1f,\"speedup\":%.2f,\"maxDifference\":%d}",
+                      fast.width, fast.height, data.size(),
+                      fast.seconds * 1000, stb.seconds * 1000, megapixels / fast.seconds, megapixels / stb.seconds,
+                      stb.seconds / fast.seconds, maxDifference(fast.pixels, stb.pixels));
+        out += buf;
+        first = false;
+    }
+
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "],\"total\":{\"defaultMegapixelsPerSecond\":%.1f,\"stbMegapixelsPerSecond\":%.1f,\"speedup\":%.2f}}",
+                  totalMegapixels / totalDefault, totalMegapixels / totalStb, totalStb / totalDefault);
+    out += buf;
+    std::cout << out << std::endl;
+    return 0;
+}
@@ -42,6 +42,4 @@ struct BlockPosition {
     int y;
 };
 
-std::vector<RGB> readBMP(const std::string& filename, int& width, int& height);
-
 #endif
\ No newline at end of file
@@ -0,0 +1,59 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+
+class WorkerPool;
+
+// A write in flight. The caller's buffer must outlive it, so destruction waits for completion.
+class PendingWrite {
+public:
+    PendingWrite() = default;
+    explicit PendingWrite(std::future<int> result) : result(std::move(result)) {}
+    PendingWrite(PendingWrite&&) = default;
+    // Waits for the write being replaced
+    PendingWrite& operator=(PendingWrite&& other) {
+        if (result.valid()) result.wait();
+        result = std::move(other.result);
+        return *this;
+    }
+    ~PendingWrite() { if (result.valid()) result.wait(); }
+
+    // 0 once the data is written and the file closed, otherwise an errno value
+    int wait() { return result.valid() ? result.get() : 0; }
+
+private:
+    std::future<int> result;
+};
+
+// Asynchronous whole-file writes. Files are opened on the calling thread; the data transfer and
+// close are submitted to io_uring and completed on a reaper thread, so the caller can keep
+// computing. Without io_uring (kernel, seccomp or STEGONINJA_NO_IO_URING) a small thread pool
+// does the writes instead.
+class AsyncFileIO {
+public:
+    AsyncFileIO(unsigned queueDepth, bool useIoUring);
+    ~AsyncFileIO();
+
+    AsyncFileIO(const AsyncFileIO&) = delete;
+    AsyncFileIO& operator=(const AsyncFileIO&) = delete;
+
+    const char* backend() const;
+
+    // Create or truncate `path` and write `length` bytes from `data` into it
+    PendingWrite writeFile(const std::string& path, const void* data, size_t length);
+    // Write `length` bytes from `data` at `offset` of the open file `fd`, which is left open.
+    // The caller keeps `fd` open until the write completes.
+    PendingWrite writeAt(int fd, const void* data, size_t length, uint64_t offset);
+
+private:
+    struct Ring;
+    std::unique_ptr<Ring> ring;
+    std::unique_ptr<WorkerPool> fallback;
+};
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef BINARY_FRAME_H
+#define BINARY_FRAME_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Body of POST /image/bpcs/embed/raw (Content-Type: application/octet-stream):
+//
+//   offset 0   "SNB1"                       magic
+//   offset 4   cover length  (uint32, big-endian)
+//   offset 8   secret length (uint32, big-endian)
+//   offset 12  cover bytes, then secret bytes
+//
+// Options (filename, password, encrypt, randomize) travel as query parameters.
+const size_t EMBED_FRAME_HEADER_SIZE = 12;
+
+struct EmbedFrame {
+    std::string_view cover;
+    std::string_view secret;
+};
+
+// Split a framed body into views over the cover and secret; nothing is copied
+bool parseEmbedFrame(std::string_view body, EmbedFrame& frame, std::string& error);
+
+#endif
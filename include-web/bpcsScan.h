@@ -0,0 +1,23 @@
+#ifndef BPCS_SCAN_H
+#define BPCS_SCAN_H
+
+#include <vector>
+#include <cstdint>
+#include <string>
+
+#include "BMPstruct.h"
+
+// Minimum number of bit transitions for an 8x8 block to carry data
+const int BPCS_THRESHOLD = 34;
+
+// Complexity-scan every 8x8 block of every bit plane, in embedding order
+// (channel, bit plane from LSB upwards, row, column).
+std::vector<BlockPosition> findEligibleBlocks(const std::vector<RGB>& pixels, int width, int height);
+
+// Complexity of a single block packed as 8 rows of 8 bits
+int blockComplexity(uint64_t bits);
+
+// Pack the 8x8 block at (x, y) of one bit plane; bit j of row byte i is pixel (x + j, y + i)
+uint64_t packBlock(const std::vector<RGB>& pixels, int width, int channel, int bitPlane, int x, int y);
+
+#endif
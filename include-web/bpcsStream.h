@@ -0,0 +1,33 @@
+#ifndef BPCS_STREAM_H
+#define BPCS_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <tuple>
+
+#include "imgBPCSExtract.h"
+
+class ResultStore;
+struct OutputOptions;
+struct CapacityEstimate;
+
+// BPCS for images past the stream threshold, which are never decoded whole. The image goes
+// through a RowDecoder 8 rows at a time: one pass counts the eligible blocks of every block
+// row and bit plane, and a second embeds or extracts. The counts give each block its place in
+// the bitstream, so bits land exactly where the in-memory engine would put them and results
+// stay interchangeable. Memory is a few rows of pixels plus one count per block row and plane.
+// Randomized embedding shuffles the full block list and is refused here.
+
+// Embed into a cover held in memory. The stego image is encoded into the store row by row as
+// block rows complete; the response matches imgBPCSEmbed.
+std::tuple<std::string, int> imgBPCSEmbedStreamed(const std::string& fileId, const uint8_t* coverData, size_t coverSize, const std::string& coverFilename, const uint8_t* secretData, size_t secretSize, const std::string& secretFilename, const std::string& password, bool encrypt, bool randomize, const OutputOptions& output, ResultStore& store);
+
+// Same contract as bpcsExtract. After the counting pass the header and then the payload are
+// read, each pass stopping at the last block it needs.
+BPCSExtractResult bpcsExtractStreamed(const uint8_t* stegoData, size_t stegoSize, const std::string& password, bool encrypt, bool randomize);
+
+// Exact capacity from a counting pass; false when the format can't be decoded in stripes
+bool streamedCapacity(const uint8_t* data, size_t length, CapacityEstimate& estimate);
+
+#endif
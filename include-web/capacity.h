@@ -0,0 +1,32 @@
+#ifndef CAPACITY_H
+#define CAPACITY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct CoverEntry;
+
+// How much a cover can carry, in bytes of embedded data (name and length header included).
+// `method` says how the figure was reached: "header" (dimensions only, an upper bound),
+// "sample" (strided block rows, extrapolated), "scan", "stream" or "cache" (exact).
+struct CapacityEstimate {
+    int width = 0;
+    int height = 0;
+    uint64_t upperBound = 0;
+    uint64_t capacity = 0;
+    bool exact = false;
+    std::string method;
+};
+
+// Every block the complexity scan visits, times 8 bytes each
+uint64_t capacityUpperBound(int width, int height);
+
+// Exact capacity of a decoded and scanned cover
+CapacityEstimate coverCapacity(const CoverEntry& cover, const char* method);
+
+// Estimate from the image header, sampling `sampleRows` block rows straight out of the
+// pixel data when the upload is an uncompressed 24-bit BMP. Returns false for unknown formats.
+bool estimateCapacity(const uint8_t* data, size_t length, int sampleRows, CapacityEstimate& estimate);
+
+#endif
@@ -1,6 +0,0 @@
-#ifndef CONVERT_TO_BMP_H
-#define CONVERT_TO_BMP_H
-
-bool convertToBMP(const char* inputPath, const char* outputPath);
-
-#endif
\ No newline at end of file
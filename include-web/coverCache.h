@@ -0,0 +1,56 @@
+#ifndef COVER_CACHE_H
+#define COVER_CACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BMPstruct.h"
+
+// A decoded cover together with its complexity scan, shared read-only between requests
+struct CoverEntry {
+    int width = 0;
+    int height = 0;
+    std::vector<RGB> pixels;
+    std::vector<BlockPosition> eligibleBlocks;
+
+    size_t footprint() const {
+        return pixels.size() * sizeof(RGB) + eligibleBlocks.size() * sizeof(BlockPosition);
+    }
+};
+
+// 64-bit XXH64 digest of an uploaded file
+uint64_t contentHash(const void* data, size_t length, uint64_t seed = 0);
+
+// Decode an uploaded image in memory and run the complexity scan over it
+std::shared_ptr<const CoverEntry> decodeCover(const uint8_t* data, size_t length);
+
+// Bounded LRU of decoded covers keyed by the hash and size of the uploaded bytes,
+// so a repeated cover skips conversion, decoding and the complexity scan.
+class CoverCache {
+public:
+    explicit CoverCache(uint64_t byteBudget) : byteBudget(byteBudget) {}
+
+    std::shared_ptr<const CoverEntry> find(uint64_t hash, uint64_t size);
+    void insert(uint64_t hash, uint64_t size, std::shared_ptr<const CoverEntry> entry);
+
+private:
+    struct Slot {
+        uint64_t size;
+        std::shared_ptr<const CoverEntry> entry;
+        std::list<uint64_t>::iterator pos;
+    };
+
+    uint64_t byteBudget;
+    uint64_t usedBytes = 0;
+    std::mutex mutex;
+    std::list<uint64_t> order; // front = most recently used
+    std::unordered_map<uint64_t, Slot> slots;
+};
+
+#endif
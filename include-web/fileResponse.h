@@ -0,0 +1,22 @@
+#ifndef FILE_RESPONSE_H
+#define FILE_RESPONSE_H
+
+#include <httpserver.hpp>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+
+// Serve a file from disk through sendfile, honouring If-None-Match and a single
+// byte Range. Returns 404 when the file can't be opened.
+std::shared_ptr<httpserver::http_response> serveFile(const httpserver::http_request& req, const std::string& path, const std::string& contentType);
+
+// Same semantics for a body already held in memory; the buffer is sent without copying.
+std::shared_ptr<httpserver::http_response> serveBuffer(const httpserver::http_request& req, std::shared_ptr<const std::string> body, const std::string& etag, const std::string& contentType);
+
+// Strong validator derived from inode, size and mtime.
+std::string fileETag(const struct stat& st);
+
+// Content-Disposition value for a download, with the filename made header-safe
+std::string attachmentDisposition(const std::string& filename);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef IMAGE_ENCODE_H
+#define IMAGE_ENCODE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <zlib.h>
+
+#include "BMPstruct.h"
+#include "asyncIO.h"
+
+class WorkerPool;
+
+// Lossless container a stego result is written in
+enum class OutputFormat {
+    BMP,
+    PNG
+};
+
+// How results are encoded. PNG stripes are deflated on `encoders` when set, inline otherwise.
+// Streamed results are written through `io` when set.
+struct OutputOptions {
+    OutputFormat format = OutputFormat::BMP;
+    int level = 6;
+    WorkerPool* encoders = nullptr;
+    AsyncFileIO* io = nullptr;
+};
+
+// "bmp" or "png"; an empty name leaves `format` untouched
+bool parseOutputFormat(std::string_view name, OutputFormat& format);
+
+const char* outputContentType(OutputFormat format);
+
+// Name a result is stored and linked under: the id for BMP, the id plus ".png" for PNG
+std::string resultName(const std::string& fileId, OutputFormat format);
+
+// 24-bit RGB PNG with zlib level 0-9. Row stripes are filtered and deflated independently
+// and stitched into one zlib stream (sync-flushed blocks, combined Adler-32), so the output
+// is an ordinary single-stream PNG whatever the stripe count.
+std::string encodePNG(const std::vector<RGB>& pixels, int width, int height, int level, WorkerPool* pool);
+
+// Dispatch on options.format
+std::string encodeImage(const std::vector<RGB>& pixels, int width, int height, const OutputOptions& options);
+
+// Encodes an image into a file as rows arrive, top row first, for results too large to
+// hold encoded in memory. PNG output is a single serial deflate stream in fixed-size IDAT
+// chunks; options.encoders is not used. BMP is limited to 4 GiB by its header. With
+// options.io set, each full write buffer goes to disk through it while the next is encoded.
+class RowEncoder {
+public:
+    RowEncoder(const std::string& path, int width, int height, const OutputOptions& options);
+    ~RowEncoder();
+
+    RowEncoder(const RowEncoder&) = delete;
+    RowEncoder& operator=(const RowEncoder&) = delete;
+
+    // `rows` holds count * width pixels. Throws when the file can't be written.
+    void writeRows(const RGB* rows, int count);
+    // Completes and closes the file once every row has been written
+    void finish();
+
+    uint64_t bytesWritten() const { return bytesOut; }
+
+private:
+    void deflateInput(const uint8_t* data, size_t size, int flush);
+    void emitIDAT();
+    void flush();
+
+    OutputFormat format;
+    int width;
+    int height;
+    int rowsWritten = 0;
+    size_t rowSize = 0;
+    int fd = -1;
+    uint64_t bytesOut = 0;
+    std::string buffer;
+    AsyncFileIO* io;
+    // The buffer `pending` is writing; rows are encoded into `buffer` meanwhile
+    std::string writing;
+    PendingWrite pending;
+
+    z_stream zs;
+    bool deflating = false;
+    std::vector<uint8_t> previous;
+    std::vector<uint8_t> filtered;
+    std::vector<uint8_t> scratch;
+    std::vector<uint8_t> idat;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BMPstruct.h"
+
+// Every decoder produces the engines' native layout: interleaved RGB, top row first, rows
+// packed back to back (stride = width * sizeof(RGB)), in a buffer from the pixel pool.
+// Nothing is written to disk and no intermediate format is produced on the way.
+inline size_t imageStride(int width) {
+    return static_cast<size_t>(width) * sizeof(RGB);
+}
+
+// Auto picks the fastest decoder built in for the format; Stb forces stb_image (for benchmarks)
+enum class ImageDecoder {
+    Auto,
+    Stb
+};
+
+// Decode an encoded image (PNG, JPEG, BMP, ...) held in memory straight to RGB pixels.
+// Uncompressed 24-bit BMPs are converted row by row without a second buffer. JPEGs go through
+// libjpeg-turbo when built with STEGONINJA_JPEG_TURBO. Everything else, and any JPEG that
+// libjpeg-turbo rejects, goes through stb_image, whose buffer is released before returning.
+// Throws std::runtime_error when the data can't be decoded.
+std::vector<RGB> decodeImage(const uint8_t* data, size_t length, int& width, int& height, ImageDecoder decoder = ImageDecoder::Auto);
+
+// "libjpeg-turbo" or "stb_image"
+const char* jpegDecoderName();
+
+// Read only the image header to get its dimensions; false when the format isn't recognised
+bool imageDimensions(const uint8_t* data, size_t length, int& width, int& height);
+
+// Images with more pixels than this are never decoded whole: decodeImage refuses them and
+// they are processed a stripe at a time through a RowDecoder instead
+void setStreamThreshold(uint64_t pixels);
+bool exceedsStreamThreshold(const uint8_t* data, size_t length);
+
+// Decodes an image held in memory a few rows at a time, top row first, in the same pixel
+// layout as decodeImage. Working memory is a few rows, whatever the image size.
+class RowDecoder {
+public:
+    virtual ~RowDecoder() = default;
+
+    int width() const { return imageWidth; }
+    int height() const { return imageHeight; }
+
+    // The next `count` rows into `out`, which holds count * width pixels. Throws on corrupt data.
+    virtual void readRows(RGB* out, int count) = 0;
+
+protected:
+    int imageWidth = 0;
+    int imageHeight = 0;
+};
+
+// Uncompressed 24-bit BMP, non-interlaced 8-bit PNG, or JPEG when built with libjpeg-turbo;
+// nullptr for anything else
+std::unique_ptr<RowDecoder> openRowDecoder(const uint8_t* data, size_t length);
+
+#endif
@@ -11,20 +11,41 @@
 #include <filesystem>
 #include <cmath>
 #include <stdexcept>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <tuple>
+
+#include "BMPstruct.h"
+
+class ResultStore;
+struct CoverEntry;
+struct OutputOptions;
 
 // Function to read a BMP file and return pixel data
 // std::vector<RGB> readBMP(const std::string& filename, int& width, int& height);
 
-// Function to write pixel data to a BMP file
-void writeBMP(const std::string& filename, const std::vector<RGB>& pixels, int width, int height);
+// Function to encode pixel data as a top-down 24-bit BMP in memory
+std::string encodeBMP(const std::vector<RGB>& pixels, int width, int height);
+
+// The bytes embedded for a secret: name length, name, 32-bit length and data, encrypted in
+// place when asked. Allocated from the request arena.
+std::pmr::vector<uint8_t> buildPayload(const uint8_t* secretData, size_t secretSize, const std::string& secretFilename, const std::string& password, bool encrypt);
 
-// Function to read a secret file into a byte vector
-std::vector<uint8_t> readSecretFile(const std::string& filename);
+// Outcome of an in-memory embed. On success code is 200 and pixels hold the
+// stego image; otherwise message carries the JSON error body.
+struct BPCSEmbedResult {
+    int code = 200;
+    std::string message;
+    std::vector<RGB> pixels;
+    double psnr = 0.0;
+};
 
-// Function to encrypt data using Vigenere cipher
-std::vector<uint8_t> vigenereEncrypt(const std::vector<uint8_t>& data, const std::string& key);
+// Embed a named secret into a copy of the cover without touching the disk
+BPCSEmbedResult bpcsEmbed(const CoverEntry& cover, const uint8_t* secretData, size_t secretSize, const std::string& secretFilename, const std::string& password, bool encrypt, bool randomize);
 
-// Main function to embed secret data into a BMP image
-std::tuple<std::string, int> imgBPCSEmbed(const std::string& fileId, const std::string& coverFilename, const std::string& secretFilename, const std::string& password, bool encrypt, bool randomize);
+// Main function to embed a secret held in memory into a decoded cover; the result is encoded
+// as `output` asks and published to `store` under resultName(fileId, output.format)
+std::tuple<std::string, int> imgBPCSEmbed(const std::string& fileId, const CoverEntry& cover, const std::string& coverFilename, const uint8_t* secretData, size_t secretSize, const std::string& secretFilename, const std::string& password, bool encrypt, bool randomize, const OutputOptions& output, ResultStore& store);
 
 #endif
\ No newline at end of file
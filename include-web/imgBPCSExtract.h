@@ -7,8 +7,28 @@
 #include <tuple>
 #include <filesystem>
 
+#include "BMPstruct.h"
+
+class ResultStore;
+
+// Outcome of an in-memory extract. On success code is 200 and filename/data
+// hold the recovered secret; otherwise message carries the JSON error body.
+struct BPCSExtractResult {
+    int code = 200;
+    std::string message;
+    std::string filename;
+    std::string data;
+};
+
+// Recover the embedded secret from stego pixels. Throws std::runtime_error on corrupt payloads.
+BPCSExtractResult bpcsExtract(const std::vector<RGB>& pixels, int width, int height, const std::string& password, bool encrypt, bool randomize);
+
+// Decode an uploaded stego image and extract from it. Images past the stream threshold are
+// never decoded whole; they go through bpcsExtractStreamed.
+BPCSExtractResult bpcsExtractImage(const uint8_t* stegoData, size_t stegoSize, const std::string& password, bool encrypt, bool randomize);
+
 // std::vector<RGB> readBMP(const std::string& filename, int& width, int& height);
-std::vector<uint8_t> vigenereDecrypt(const std::vector<uint8_t>& data, const std::string& key);
-std::tuple<std::string, int> imgBPCSExtract(const std::string& fileId, const std::string& password, bool encrypt, bool randomize);
+// Extract from an uploaded stego image held in memory and publish the secret to `store` under fileId
+std::tuple<std::string, int> imgBPCSExtract(const std::string& fileId, const uint8_t* stegoData, size_t stegoSize, const std::string& password, bool encrypt, bool randomize, ResultStore& store);
 
 #endif // IMG_BPCS_EXTRACT_H
\ No newline at end of file
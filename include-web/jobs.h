@@ -0,0 +1,99 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+enum class JobPhase {
+    Waiting,
+    Decoding,
+    Scanning,
+    Embedding,
+    Extracting,
+    Writing,
+    Done,
+    Failed,
+    Cancelled
+};
+
+// Progress of one embed or extract, written by the engine with relaxed atomics and
+// read by whoever is streaming it. Totals are zero until the engine knows them.
+struct JobProgress {
+    std::atomic<int> phase{static_cast<int>(JobPhase::Waiting)};
+    std::atomic<uint64_t> blocksScanned{0};
+    std::atomic<uint64_t> blocksTotal{0};
+    std::atomic<uint64_t> bitsEmbedded{0};
+    std::atomic<uint64_t> bitsTotal{0};
+    std::atomic<uint64_t> bytesWritten{0};
+    std::atomic<int> code{0};
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> started{false};
+    std::chrono::steady_clock::time_point created = std::chrono::steady_clock::now();
+    std::atomic<int64_t> finishedAt{0}; // steady_clock ticks, 0 while running
+};
+
+// Thrown from inside an engine when its job has been cancelled
+class JobCancelled : public std::runtime_error {
+public:
+    JobCancelled() : std::runtime_error("Job cancelled") {}
+};
+
+const char* jobPhaseName(JobPhase phase);
+
+// One-line JSON snapshot of a job, as sent in each progress event
+std::string jobSnapshot(const JobProgress& job);
+
+// Client-named jobs. Either the request doing the work or the client watching it may arrive
+// first, so both acquire the entry. Finished jobs linger briefly so a late watcher still sees the outcome.
+class JobRegistry {
+public:
+    explicit JobRegistry(size_t maxJobs) : maxJobs(maxJobs) {}
+
+    // nullptr when the registry is full
+    std::shared_ptr<JobProgress> acquire(const std::string& id);
+    bool cancel(const std::string& id);
+
+private:
+    void purge();
+
+    size_t maxJobs;
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<JobProgress>> jobs;
+};
+
+// Makes a job the current one for this thread so engines can report into it without
+// threading it through every call. Without a scope the engines skip reporting entirely.
+class JobScope {
+public:
+    explicit JobScope(std::shared_ptr<JobProgress> job);
+    ~JobScope();
+
+    JobScope(const JobScope&) = delete;
+    JobScope& operator=(const JobScope&) = delete;
+
+    // Record the HTTP status the request finished with
+    void finish(int code);
+
+private:
+    std::shared_ptr<JobProgress> job;
+    JobProgress* previous;
+    bool finished = false;
+};
+
+JobProgress* currentJob();
+
+inline void setJobPhase(JobProgress* job, JobPhase phase) {
+    if (job) job->phase.store(static_cast<int>(phase), std::memory_order_relaxed);
+}
+
+inline void checkCancelled(const JobProgress* job) {
+    if (job && job->cancelled.load(std::memory_order_relaxed)) throw JobCancelled();
+}
+
+#endif
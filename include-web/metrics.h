@@ -0,0 +1,103 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Processing stages timed inside the request handlers
+enum class Stage {
+    MultipartParse,
+    Decode,
+    ComplexityScan,
+    Embed,
+    PSNR,
+    WriteBMP,
+    EncodePNG,
+    Publish,
+    Extract,
+    QueueWait,
+    COUNT
+};
+
+// Monotonic counters
+enum class Counter {
+    CoverBytes,
+    SecretBytes,
+    StegoBytes,
+    ResultBytes,
+    ExtractedBytes,
+    CoverCacheHits,
+    CoverCacheMisses,
+    RejectedStatic,
+    RejectedExtract,
+    RejectedCapacity,
+    RejectedEmbed,
+    COUNT
+};
+
+// Endpoints tracked for request totals and in-flight gauges
+enum class Endpoint {
+    Index,
+    Embed,
+    Extract,
+    Result,
+    Metrics,
+    EmbedRaw,
+    ExtractRaw,
+    EmbedBatch,
+    Capacity,
+    JobEvents,
+    JobCancel,
+    ExtractResult,
+    COUNT
+};
+
+// Admission classes, highest priority first; see AdmissionScheduler
+enum class WorkClass {
+    Static,
+    Extract,
+    Capacity,
+    Embed,
+    COUNT
+};
+
+// Recording is lock-free: every thread owns a shard of histograms and counters
+// that only it writes, and a scrape sums the shards.
+void observeStage(Stage stage, std::chrono::nanoseconds elapsed);
+void addCounter(Counter counter, uint64_t amount = 1);
+
+// Queue depth and admitted requests per admission class, published by the scheduler
+void setAdmissionGauges(WorkClass workClass, int64_t queued, int64_t running);
+
+// Prometheus text exposition format (version 0.0.4)
+std::string renderMetrics();
+
+// Times a stage from construction to destruction
+class StageTimer {
+public:
+    explicit StageTimer(Stage stage) : stage(stage), start(std::chrono::steady_clock::now()) {}
+    ~StageTimer() { observeStage(stage, std::chrono::steady_clock::now() - start); }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    Stage stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Counts a request and keeps it in the in-flight gauge for its lifetime
+class InFlightRequest {
+public:
+    explicit InFlightRequest(Endpoint endpoint);
+    ~InFlightRequest();
+
+    InFlightRequest(const InFlightRequest&) = delete;
+    InFlightRequest& operator=(const InFlightRequest&) = delete;
+
+private:
+    Endpoint endpoint;
+};
+
+#endif
@@ -3,18 +3,30 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <optional>
 
-std::vector<std::pair<std::string, std::string>> parse_multipart(
-    const std::string& body,
+// Filename and content of one file part. The content views the request body, which
+// must outlive it; nothing is copied out of the upload.
+using MultipartFile = std::pair<std::string, std::string_view>;
+
+std::vector<MultipartFile> parse_multipart(
+    std::string_view body,
     const std::string& boundary
 );
 
-std::optional<std::pair<std::string, std::string>> get_file_by_name(
-    const std::string& body,
+std::optional<MultipartFile> get_file_by_name(
+    std::string_view body,
+    const std::string& boundary,
+    const std::string& target_name
+);
+
+// Every file part sent under `target_name`, in body order
+std::vector<MultipartFile> get_files_by_name(
+    std::string_view body,
     const std::string& boundary,
     const std::string& target_name
 );
 
-#endif
\ No newline at end of file
+#endif
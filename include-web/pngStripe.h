@@ -0,0 +1,46 @@
+#ifndef PNG_STRIPE_H
+#define PNG_STRIPE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+// Striped PNG encoding shared by the web server (imageEncode) and the CLI (PngWriter). Only
+// depends on zlib. Row stripes are filtered and deflated independently and stitched into one
+// zlib stream (sync-flushed blocks, combined Adler-32), pigz style, so callers can encode the
+// stripes on whatever threads they have and still emit an ordinary single-stream PNG.
+
+// One stripe's IDAT payload. The first stripe carries the zlib header and, after
+// finishPngStripes, the last one carries the stream's Adler-32.
+struct PngStripe {
+    std::vector<uint8_t> deflated;
+    uLong adler = 0;
+    size_t rawLength = 0;
+};
+
+// Rows per stripe for an 8-bit image with `channels` channels
+int pngStripeRows(int width, int channels);
+
+// Filter one row with each of None/Sub/Up/Paeth and keep the one with the smallest sum of
+// absolute signed bytes, the heuristic libpng uses by default. `out` gets the filter byte and
+// rowBytes filtered bytes. `prev` is null on the first row.
+void pngFilterRow(const uint8_t* row, const uint8_t* prev, size_t rowBytes, int bpp, uint8_t* out, std::vector<uint8_t>& scratch);
+
+// Filters and deflates rows [y0, y1) of an 8-bit grey, RGB or RGBA image (`channels` 1, 3 or
+// 4) at zlib level 0-9. `rows[y]` points at row y; with `bgr` set the rows are BGR(A) and the
+// first and third channels are swapped into PNG order. Returns false when zlib fails.
+bool encodePngStripe(const uint8_t* const* rows, int width, int channels, bool bgr, int y0, int y1, int level, bool last, PngStripe& stripe);
+
+// Appends the combined Adler-32 to the last stripe once every stripe is encoded
+void finishPngStripes(std::vector<PngStripe>& stripes);
+
+// PNG signature and IHDR for an 8-bit image with `channels` channels
+void appendPngHeader(std::string& out, int width, int height, int channels);
+
+// Length, type, payload and CRC of one chunk
+void appendPngChunk(std::string& out, const char* type, const uint8_t* data, size_t size);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef PREFORK_H
+#define PREFORK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+enum class CpuPinning {
+    None,
+    Cores,  // each worker gets its own contiguous slice of the allowed CPUs
+    Numa    // workers are spread round-robin over NUMA nodes
+};
+
+// "cores", "numa" or anything else for no pinning
+CpuPinning parsePinning(const std::string& name);
+
+// CPUs this process may run on, which is fewer than the machine has once a worker is pinned
+size_t availableCpus();
+
+// A listening IPv4 socket on `port` with SO_REUSEPORT set, so every worker can bind its
+// own and the kernel spreads connections between them. Returns -1 on failure.
+int reusePortSocket(uint16_t port);
+
+// Forks `workers` processes that each run serve(index) and restarts any that exit, backing
+// off when one keeps dying young. Returns once SIGTERM or SIGINT has stopped them all.
+int runPrefork(size_t workers, CpuPinning pinning, const std::function<int(size_t)>& serve);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef REQUEST_ARENA_H
+#define REQUEST_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+#include "BMPstruct.h"
+
+// Scratch memory for one request. Payload bytes, shuffled block lists and the like are
+// bump-allocated and all released together when the scope ends. The outermost arena on a
+// thread starts in a buffer that thread keeps between requests, so most requests never
+// reach malloc for them.
+class RequestArena {
+public:
+    RequestArena();
+    ~RequestArena();
+
+    RequestArena(const RequestArena&) = delete;
+    RequestArena& operator=(const RequestArena&) = delete;
+
+    std::pmr::memory_resource* resource() { return &arena; }
+
+private:
+    std::unique_ptr<std::byte[]> ownBuffer;
+    std::pmr::monotonic_buffer_resource arena;
+    RequestArena* previous;
+};
+
+// The current thread's arena, or the default heap resource outside any RequestArena
+std::pmr::memory_resource* requestMemory();
+
+// Whole-image pixel buffers are too big for the arena and too big to churn through malloc:
+// released buffers are kept, up to a byte budget, and handed to the next request that fits.
+// The returned vector has exactly `count` pixels; recycled contents are not cleared.
+std::vector<RGB> acquirePixels(size_t count);
+void releasePixels(std::vector<RGB>&& pixels);
+void setPixelPoolBudget(uint64_t bytes);
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef RESULT_STORE_H
+#define RESULT_STORE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class AsyncFileIO;
+
+// Result bytes kept in memory for recently published ids
+struct HotResult {
+    std::shared_ptr<const std::string> data;
+    std::string etag;
+};
+
+// Disk-backed store for produced results with a byte budget and a TTL.
+// Files are published atomically (temp file + rename) so readers never see a
+// partial result. Access time marks recency, which keeps the LRU order in the
+// filesystem rather than in this process. A background janitor expires and
+// evicts results.
+class ResultStore {
+public:
+    ResultStore(std::string root, uint64_t byteBudget, std::chrono::seconds ttl, uint64_t hotBudget);
+    ~ResultStore();
+
+    ResultStore(const ResultStore&) = delete;
+    ResultStore& operator=(const ResultStore&) = delete;
+
+    void startJanitor(std::chrono::seconds interval);
+    // Write results through `io` instead of blocking write calls
+    void setFileIO(AsyncFileIO* io) { this->io = io; }
+    void stopJanitor();
+
+    bool publish(const std::string& id, std::shared_ptr<const std::string> data);
+    // For results written straight to disk: fill stagingPath(id), then publishStaged renames
+    // it into place. Such results are too big for the hot cache and never enter it.
+    std::string stagingPath(const std::string& id) const;
+    bool publishStaged(const std::string& id);
+    std::shared_ptr<const HotResult> hot(const std::string& id);
+    void touch(const std::string& id) const;
+    std::string path(const std::string& id) const;
+
+    // One eviction pass; the janitor calls this on every tick
+    void sweep();
+
+private:
+    struct HotSlot {
+        std::shared_ptr<const HotResult> result;
+        std::chrono::steady_clock::time_point expires;
+        std::list<std::string>::iterator pos;
+    };
+
+    void insertHot(const std::string& id, std::shared_ptr<const HotResult> result);
+    void dropHot(const std::string& id);
+    void janitorLoop(std::chrono::seconds interval);
+
+    std::string root;
+    uint64_t byteBudget;
+    std::chrono::seconds ttl;
+    uint64_t hotBudget;
+    AsyncFileIO* io = nullptr;
+
+    std::mutex hotMutex;
+    std::list<std::string> hotOrder; // front = most recently used
+    std::unordered_map<std::string, HotSlot> hotSlots;
+    uint64_t hotBytes = 0;
+
+    std::mutex janitorMutex;
+    std::condition_variable janitorWake;
+    bool janitorStop = false;
+    bool sweepRequested = false;
+    uint64_t bytesSinceSweep = 0;
+    std::thread janitor;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include "metrics.h"
+
+static const size_t WORK_CLASS_COUNT = static_cast<size_t>(WorkClass::COUNT);
+
+struct ClassLimits {
+    size_t running;  // requests of this class doing work at once
+    size_t queued;   // requests allowed to wait; further ones are turned away
+    bool usesCpu;    // counts against the shared CPU slots
+};
+
+// Admission control for request handlers. Every class has its own concurrency limit and FIFO
+// queue; CPU-bound classes also share a fixed number of CPU slots. When a slot frees up it goes
+// to the highest-priority class (WorkClass order) whose head request is able to run, so a flood
+// of embeds queues behind its own limit instead of delaying static files and extracts. A request
+// that fans out over several threads holds one CPU slot per thread.
+class AdmissionScheduler {
+public:
+    AdmissionScheduler(size_t cpuSlots, const std::array<ClassLimits, WORK_CLASS_COUNT>& limits, std::chrono::milliseconds maxWait);
+
+    // Held for as long as the request does its work; false when the request was turned away
+    class Ticket {
+    public:
+        Ticket() = default;
+        Ticket(AdmissionScheduler* scheduler, WorkClass workClass, size_t slots) : scheduler(scheduler), workClass(workClass), slots(slots) {}
+        Ticket(Ticket&& other) noexcept : scheduler(other.scheduler), workClass(other.workClass), slots(other.slots) { other.scheduler = nullptr; }
+        Ticket& operator=(Ticket&&) = delete;
+        ~Ticket() { if (scheduler) scheduler->release(workClass, slots); }
+
+        explicit operator bool() const { return scheduler != nullptr; }
+
+    private:
+        AdmissionScheduler* scheduler = nullptr;
+        WorkClass workClass = WorkClass::Static;
+        size_t slots = 0;
+    };
+
+    // Blocks until the request may run, its queue is full, or it has waited maxWait. CPU-bound
+    // classes take `slots` CPU slots (at most all of them) for as long as the ticket is held.
+    Ticket admit(WorkClass workClass, size_t slots = 1);
+
+private:
+    struct Waiter {
+        uint64_t id;
+        size_t slots;
+    };
+
+    bool canRun(size_t c, size_t slots) const;
+    bool outranked(size_t c) const;
+    void release(WorkClass workClass, size_t slots);
+    void publish(size_t c);
+
+    size_t cpuSlots;
+    std::array<ClassLimits, WORK_CLASS_COUNT> limits;
+    std::chrono::milliseconds maxWait;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t cpuRunning = 0;
+    uint64_t nextWaiter = 0;
+    std::array<size_t, WORK_CLASS_COUNT> running{};
+    std::array<std::deque<Waiter>, WORK_CLASS_COUNT> waiting;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef LSB_KERNELS_H
+#define LSB_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Bulk LSB embedding over a flat carrier: payload byte i always lands in the
+// least significant bits of carrier bytes 8i..8i+7, so callers pass the data of
+// a continuous cv::Mat (or any byte buffer) and a payload of whole bytes. The
+// widest kernel the CPU supports is picked once at startup: AVX2 moves 32
+// payload bits per instruction, SSE2 16, and the portable fallback 8 at a time
+// with 64-bit SWAR.
+//
+// With k bits per sample (1-4) each carrier byte takes the next k payload bits
+// in the same order, so k payload bytes fill 8 carrier bytes. Each k has its
+// own compile-time instance; only k = 1 has SIMD kernels.
+namespace LsbKernels {
+
+constexpr int MAX_BITS = 4;
+
+// Which payload bit goes into the first carrier byte
+enum class BitOrder {
+  MsbFirst, // image payloads (embedImage, embedData)
+  LsbFirst  // text messages (embedMessage)
+};
+
+enum class Backend { Scalar, SSE2, AVX2 };
+
+// Carrier bytes that `bytes` payload bytes take at `bits` bits per sample
+constexpr size_t carrierBytes(size_t bytes, int bits) {
+  return (bytes * 8 + bits - 1) / bits;
+}
+
+// Overwrite the low `bits` bits of carrier[0, carrierBytes(bytes, bits)) with
+// the bits of payload
+void embed(uint8_t *carrier, const uint8_t *payload, size_t bytes,
+           BitOrder order, int bits = 1);
+
+// Read `bytes` payload bytes back from carrier[0, carrierBytes(bytes, bits))
+void extract(const uint8_t *carrier, uint8_t *payload, size_t bytes,
+             BitOrder order, int bits = 1);
+
+// The low K bits of a single sample, for loops that visit samples one at a
+// time (video frames, shuffled audio samples)
+template <int K> struct Sample {
+  static_assert(K >= 1 && K <= MAX_BITS, "1 to 4 bits per sample");
+  static constexpr uint8_t MASK = (1u << K) - 1;
+
+  static constexpr uint8_t set(uint8_t sample, unsigned bits) {
+    return static_cast<uint8_t>((sample & ~MASK) | (bits & MASK));
+  }
+  static constexpr uint8_t get(uint8_t sample) { return sample & MASK; }
+};
+
+// Call f(std::integral_constant<int, K>) for a runtime k in 1..4, so the body
+// can be written once as a generic lambda and instantiated per K
+template <typename F> decltype(auto) withBits(int bits, F &&f) {
+  switch (bits) {
+  case 2:
+    return f(std::integral_constant<int, 2>());
+  case 3:
+    return f(std::integral_constant<int, 3>());
+  case 4:
+    return f(std::integral_constant<int, 4>());
+  default:
+    return f(std::integral_constant<int, 1>());
+  }
+}
+
+// The kernel in use, and a way to pin a narrower one for benchmarks; asking
+// for one the CPU lacks keeps the current kernel and returns false
+Backend backend();
+bool setBackend(Backend backend);
+const char *backendName(Backend backend);
+
+} // namespace LsbKernels
+
+#endif // LSB_KERNELS_H
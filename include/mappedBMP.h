@@ -0,0 +1,62 @@
+#ifndef MAPPED_BMP_H
+#define MAPPED_BMP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// An uncompressed 24-bit BMP mapped into memory. Rows are addressed top row first and point
+// straight into the mapping, so a bottom-up file (the usual kind) has a negative stride.
+// Pixels are stored B, G, R as in the file.
+//
+// Read maps the file shared and read-only. CopyOnWrite maps it private and writable: pages
+// are only copied once a pixel on them changes, and the file itself is never modified.
+class MappedBMP {
+public:
+    enum class Access {
+        Read,
+        CopyOnWrite
+    };
+
+    explicit MappedBMP(const std::string& filename, Access access = Access::Read);
+    ~MappedBMP();
+
+    MappedBMP(const MappedBMP&) = delete;
+    MappedBMP& operator=(const MappedBMP&) = delete;
+
+    int width() const { return imageWidth; }
+    int height() const { return imageHeight; }
+    ptrdiff_t stride() const { return rowStride; }
+
+    const uint8_t* row(int y) const { return firstRow + rowStride * y; }
+    uint8_t* row(int y) { return firstRow + rowStride * y; }
+
+    // Channel 0 is red, 1 green, 2 blue
+    uint8_t sample(int x, int y, int channel) const { return row(y)[x * 3 + 2 - channel]; }
+    uint8_t& sample(int x, int y, int channel) { return row(y)[x * 3 + 2 - channel]; }
+
+    // sample() for BPCS blocks, which read the image as one run of pixels: an `x` past the
+    // right edge continues into the rows below, as in the web engine's block scan
+    uint8_t wrappedSample(int x, int y, int channel) const {
+        size_t index = static_cast<size_t>(y) * imageWidth + x;
+        return sample(static_cast<int>(index % imageWidth), static_cast<int>(index / imageWidth), channel);
+    }
+    uint8_t& wrappedSample(int x, int y, int channel) {
+        size_t index = static_cast<size_t>(y) * imageWidth + x;
+        return sample(static_cast<int>(index % imageWidth), static_cast<int>(index / imageWidth), channel);
+    }
+
+    // Write the mapped file, headers and all, with one write call per chunk the kernel accepts.
+    // The file is replaced by rename, so `filename` may be the mapped file itself.
+    void write(const std::string& filename) const;
+
+private:
+    uint8_t* mapping = nullptr;
+    size_t length = 0;
+    uint8_t* firstRow = nullptr;
+    ptrdiff_t rowStride = 0;
+    int imageWidth = 0;
+    int imageHeight = 0;
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+
+// Lossless PNG output for stego images. Row stripes are filtered and deflated
+// by the encoder shared with the web server (include-web/pngStripe.h) on
+// OpenCV's worker threads (cv::parallel_for_, so cv::setNumThreads applies) and
+// stitched into one zlib stream with sync flushes and a combined Adler-32,
+// pigz style. Any decoder reads the result; each stripe is its own IDAT chunk.
+namespace PngWriter {
+
+// 8-bit grey, BGR or BGRA images at zlib level 0-9. Returns false for any other
+// image type or when the file can't be written.
+bool write(const std::string &path, const cv::Mat &image, int level = 6);
+
+// write() for ".png" paths and image types it supports, cv::imwrite otherwise
+bool writeImage(const std::string &path, const cv::Mat &image, int level = 6);
+
+} // namespace PngWriter
+
+#endif // PNG_WRITER_H
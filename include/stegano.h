@@ -4,28 +4,83 @@
 #include <opencv2/opencv.hpp>
 #include <string>
 
+// LSB steganography over 8-bit BGR images. Nothing here touches the terminal or
+// a window: every call reports what happened in its result, so the engine runs
+// the same under the TUI, in batch jobs or behind a server.
 namespace Stegano {
-bool embedMessage(const std::string &inputImage, const std::string &outputImage,
-                  const std::string &message);
-bool embedImage(const cv::Mat &carrier, const cv::Mat &secret,
-                const std::string &key, const std::string &outputPath);
 
-bool embedImage(const cv::Mat &carrier, const cv::Mat &secret,
-                const std::string &outputPath);
+struct EmbedResult {
+  bool ok = false;
+  std::string error;        // why the embed failed, empty on success
+  cv::Mat stego;            // the stego image, also when it wasn't saved
+  size_t capacityBytes = 0; // at the requested bits per channel
+  size_t payloadBytes = 0;  // bytes embedded, length header included
+  double embedMs = 0;       // time spent setting bits
+  double writeMs = 0;       // time encoding and saving the output
+};
 
-bool extractImage(const cv::Mat &carrier_img, const std::string &key,
-                  const std::string &outputPath);
+struct ExtractResult {
+  bool ok = false;
+  std::string error;       // why the extract failed, empty on success
+  cv::Mat image;           // the recovered image (extractImage)
+  std::string message;     // the recovered text (extractMessage)
+  bool encrypted = false;  // the message header's encrypted flag
+  int bitsPerSample = 1;   // bits per channel the payload was embedded with
+  size_t payloadBytes = 0; // bytes read back, length header included
+  double extractMs = 0;    // time spent reading bits and decoding
+  double writeMs = 0;      // time encoding and saving the output
+};
 
-bool extractImage(const cv::Mat &carrier_img, const std::string &outputPath);
+// Text messages start with a 9-byte header: "SNM", a format version, flags
+// (bit 0: encrypted, bits 1-2: bits per sample - 1) and the message length,
+// big endian. extractMessage reads
+// the header from the first 24 pixels and stops there when it isn't one, so a
+// clean image costs next to nothing. The message itself is stored as is, with
+// no terminator.
+//
+// Outputs ending in .png are written by PngWriter at zlib level `pngLevel`
+// (0-9), other extensions by cv::imwrite. An empty output path skips the write
+// and leaves the image in the result only.
+//
+// `bitsPerSample` (1-4) is how many low bits of each channel carry payload:
+// k = 2 holds twice the data of k = 1 at a lower PSNR. The headers themselves
+// always use one bit and record k, so the extract calls take no k.
+EmbedResult embedMessage(const std::string &inputImage,
+                         const std::string &outputImage,
+                         const std::string &message, bool encrypted = false,
+                         int pngLevel = 6, int bitsPerSample = 1);
+EmbedResult embedImage(const cv::Mat &carrier, const cv::Mat &secret,
+                       const std::string &key, const std::string &outputPath,
+                       int pngLevel = 6, int bitsPerSample = 1);
 
-bool extractMessage(const std::string &inputImage, std::string &message);
+EmbedResult embedImage(const cv::Mat &carrier, const cv::Mat &secret,
+                       const std::string &outputPath, int pngLevel = 6,
+                       int bitsPerSample = 1);
+
+ExtractResult extractImage(const cv::Mat &carrier_img, const std::string &key,
+                           const std::string &outputPath);
+
+ExtractResult extractImage(const cv::Mat &carrier_img,
+                           const std::string &outputPath);
+
+ExtractResult extractMessage(const std::string &inputImage);
+
+// Payloads over a few hundred KiB are embedded and extracted in equal stripes
+// on cv::parallel_for_. `threads` caps the stripes: 0 (the default) uses every
+// OpenCV thread, 1 keeps everything on the calling thread.
+void setThreads(int threads);
+
+// Peak signal-to-noise ratio between a cover and its stego image in dB;
+// infinity when they are identical
+double psnr(const cv::Mat &original, const cv::Mat &stego);
 
 std::vector<unsigned char> intToBytes(int value);
 
 int bytesToInt(const std::vector<unsigned char> &bytes);
 
 bool embedData(const cv::Mat &coverImage,
-               const std::vector<unsigned char> &data, cv::Mat &stegoImage);
+               const std::vector<unsigned char> &data, cv::Mat &stegoImage,
+               int bitsPerSample = 1);
 
 } // namespace Stegano
 
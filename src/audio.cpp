@@ -1,3 +1,4 @@
+#include "lsbKernels.h"
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -7,6 +8,15 @@
 #include <cstdint>
 #include <cmath>
 #include <climits>
+#include <cstdlib>
+#include <numeric>
+
+using LsbKernels::Sample;
+
+// The 8-byte header size is stored one bit per sample; its top byte holds
+// bits per sample - 1 for everything after it
+const size_t SIZE_SAMPLES = 64;
+const int BITS_SHIFT = 56;
 
 struct WavHeader {
     uint32_t riff;
@@ -77,7 +87,47 @@ size_t find_data_chunk(const std::vector<uint8_t>& wav, size_t& data_size) {
     throw std::runtime_error("Could not find data chunk");
 }
 
-void embed_data(const std::string& cover_file, const std::string& secret_file, const std::string& output_file, const std::string& password, bool encrypt, bool randomize) {
+// Write `data` into samples indices[first...], K bits per sample, MSB first
+template <int K>
+void embed_bits(std::vector<uint8_t>& wav, size_t data_start, const std::vector<size_t>& indices,
+                size_t first, const std::vector<uint8_t>& data) {
+    size_t total_bits = data.size() * 8;
+    size_t samples = LsbKernels::carrierBytes(data.size(), K);
+    for (size_t n = 0; n < samples; ++n) {
+        unsigned field = 0;
+        for (int b = 0; b < K; ++b) {
+            size_t bit = n * K + b;
+            unsigned value = bit < total_bits ? (data[bit / 8] >> (7 - bit % 8)) & 1 : 0;
+            field = field << 1 | value;
+        }
+        if (first + n >= indices.size()) throw std::runtime_error("Index out of bounds");
+        size_t pos = data_start + indices[first + n];
+        wav[pos] = Sample<K>::set(wav[pos], field);
+    }
+}
+
+template <int K>
+std::vector<uint8_t> extract_bits(const std::vector<uint8_t>& wav, size_t data_start,
+                                  const std::vector<size_t>& indices, size_t first, size_t bytes) {
+    std::vector<uint8_t> data(bytes);
+    size_t total_bits = bytes * 8;
+    size_t samples = LsbKernels::carrierBytes(bytes, K);
+    for (size_t n = 0; n < samples; ++n) {
+        if (first + n >= indices.size()) throw std::runtime_error("Index out of bounds");
+        unsigned field = Sample<K>::get(wav[data_start + indices[first + n]]);
+        for (int b = 0; b < K; ++b) {
+            size_t bit = n * K + b;
+            if (bit < total_bits)
+                data[bit / 8] |= ((field >> (K - 1 - b)) & 1) << (7 - bit % 8);
+        }
+    }
+    return data;
+}
+
+void embed_data(const std::string& cover_file, const std::string& secret_file, const std::string& output_file, const std::string& password, bool encrypt, bool randomize, int bits_per_sample) {
+    if (bits_per_sample < 1 || bits_per_sample > LsbKernels::MAX_BITS)
+        throw std::runtime_error("Bits per sample must be 1-4");
+
     auto wav = read_file(cover_file);
     size_t data_size;
     size_t data_start = find_data_chunk(wav, data_size);
@@ -98,29 +148,22 @@ void embed_data(const std::string& cover_file, const std::string& secret_file, c
     
     if (encrypt) vigenere_cipher(header, password, true);
     
-    std::vector<uint8_t> full_data;
-    uint64_t header_size = header.size();
-    full_data.insert(full_data.end(), reinterpret_cast<uint8_t*>(&header_size), reinterpret_cast<uint8_t*>(&header_size) + 8);
-    full_data.insert(full_data.end(), header.begin(), header.end());
+    uint64_t header_size = header.size() | static_cast<uint64_t>(bits_per_sample - 1) << BITS_SHIFT;
+    std::vector<uint8_t> size_bytes(reinterpret_cast<uint8_t*>(&header_size), reinterpret_cast<uint8_t*>(&header_size) + 8);
     
-    size_t required_bits = full_data.size() * 8;
-    if (required_bits > data_size) {
-        throw std::runtime_error("Insufficient capacity: " + std::to_string(required_bits) + 
-                                 " bits required, " + std::to_string(data_size) + " available");
+    size_t required_samples = SIZE_SAMPLES + LsbKernels::carrierBytes(header.size(), bits_per_sample);
+    if (required_samples > data_size) {
+        throw std::runtime_error("Insufficient capacity: " + std::to_string(required_samples) + 
+                                 " samples required, " + std::to_string(data_size) + " available");
     }
     
     unsigned int seed = generate_seed(password);
     auto indices = generate_indices(data_size, seed, randomize);
     
-    for (size_t i = 0; i < full_data.size(); ++i) {
-        uint8_t byte = full_data[i];
-        for (int bit = 7; bit >= 0; --bit) {
-            size_t idx = i * 8 + (7 - bit);
-            if (idx >= indices.size()) throw std::runtime_error("Index out of bounds");
-            size_t pos = data_start + indices[idx];
-            wav[pos] = (wav[pos] & 0xFE) | ((byte >> bit) & 1);
-        }
-    }
+    embed_bits<1>(wav, data_start, indices, 0, size_bytes);
+    LsbKernels::withBits(bits_per_sample, [&](auto k) {
+        embed_bits<decltype(k)::value>(wav, data_start, indices, SIZE_SAMPLES, header);
+    });
     
     // Calculate PSNR
     double P0 = 0.0, P1 = 0.0;
@@ -155,34 +198,19 @@ void extract_data(const std::string& stego_file, const std::string& password, bo
     unsigned int seed = generate_seed(password);
     auto indices = generate_indices(data_size, seed, randomize);
     
-    std::vector<uint8_t> header_size_bytes(8);
-    for (size_t i = 0; i < 8; ++i) {
-        uint8_t byte = 0;
-        for (int bit = 7; bit >= 0; --bit) {
-            size_t idx = i * 8 + (7 - bit);
-            if (idx >= indices.size()) throw std::runtime_error("Index out of bounds");
-            size_t pos = data_start + indices[idx];
-            byte |= (wav[pos] & 1) << bit;
-        }
-        header_size_bytes[i] = byte;
-    }
-    
-    uint64_t header_size = *reinterpret_cast<uint64_t*>(header_size_bytes.data());
-    if (header_size > data_size) {
+    auto header_size_bytes = extract_bits<1>(wav, data_start, indices, 0, 8);
+    uint64_t header_field = *reinterpret_cast<uint64_t*>(header_size_bytes.data());
+    uint64_t bits_tag = header_field >> BITS_SHIFT;
+    uint64_t header_size = header_field & ((uint64_t(1) << BITS_SHIFT) - 1);
+    if (bits_tag >= static_cast<uint64_t>(LsbKernels::MAX_BITS) || data_size < SIZE_SAMPLES ||
+        header_size > (data_size - SIZE_SAMPLES) * (bits_tag + 1) / 8) {
         throw std::runtime_error("Invalid header size");
     }
     
-    std::vector<uint8_t> header(header_size);
-    for (size_t i = 0; i < header.size(); ++i) {
-        uint8_t byte = 0;
-        for (int bit = 7; bit >= 0; --bit) {
-            size_t idx = 8 * 8 + i * 8 + (7 - bit);
-            if (idx >= indices.size()) throw std::runtime_error("Index out of bounds");
-            size_t pos = data_start + indices[idx];
-            byte |= (wav[pos] & 1) << bit;
-        }
-        header[i] = byte;
-    }
+    std::vector<uint8_t> header;
+    LsbKernels::withBits(static_cast<int>(bits_tag) + 1, [&](auto k) {
+        header = extract_bits<decltype(k)::value>(wav, data_start, indices, SIZE_SAMPLES, header_size);
+    });
     
     if (encrypt) vigenere_cipher(header, password, false);
     
@@ -199,7 +227,7 @@ int main(int argc, char* argv[]) {
     try {
         if (argc < 2) {
             std::cerr << "Usage:\n"
-                      << "  " << argv[0] << " embed <cover.wav> <secret> <output> [password] [-e] [-r]\n"
+                      << "  " << argv[0] << " embed <cover.wav> <secret> <output> [password] [-e] [-r] [-k bits]\n"
                       << "  " << argv[0] << " extract <stego.wav> [password] [-e] [-r]\n";
             return 1;
         }
@@ -207,7 +235,7 @@ int main(int argc, char* argv[]) {
         std::string mode(argv[1]);
         if (mode == "embed") {
             if (argc < 5) {
-                std::cerr << "Usage: " << argv[0] << " embed <cover.wav> <secret> <output> [password] [-e] [-r]\n";
+                std::cerr << "Usage: " << argv[0] << " embed <cover.wav> <secret> <output> [password] [-e] [-r] [-k bits]\n";
                 return 1;
             }
             
@@ -217,15 +245,17 @@ int main(int argc, char* argv[]) {
             std::string password;
             bool encrypt = false;
             bool randomize = false;
+            int bits_per_sample = 1;
             
             for (int i = 5; i < argc; ++i) {
                 std::string arg = argv[i];
                 if (arg == "-e") encrypt = true;
                 else if (arg == "-r") randomize = true;
+                else if (arg == "-k" && i + 1 < argc) bits_per_sample = std::atoi(argv[++i]);
                 else password = arg;
             }
             
-            embed_data(cover, secret, output, password, encrypt, randomize);
+            embed_data(cover, secret, output, password, encrypt, randomize, bits_per_sample);
             std::cout << "Embedding successful!" << std::endl;
             
         } else if (mode == "extract") {
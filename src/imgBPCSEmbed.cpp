@@ -8,33 +8,7 @@
 #include <filesystem>
 #include <cmath>
 
-#pragma pack(push, 1)
-struct BMPFileHeader {
-    uint16_t fileType{0x4D42};
-    uint32_t fileSize{0};
-    uint16_t reserved1{0};
-    uint16_t reserved2{0};
-    uint32_t offsetData{0};
-};
-
-struct BMPInfoHeader {
-    uint32_t headerSize{40};
-    int32_t width{0};
-    int32_t height{0};
-    uint16_t planes{1};
-    uint16_t bitCount{24};
-    uint32_t compression{0};
-    uint32_t imageSize{0};
-    int32_t xPixelsPerMeter{2835};
-    int32_t yPixelsPerMeter{2835};
-    uint32_t colorsUsed{0};
-    uint32_t colorsImportant{0};
-};
-#pragma pack(pop)
-
-struct RGB {
-    uint8_t r, g, b;
-};
+#include "mappedBMP.h"
 
 struct BlockPosition {
     int channel;
@@ -43,82 +17,6 @@ struct BlockPosition {
     int y;
 };
 
-std::vector<RGB> readBMP(const std::string& filename, int& width, int& height) {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file) throw std::runtime_error("Failed to open BMP file");
-
-    BMPFileHeader fileHeader;
-    BMPInfoHeader infoHeader;
-    
-    file.read(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader));
-    file.read(reinterpret_cast<char*>(&infoHeader), sizeof(infoHeader));
-
-    if (fileHeader.fileType != 0x4D42 || infoHeader.headerSize != 40 || 
-        infoHeader.bitCount != 24 || infoHeader.compression != 0) {
-        throw std::runtime_error("Unsupported BMP format");
-    }
-
-    width = infoHeader.width;
-    height = std::abs(infoHeader.height);
-    int rowSize = (width * 3 + 3) & ~3;
-    int dataSize = rowSize * height;
-
-    std::vector<uint8_t> data(dataSize);
-    file.seekg(fileHeader.offsetData);
-    file.read(reinterpret_cast<char*>(data.data()), dataSize);
-
-    std::vector<RGB> pixels(width * height);
-    bool isBottomUp = infoHeader.height > 0;
-
-    for (int y = 0; y < height; ++y) {
-        int srcY = isBottomUp ? height - 1 - y : y;
-        const uint8_t* row = data.data() + srcY * rowSize;
-        
-        for (int x = 0; x < width; ++x) {
-            pixels[y * width + x].r = row[x * 3 + 2];
-            pixels[y * width + x].g = row[x * 3 + 1];
-            pixels[y * width + x].b = row[x * 3 + 0];
-        }
-    }
-
-    return pixels;
-}
-
-void writeBMP(const std::string& filename, const std::vector<RGB>& pixels, int width, int height) {
-    std::ofstream file(filename, std::ios::binary);
-    if (!file) throw std::runtime_error("Failed to create BMP file");
-
-    int rowSize = (width * 3 + 3) & ~3;
-    int dataSize = rowSize * height;
-    int fileSize = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader) + dataSize;
-
-    BMPFileHeader fileHeader;
-    fileHeader.fileSize = fileSize;
-    fileHeader.offsetData = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader);
-
-    BMPInfoHeader infoHeader;
-    infoHeader.width = width;
-    infoHeader.height = -height;
-
-    file.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
-    file.write(reinterpret_cast<const char*>(&infoHeader), sizeof(infoHeader));
-
-    std::vector<uint8_t> row(rowSize);
-    
-    for (int y = 0; y < height; ++y) {
-        const RGB* srcRow = pixels.data() + y * width;
-        
-        for (int x = 0; x < width; ++x) {
-            row[x * 3 + 0] = srcRow[x].b;
-            row[x * 3 + 1] = srcRow[x].g;
-            row[x * 3 + 2] = srcRow[x].r;
-        }
-        
-        std::fill(row.begin() + width * 3, row.end(), 0);
-        file.write(reinterpret_cast<const char*>(row.data()), rowSize);
-    }
-}
-
 std::vector<uint8_t> readSecretFile(const std::string& filename) {
     std::ifstream file(filename, std::ios::binary | std::ios::ate);
     std::streamsize size = file.tellg();
@@ -154,9 +52,12 @@ int main(int argc, char* argv[]) {
     // Get secret filename
     std::string secretFilename = std::filesystem::path(secretFile).filename().string();
 
-    int width, height;
-    std::vector<RGB> originalPixels = readBMP(coverFile, width, height);
-    std::vector<RGB> pixels = originalPixels; // Working copy for modification
+    // The cover is mapped twice: read-only for the PSNR, and copy-on-write as the stego image,
+    // so only the pages that take secret bits are ever copied
+    MappedBMP original(coverFile);
+    MappedBMP stego(coverFile, MappedBMP::Access::CopyOnWrite);
+    int width = stego.width();
+    int height = stego.height();
 
     std::vector<uint8_t> secretData = readSecretFile(secretFile);
 
@@ -203,16 +104,17 @@ int main(int argc, char* argv[]) {
 
     for (int channel = 0; channel < 3; ++channel) {
         for (int bitPlane = 7; bitPlane >= 0; --bitPlane) {
-            for (int y = 0; y < height; y += 8) {
-                for (int x = 0; x < width; x += 8) {
+            // Blocks past the right edge wrap into the next row, as they always have. Only whole
+            // block rows are scanned, and the last stops before its first wrapping block.
+            for (int y = 0; y + 8 <= height; y += 8) {
+                int rowEnd = (y + 8 < height) ? width : width - 7;
+                for (int x = 0; x < rowEnd; x += 8) {
                     std::vector<std::vector<bool>> block(8, std::vector<bool>(8));
                     
                     // Extract block bits
                     for (int i = 0; i < 8; ++i) {
                         for (int j = 0; j < 8; ++j) {
-                            int pixelIndex = (y + i) * width + (x + j);
-                            uint8_t value = (channel == 0) ? pixels[pixelIndex].r :
-                                            (channel == 1) ? pixels[pixelIndex].g : pixels[pixelIndex].b;
+                            uint8_t value = stego.wrappedSample(x + j, y + i, channel);
                             block[i][j] = (value >> (7 - bitPlane)) & 1;
                         }
                     }
@@ -262,9 +164,7 @@ int main(int argc, char* argv[]) {
         // Extract current block bits
         for (int i = 0; i < 8; ++i) {
             for (int j = 0; j < 8; ++j) {
-                int pixelIndex = (pos.y + i) * width + (pos.x + j);
-                uint8_t value = (pos.channel == 0) ? pixels[pixelIndex].r :
-                                (pos.channel == 1) ? pixels[pixelIndex].g : pixels[pixelIndex].b;
+                uint8_t value = stego.wrappedSample(pos.x + j, pos.y + i, pos.channel);
                 block[i][j] = (value >> (7 - pos.bitPlane)) & 1;
             }
         }
@@ -279,9 +179,7 @@ int main(int argc, char* argv[]) {
         // Update pixels
         for (int i = 0; i < 8; ++i) {
             for (int j = 0; j < 8; ++j) {
-                int pixelIndex = (pos.y + i) * width + (pos.x + j);
-                uint8_t& value = (pos.channel == 0) ? pixels[pixelIndex].r :
-                                 (pos.channel == 1) ? pixels[pixelIndex].g : pixels[pixelIndex].b;
+                uint8_t& value = stego.wrappedSample(pos.x + j, pos.y + i, pos.channel);
                 value &= ~(1 << (7 - pos.bitPlane));
                 value |= (block[i][j] << (7 - pos.bitPlane));
             }
@@ -290,10 +188,12 @@ int main(int argc, char* argv[]) {
 
     // Calculate PSNR
     double sum = 0.0;
-    for (size_t i = 0; i < pixels.size(); ++i) {
-        sum += std::pow(originalPixels[i].r - pixels[i].r, 2);
-        sum += std::pow(originalPixels[i].g - pixels[i].g, 2);
-        sum += std::pow(originalPixels[i].b - pixels[i].b, 2);
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* before = original.row(y);
+        const uint8_t* after = stego.row(y);
+        for (int i = 0; i < width * 3; ++i) {
+            sum += std::pow(before[i] - after[i], 2);
+        }
     }
     
     double mse = sum / (3 * width * height);
@@ -307,7 +207,8 @@ int main(int argc, char* argv[]) {
         std::cout << "PSNR: " << psnr << " dB" << std::endl;
     }
 
-    writeBMP(outputFile, pixels, width, height);
+    // Headers and padding come through unchanged from the cover
+    stego.write(outputFile);
     std::cout << "Data embedded successfully: " << outputFile << std::endl;
 
     return 0;
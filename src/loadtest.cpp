@@ -0,0 +1,523 @@
+// Load generator for the Stegoninja web server. Synthesizes noisy BMP covers and random
+// secrets, seeds a few results, then drives embed, extract and result downloads against
+// 127.0.0.1 and prints latency percentiles, throughput and error counts as JSON.
+//
+//   SteganoLoadTest [--port 8080] [--duration 30] [--concurrency 16] [--rate 0]
+//                   [--cover 512x512] [--secret 4096] [--covers 4]
+//                   [--mix embed=1,extract=1,result=2] [--embed-query format=png]
+//
+// With --rate 0 every connection issues its next request as soon as the last one returns
+// (closed loop). With --rate N requests are scheduled N per second regardless of how the
+// server keeps up (open loop), and latency is measured from the scheduled start so a
+// stalled server shows up in the percentiles instead of silently lowering the load.
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    int port = 8080;
+    double duration = 30;
+    int concurrency = 16;
+    double rate = 0;
+    int coverWidth = 512;
+    int coverHeight = 512;
+    size_t secretSize = 4096;
+    int covers = 4;
+    int mixEmbed = 1;
+    int mixExtract = 1;
+    int mixResult = 2;
+    std::string embedQuery;
+};
+
+enum Op { OP_EMBED, OP_EXTRACT, OP_RESULT, OP_COUNT };
+static const char* OP_NAMES[OP_COUNT] = {"embed", "extract", "result"};
+
+struct Response {
+    int status = 0;
+    std::string body;
+};
+
+// ====================== HTTP over a loopback socket ======================
+
+// One keep-alive connection to the server; reconnects on the next request after any failure
+class Connection {
+public:
+    explicit Connection(int port) : port(port) {}
+    ~Connection() { close(); }
+
+    // Returns false on a transport error (connect, send, malformed or truncated response)
+    bool request(const std::string& raw, Response& response) {
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            bool fresh = fd < 0;
+            if (fresh && !open()) return false;
+            if (sendAll(raw) && readResponse(response)) return true;
+            close();
+            // A reused connection may have been closed by the server in the meantime
+            if (fresh) return false;
+        }
+        return false;
+    }
+
+private:
+    bool open() {
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return false;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            close();
+            return false;
+        }
+        buffer.clear();
+        return true;
+    }
+
+    void close() {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+
+    bool sendAll(const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            sent += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // Appends at least one byte to the buffer; false on EOF or error
+    bool fill() {
+        char chunk[64 * 1024];
+        for (;;) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            buffer.append(chunk, static_cast<size_t>(n));
+            return true;
+        }
+    }
+
+    bool readLine(std::string& line) {
+        size_t eol;
+        while ((eol = buffer.find("\r\n")) == std::string::npos) {
+            if (!fill()) return false;
+        }
+        line = buffer.substr(0, eol);
+        buffer.erase(0, eol + 2);
+        return true;
+    }
+
+    bool readBytes(size_t n, std::string& out) {
+        while (buffer.size() < n) {
+            if (!fill()) return false;
+        }
+        out.append(buffer, 0, n);
+        buffer.erase(0, n);
+        return true;
+    }
+
+    bool readResponse(Response& response) {
+        std::string line;
+        if (!readLine(line) || line.compare(0, 5, "HTTP/") != 0) return false;
+        size_t space = line.find(' ');
+        if (space == std::string::npos) return false;
+        response.status = std::atoi(line.c_str() + space + 1);
+        response.body.clear();
+
+        long long contentLength = -1;
+        bool chunked = false;
+        bool closeAfter = false;
+        while (readLine(line) && !line.empty()) {
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) continue;
+            std::string name = line.substr(0, colon);
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+            size_t valueStart = line.find_first_not_of(' ', colon + 1);
+            std::string value = valueStart == std::string::npos ? "" : line.substr(valueStart);
+            if (name == "content-length") contentLength = std::atoll(value.c_str());
+            if (name == "transfer-encoding" && value.find("chunked") != std::string::npos) chunked = true;
+            if (name == "connection" && value.find("close") != std::string::npos) closeAfter = true;
+        }
+        if (!line.empty()) return false;
+
+        if (chunked) {
+            for (;;) {
+                if (!readLine(line)) return false;
+                size_t size = std::strtoul(line.c_str(), nullptr, 16);
+                if (size == 0) {
+                    while (readLine(line) && !line.empty()) {}
+                    break;
+                }
+                if (!readBytes(size, response.body) || !readLine(line)) return false;
+            }
+        } else if (contentLength >= 0) {
+            if (!readBytes(static_cast<size_t>(contentLength), response.body)) return false;
+        } else {
+            while (fill()) {}
+            response.body.swap(buffer);
+            closeAfter = true;
+        }
+
+        if (closeAfter) close();
+        return true;
+    }
+
+    int port;
+    int fd = -1;
+    std::string buffer;
+};
+
+static std::string multipartRequest(const std::string& path, const std::vector<std::pair<std::string, const std::string*>>& files, const std::string& filenamePrefix) {
+    static const std::string boundary = "----stegoninja-loadtest-boundary";
+    std::string body;
+    for (const auto& file : files) {
+        body += "--" + boundary + "\r\n";
+        body += "Content-Disposition: form-data; name=\"" + file.first + "\"; filename=\"" + filenamePrefix + file.first + "\"\r\n";
+        body += "Content-Type: application/octet-stream\r\n\r\n";
+        body += *file.second;
+        body += "\r\n";
+    }
+    body += "--" + boundary + "--\r\n";
+
+    std::string request = "POST " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n";
+    request += "Content-Type: multipart/form-data; boundary=" + boundary + "\r\n";
+    request += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    return request + body;
+}
+
+static std::string getRequest(const std::string& path) {
+    return "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+}
+
+// Value of "key":"..." in a flat JSON response
+static std::string jsonField(const std::string& json, const std::string& key) {
+    std::string needle = "\"" + key + "\":\"";
+    size_t start = json.find(needle);
+    if (start == std::string::npos) return "";
+    start += needle.size();
+    size_t end = json.find('"', start);
+    return end == std::string::npos ? "" : json.substr(start, end - start);
+}
+
+// ====================== Synthetic payloads ======================
+
+// Uniform noise keeps every bit-plane complex, so the cover's capacity is close to its upper bound
+static std::string noiseBMP(int width, int height, std::mt19937& rng) {
+    int rowSize = (width * 3 + 3) & ~3;
+    uint32_t dataSize = static_cast<uint32_t>(rowSize) * static_cast<uint32_t>(height);
+    std::string bmp(54 + dataSize, '\0');
+    auto put16 = [&](size_t at, uint16_t v) { std::memcpy(&bmp[at], &v, 2); };
+    auto put32 = [&](size_t at, uint32_t v) { std::memcpy(&bmp[at], &v, 4); };
+    bmp[0] = 'B';
+    bmp[1] = 'M';
+    put32(2, 54 + dataSize);
+    put32(10, 54);
+    put32(14, 40);
+    put32(18, static_cast<uint32_t>(width));
+    put32(22, static_cast<uint32_t>(height));
+    put16(26, 1);
+    put16(28, 24);
+    put32(34, dataSize);
+
+    for (int y = 0; y < height; ++y) {
+        uint8_t* row = reinterpret_cast<uint8_t*>(&bmp[54 + static_cast<size_t>(y) * rowSize]);
+        for (int x = 0; x < width * 3; ++x) row[x] = static_cast<uint8_t>(rng());
+    }
+    return bmp;
+}
+
+static std::string randomBytes(size_t size, std::mt19937& rng) {
+    std::string data(size, '\0');
+    for (auto& c : data) c = static_cast<char>(rng());
+    return data;
+}
+
+// ====================== Runner ======================
+
+struct Fixture {
+    std::vector<std::string> covers;
+    std::vector<std::string> secrets;
+    std::vector<std::string> stegos;
+    std::vector<std::string> resultPaths;
+};
+
+struct OpStats {
+    std::vector<double> latencies;
+    std::map<int, uint64_t> statuses;
+    uint64_t transportErrors = 0;
+    uint64_t bytes = 0;
+};
+
+struct WorkerStats {
+    OpStats ops[OP_COUNT];
+};
+
+static std::string embedPath(const Options& options) {
+    return options.embedQuery.empty() ? "/image/bpcs/embed" : "/image/bpcs/embed?" + options.embedQuery;
+}
+
+// Embeds each cover once and downloads the result, giving extract and result requests something to hit
+static bool prepare(const Options& options, Fixture& fixture) {
+    std::mt19937 rng(42);
+    Connection conn(options.port);
+    for (int i = 0; i < options.covers; ++i) {
+        fixture.covers.push_back(noiseBMP(options.coverWidth, options.coverHeight, rng));
+        fixture.secrets.push_back(randomBytes(options.secretSize, rng));
+
+        Response response;
+        std::string request = multipartRequest(embedPath(options), {{"cover", &fixture.covers.back()}, {"secret", &fixture.secrets.back()}}, "seed");
+        if (!conn.request(request, response) || response.status != 200) {
+            std::cerr << "Seeding embed failed (status " << response.status << "): " << response.body.substr(0, 200) << std::endl;
+            return false;
+        }
+        std::string path = jsonField(response.body, "result");
+        if (path.empty() || !conn.request(getRequest(path), response) || response.status != 200) {
+            std::cerr << "Seeding result download failed for '" << path << "'" << std::endl;
+            return false;
+        }
+        fixture.resultPaths.push_back(path);
+        fixture.stegos.push_back(std::move(response.body));
+    }
+    return true;
+}
+
+static Op pickOp(const Options& options, std::mt19937& rng) {
+    int total = options.mixEmbed + options.mixExtract + options.mixResult;
+    int roll = static_cast<int>(rng() % static_cast<uint32_t>(total));
+    if (roll < options.mixEmbed) return OP_EMBED;
+    if (roll < options.mixEmbed + options.mixExtract) return OP_EXTRACT;
+    return OP_RESULT;
+}
+
+static void runOne(const Options& options, const Fixture& fixture, Connection& conn, std::mt19937& rng,
+                   Clock::time_point scheduled, WorkerStats& stats) {
+    Op op = pickOp(options, rng);
+    size_t pick = rng() % fixture.covers.size();
+
+    std::string request;
+    switch (op) {
+        case OP_EMBED:
+            request = multipartRequest(embedPath(options), {{"cover", &fixture.covers[pick]}, {"secret", &fixture.secrets[pick]}}, "load");
+            break;
+        case OP_EXTRACT:
+            request = multipartRequest("/image/bpcs/extract", {{"stego", &fixture.stegos[pick]}}, "load");
+            break;
+        default:
+            request = getRequest(fixture.resultPaths[pick]);
+            break;
+    }
+
+    Response response;
+    bool ok = conn.request(request, response);
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - scheduled).count();
+
+    OpStats& s = stats.ops[op];
+    s.latencies.push_back(ms);
+    if (!ok) {
+        ++s.transportErrors;
+        return;
+    }
+    ++s.statuses[response.status];
+    s.bytes += response.body.size();
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(sorted.size() - 1, rank == 0 ? 0 : rank - 1)];
+}
+
+static void appendLatency(std::string& out, std::vector<double>& latencies) {
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0;
+    for (double l : latencies) sum += l;
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "{\"mean\":%.3f,\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+                  latencies.empty() ? 0.0 : sum / latencies.size(), percentile(latencies, 50), percentile(latencies, 95),
+                  percentile(latencies, 99), latencies.empty() ? 0.0 : latencies.back());
+    out += buf;
+}
+
+static std::string report(const Options& options, std::vector<WorkerStats>& workers, double elapsed) {
+    char buf[512];
+    std::string out = "{";
+    std::snprintf(buf, sizeof(buf), "\"mode\":\"%s\",\"concurrency\":%d,\"targetRate\":%.1f,\"durationSeconds\":%.3f,"
+                  "\"cover\":\"%dx%d\",\"secretBytes\":%zu,\"latencyUnit\":\"ms\",",
+                  options.rate > 0 ? "open" : "closed", options.concurrency, options.rate, elapsed,
+                  options.coverWidth, options.coverHeight, options.secretSize);
+    out += buf;
+
+    std::vector<double> all;
+    uint64_t totalRequests = 0, totalErrors = 0;
+    out += "\"endpoints\":{";
+    for (int op = 0; op < OP_COUNT; ++op) {
+        OpStats merged;
+        for (auto& w : workers) {
+            OpStats& s = w.ops[op];
+            merged.latencies.insert(merged.latencies.end(), s.latencies.begin(), s.latencies.end());
+            for (const auto& kv : s.statuses) merged.statuses[kv.first] += kv.second;
+            merged.transportErrors += s.transportErrors;
+            merged.bytes += s.bytes;
+        }
+        all.insert(all.end(), merged.latencies.begin(), merged.latencies.end());
+
+        uint64_t requests = merged.latencies.size();
+        uint64_t errors = merged.transportErrors;
+        for (const auto& kv : merged.statuses) {
+            if (kv.first < 200 || kv.first >= 300) errors += kv.second;
+        }
+        totalRequests += requests;
+        totalErrors += errors;
+
+        if (op > 0) out += ",";
+        std::snprintf(buf, sizeof(buf), "\"%s\":{\"requests\":%llu,\"errors\":%llu,\"errorRate\":%.6f,\"throughput\":%.3f,"
+                      "\"bytesReceived\":%llu,\"transportErrors\":%llu,\"status\":{",
+                      OP_NAMES[op], static_cast<unsigned long long>(requests), static_cast<unsigned long long>(errors),
+                      requests ? static_cast<double>(errors) / requests : 0.0, requests / elapsed,
+                      static_cast<unsigned long long>(merged.bytes), static_cast<unsigned long long>(merged.transportErrors));
+        out += buf;
+        bool first = true;
+        for (const auto& kv : merged.statuses) {
+            std::snprintf(buf, sizeof(buf), "%s\"%d\":%llu", first ? "" : ",", kv.first, static_cast<unsigned long long>(kv.second));
+            out += buf;
+            first = false;
+        }
+        out += "},\"latency\":";
+        appendLatency(out, merged.latencies);
+        out += "}";
+    }
+    out += "},";
+
+    std::snprintf(buf, sizeof(buf), "\"total\":{\"requests\":%llu,\"errors\":%llu,\"errorRate\":%.6f,\"throughput\":%.3f,\"latency\":",
+                  static_cast<unsigned long long>(totalRequests), static_cast<unsigned long long>(totalErrors),
+                  totalRequests ? static_cast<double>(totalErrors) / totalRequests : 0.0, totalRequests / elapsed);
+    out += buf;
+    appendLatency(out, all);
+    out += "}}";
+    return out;
+}
+
+// ====================== Command line ======================
+
+static bool parseMix(const std::string& spec, Options& options) {
+    options.mixEmbed = options.mixExtract = options.mixResult = 0;
+    size_t pos = 0;
+    while (pos < spec.size()) {
+        size_t end = spec.find(',', pos);
+        if (end == std::string::npos) end = spec.size();
+        std::string item = spec.substr(pos, end - pos);
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) return false;
+        std::string name = item.substr(0, eq);
+        int weight = std::atoi(item.c_str() + eq + 1);
+        if (weight < 0) return false;
+        if (name == "embed") options.mixEmbed = weight;
+        else if (name == "extract") options.mixExtract = weight;
+        else if (name == "result") options.mixResult = weight;
+        else return false;
+        pos = end + 1;
+    }
+    return options.mixEmbed + options.mixExtract + options.mixResult > 0;
+}
+
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [--port N] [--duration SECONDS] [--concurrency N] [--rate REQ_PER_SEC]\n"
+              << "       [--cover WIDTHxHEIGHT] [--secret BYTES] [--covers N]\n"
+              << "       [--mix embed=W,extract=W,result=W] [--embed-query QUERY]\n";
+}
+
+static bool parseArgs(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        std::string value = argv[++i];
+        if (arg == "--port") options.port = std::atoi(value.c_str());
+        else if (arg == "--duration") options.duration = std::atof(value.c_str());
+        else if (arg == "--concurrency") options.concurrency = std::atoi(value.c_str());
+        else if (arg == "--rate") options.rate = std::atof(value.c_str());
+        else if (arg == "--secret") options.secretSize = std::strtoul(value.c_str(), nullptr, 10);
+        else if (arg == "--covers") options.covers = std::atoi(value.c_str());
+        else if (arg == "--embed-query") options.embedQuery = value;
+        else if (arg == "--mix") {
+            if (!parseMix(value, options)) return false;
+        } else if (arg == "--cover") {
+            if (std::sscanf(value.c_str(), "%dx%d", &options.coverWidth, &options.coverHeight) != 2) return false;
+        } else {
+            return false;
+        }
+    }
+    return options.port > 0 && options.port < 65536 && options.duration > 0 && options.concurrency > 0 && options.rate >= 0 &&
+           options.coverWidth >= 8 && options.coverHeight >= 8 && options.secretSize > 0 && options.covers > 0;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseArgs(argc, argv, options)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Fixture fixture;
+    if (!prepare(options, fixture)) return 1;
+
+    std::vector<WorkerStats> workers(static_cast<size_t>(options.concurrency));
+    std::atomic<uint64_t> nextTicket{0};
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration));
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < options.concurrency; ++t) {
+        threads.emplace_back([&, t] {
+            Connection conn(options.port);
+            std::mt19937 rng(1000 + t);
+            WorkerStats& stats = workers[static_cast<size_t>(t)];
+            for (;;) {
+                Clock::time_point scheduled;
+                if (options.rate > 0) {
+                    // Open loop: claim the next slot of the global schedule and wait for it
+                    uint64_t ticket = nextTicket.fetch_add(1, std::memory_order_relaxed);
+                    scheduled = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(ticket / options.rate));
+                    if (scheduled >= deadline) break;
+                    std::this_thread::sleep_until(scheduled);
+                } else {
+                    scheduled = Clock::now();
+                    if (scheduled >= deadline) break;
+                }
+                runOne(options, fixture, conn, rng, scheduled, stats);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << report(options, workers, elapsed) << std::endl;
+    return 0;
+}
@@ -0,0 +1,354 @@
+#include "lsbKernels.h"
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LSB_KERNELS_X86 1
+#endif
+
+using LsbKernels::Backend;
+using LsbKernels::BitOrder;
+using LsbKernels::Sample;
+
+static const uint64_t ONES = 0x0101010101010101ull;
+
+static inline uint64_t load64(const uint8_t *p) {
+  uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+static inline void store64(uint8_t *p, uint64_t v) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  std::memcpy(p, &v, sizeof(v));
+}
+
+// One payload byte as the low bit of each of 8 bytes: copy it into every byte,
+// keep a different bit in each, then turn any set bit into 0x01
+template <BitOrder Order> static inline uint64_t spread(uint8_t b) {
+  constexpr uint64_t select = Order == BitOrder::MsbFirst
+                                  ? 0x0102040810204080ull
+                                  : 0x8040201008040201ull;
+  uint64_t m = (b * ONES) & select;
+  return ((m + 0x7F7F7F7F7F7F7F7Full) >> 7) & ONES;
+}
+
+// The inverse: the multiply shifts each byte's low bit to a distinct position
+// of the top byte without carries
+template <BitOrder Order> static inline uint8_t gather(uint64_t lsbs) {
+  constexpr uint64_t multiplier = Order == BitOrder::MsbFirst
+                                      ? 0x8040201008040201ull
+                                      : 0x0102040810204080ull;
+  return static_cast<uint8_t>((lsbs * multiplier) >> 56);
+}
+
+template <BitOrder Order>
+static void embedScalar(uint8_t *carrier, const uint8_t *payload,
+                        size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i, carrier += 8)
+    store64(carrier, (load64(carrier) & ~ONES) | spread<Order>(payload[i]));
+}
+
+template <BitOrder Order>
+static void extractScalar(const uint8_t *carrier, uint8_t *payload,
+                          size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i, carrier += 8)
+    payload[i] = gather<Order>(load64(carrier) & ONES);
+}
+
+// k > 1: a block of K payload bytes is one 8K-bit value v whose fields go
+// to 8 carrier bytes. MSB-first reads v big endian and fills carrier byte 0
+// from its top field; LSB-first reads it little endian and starts at the
+// bottom.
+template <BitOrder Order, int K> static constexpr int fieldShift(int j) {
+  return Order == BitOrder::MsbFirst ? K * (7 - j) : K * j;
+}
+
+// The first `n` of K bytes, the rest taken as zero
+template <BitOrder Order, int K>
+static inline uint32_t packBlock(const uint8_t *p, size_t n) {
+  uint32_t v = 0;
+  for (int b = 0; b < K; ++b) {
+    uint32_t byte = static_cast<size_t>(b) < n ? p[b] : 0;
+    v |= Order == BitOrder::MsbFirst ? byte << 8 * (K - 1 - b) : byte << 8 * b;
+  }
+  return v;
+}
+
+template <BitOrder Order, int K>
+static inline void unpackBlock(uint32_t v, uint8_t *p, size_t n) {
+  for (size_t b = 0; b < n; ++b)
+    p[b] = static_cast<uint8_t>(Order == BitOrder::MsbFirst
+                                    ? v >> 8 * (K - 1 - b)
+                                    : v >> 8 * b);
+}
+
+// Whole blocks are one 64-bit read-modify-write each, like the k = 1 SWAR
+// kernel; a partial last block touches only the carrier bytes it needs
+template <BitOrder Order, int K>
+static void embedFields(uint8_t *carrier, const uint8_t *payload,
+                        size_t bytes) {
+  constexpr uint64_t keep = ~(Sample<K>::MASK * ONES);
+  size_t i = 0;
+  for (; i + K <= bytes; i += K, carrier += 8) {
+    uint32_t v = packBlock<Order, K>(payload + i, K);
+    uint64_t fields = 0;
+    for (int j = 0; j < 8; ++j)
+      fields |= static_cast<uint64_t>((v >> fieldShift<Order, K>(j)) &
+                                      Sample<K>::MASK)
+                << 8 * j;
+    store64(carrier, (load64(carrier) & keep) | fields);
+  }
+  size_t rest = bytes - i;
+  if (rest == 0)
+    return;
+  uint32_t v = packBlock<Order, K>(payload + i, rest);
+  size_t n = LsbKernels::carrierBytes(rest, K);
+  for (size_t j = 0; j < n; ++j) {
+    int shift = fieldShift<Order, K>(static_cast<int>(j));
+    carrier[j] = Sample<K>::set(carrier[j], v >> shift);
+  }
+}
+
+template <BitOrder Order, int K>
+static void extractFields(const uint8_t *carrier, uint8_t *payload,
+                          size_t bytes) {
+  size_t i = 0;
+  for (; i + K <= bytes; i += K, carrier += 8) {
+    uint64_t fields = load64(carrier);
+    uint32_t v = 0;
+    for (int j = 0; j < 8; ++j)
+      v |= static_cast<uint32_t>(Sample<K>::get(fields >> 8 * j))
+           << fieldShift<Order, K>(j);
+    unpackBlock<Order, K>(v, payload + i, K);
+  }
+  size_t rest = bytes - i;
+  if (rest == 0)
+    return;
+  uint32_t v = 0;
+  size_t n = LsbKernels::carrierBytes(rest, K);
+  for (size_t j = 0; j < n; ++j)
+    v |= static_cast<uint32_t>(Sample<K>::get(carrier[j]))
+         << fieldShift<Order, K>(static_cast<int>(j));
+  unpackBlock<Order, K>(v, payload + i, rest);
+}
+
+#ifdef LSB_KERNELS_X86
+struct ReversedBits {
+  uint8_t table[256];
+  constexpr ReversedBits() : table() {
+    for (int v = 0; v < 256; ++v) {
+      int r = 0;
+      for (int bit = 0; bit < 8; ++bit)
+        r |= ((v >> bit) & 1) << (7 - bit);
+      table[v] = static_cast<uint8_t>(r);
+    }
+  }
+};
+static constexpr ReversedBits REVERSED{};
+
+// Bit i of each byte of `select` picks the payload bit for that carrier byte
+template <BitOrder Order> static inline __m128i selectBits128() {
+  return Order == BitOrder::MsbFirst
+             ? _mm_setr_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16,
+                             8, 4, 2, 1)
+             : _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16,
+                             32, 64, -128);
+}
+
+// Two payload bytes per 16 carrier bytes
+template <BitOrder Order>
+static void embedSSE2(uint8_t *carrier, const uint8_t *payload, size_t bytes) {
+  const __m128i select = selectBits128<Order>();
+  const __m128i ones = _mm_set1_epi8(1);
+  size_t i = 0;
+  for (; i + 2 <= bytes; i += 2, carrier += 16) {
+    // b0 b1 -> b0 x8, b1 x8
+    __m128i v = _mm_cvtsi32_si128(payload[i] | payload[i + 1] << 8);
+    v = _mm_unpacklo_epi8(v, v);
+    v = _mm_unpacklo_epi16(v, v);
+    v = _mm_unpacklo_epi32(v, v);
+    __m128i bits = _mm_and_si128(
+        _mm_cmpeq_epi8(_mm_and_si128(v, select), select), ones);
+
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(carrier));
+    c = _mm_or_si128(_mm_andnot_si128(ones, c), bits);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(carrier), c);
+  }
+  embedScalar<Order>(carrier, payload + i, bytes - i);
+}
+
+// movemask collects the low bits (shifted up to the sign bit) 16 at a time, in
+// LSB-first order
+template <BitOrder Order>
+static void extractSSE2(const uint8_t *carrier, uint8_t *payload,
+                        size_t bytes) {
+  size_t i = 0;
+  for (; i + 2 <= bytes; i += 2, carrier += 16) {
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(carrier));
+    int mask = _mm_movemask_epi8(_mm_slli_epi64(c, 7));
+    uint8_t lo = static_cast<uint8_t>(mask);
+    uint8_t hi = static_cast<uint8_t>(mask >> 8);
+    if (Order == BitOrder::MsbFirst) {
+      lo = REVERSED.table[lo];
+      hi = REVERSED.table[hi];
+    }
+    payload[i] = lo;
+    payload[i + 1] = hi;
+  }
+  extractScalar<Order>(carrier, payload + i, bytes - i);
+}
+
+// Four payload bytes per 32 carrier bytes. Shuffles stay within 128-bit lanes,
+// so each lane picks its two bytes out of the broadcast word.
+template <BitOrder Order>
+__attribute__((target("avx2"))) static void
+embedAVX2(uint8_t *carrier, const uint8_t *payload, size_t bytes) {
+  const __m256i select = _mm256_broadcastsi128_si256(selectBits128<Order>());
+  const __m256i spreadIndex =
+      _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2,
+                       2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+  const __m256i ones = _mm256_set1_epi8(1);
+  size_t i = 0;
+  for (; i + 4 <= bytes; i += 4, carrier += 32) {
+    int word;
+    std::memcpy(&word, payload + i, sizeof(word));
+    __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(word), spreadIndex);
+    __m256i bits = _mm256_and_si256(
+        _mm256_cmpeq_epi8(_mm256_and_si256(v, select), select), ones);
+
+    __m256i c =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(carrier));
+    c = _mm256_or_si256(_mm256_andnot_si256(ones, c), bits);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(carrier), c);
+  }
+  embedSSE2<Order>(carrier, payload + i, bytes - i);
+}
+
+// For MSB-first the carrier bytes of each payload byte are reversed before the
+// movemask, which then yields the payload bytes directly
+template <BitOrder Order>
+__attribute__((target("avx2"))) static void
+extractAVX2(const uint8_t *carrier, uint8_t *payload, size_t bytes) {
+  const __m256i reverse =
+      _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                       7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  size_t i = 0;
+  for (; i + 4 <= bytes; i += 4, carrier += 32) {
+    __m256i c =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(carrier));
+    if (Order == BitOrder::MsbFirst)
+      c = _mm256_shuffle_epi8(c, reverse);
+    int mask = _mm256_movemask_epi8(_mm256_slli_epi64(c, 7));
+    std::memcpy(payload + i, &mask, sizeof(mask));
+  }
+  extractSSE2<Order>(carrier, payload + i, bytes - i);
+}
+#endif
+
+static Backend detectBackend() {
+#ifdef LSB_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return Backend::AVX2;
+  return Backend::SSE2;
+#else
+  return Backend::Scalar;
+#endif
+}
+
+static const Backend BEST = detectBackend();
+static std::atomic<Backend> active{BEST};
+
+Backend LsbKernels::backend() { return active.load(std::memory_order_relaxed); }
+
+bool LsbKernels::setBackend(Backend backend) {
+  if (static_cast<int>(backend) > static_cast<int>(BEST))
+    return false;
+  active.store(backend, std::memory_order_relaxed);
+  return true;
+}
+
+const char *LsbKernels::backendName(Backend backend) {
+  switch (backend) {
+  case Backend::AVX2:
+    return "avx2";
+  case Backend::SSE2:
+    return "sse2";
+  default:
+    return "scalar";
+  }
+}
+
+template <BitOrder Order>
+static void embedWith(uint8_t *carrier, const uint8_t *payload, size_t bytes) {
+  switch (LsbKernels::backend()) {
+#ifdef LSB_KERNELS_X86
+  case Backend::AVX2:
+    return embedAVX2<Order>(carrier, payload, bytes);
+  case Backend::SSE2:
+    return embedSSE2<Order>(carrier, payload, bytes);
+#endif
+  default:
+    return embedScalar<Order>(carrier, payload, bytes);
+  }
+}
+
+template <BitOrder Order>
+static void extractWith(const uint8_t *carrier, uint8_t *payload,
+                        size_t bytes) {
+  switch (LsbKernels::backend()) {
+#ifdef LSB_KERNELS_X86
+  case Backend::AVX2:
+    return extractAVX2<Order>(carrier, payload, bytes);
+  case Backend::SSE2:
+    return extractSSE2<Order>(carrier, payload, bytes);
+#endif
+  default:
+    return extractScalar<Order>(carrier, payload, bytes);
+  }
+}
+
+template <BitOrder Order>
+static void embedOrdered(uint8_t *carrier, const uint8_t *payload,
+                         size_t bytes, int bits) {
+  LsbKernels::withBits(bits, [&](auto k) {
+    if constexpr (decltype(k)::value == 1)
+      embedWith<Order>(carrier, payload, bytes);
+    else
+      embedFields<Order, decltype(k)::value>(carrier, payload, bytes);
+  });
+}
+
+template <BitOrder Order>
+static void extractOrdered(const uint8_t *carrier, uint8_t *payload,
+                           size_t bytes, int bits) {
+  LsbKernels::withBits(bits, [&](auto k) {
+    if constexpr (decltype(k)::value == 1)
+      extractWith<Order>(carrier, payload, bytes);
+    else
+      extractFields<Order, decltype(k)::value>(carrier, payload, bytes);
+  });
+}
+
+void LsbKernels::embed(uint8_t *carrier, const uint8_t *payload, size_t bytes,
+                       BitOrder order, int bits) {
+  if (order == BitOrder::MsbFirst)
+    embedOrdered<BitOrder::MsbFirst>(carrier, payload, bytes, bits);
+  else
+    embedOrdered<BitOrder::LsbFirst>(carrier, payload, bytes, bits);
+}
+
+void LsbKernels::extract(const uint8_t *carrier, uint8_t *payload,
+                         size_t bytes, BitOrder order, int bits) {
+  if (order == BitOrder::MsbFirst)
+    extractOrdered<BitOrder::MsbFirst>(carrier, payload, bytes, bits);
+  else
+    extractOrdered<BitOrder::LsbFirst>(carrier, payload, bytes, bits);
+}
@@ -1,3 +1,4 @@
+#include "lsbKernels.h"
 #include "stegano.h"
 #include "vigenere.h"
 #include <cstdlib>
@@ -64,23 +65,74 @@ void truncate_name(char *display_name, const char *original_name) {
   }
 }
 
-double getPSNR(const cv::Mat &I1, const cv::Mat &I2) {
-  cv::Mat s1;
-  absdiff(I1, I2, s1);      // |I1 - I2|
-  s1.convertTo(s1, CV_32F); // make sure it's float
-  s1 = s1.mul(s1);          // square the difference
+// Show a cover and its stego image side by side, both scaled to `height`
+void showSideBySide(cv::Mat original, cv::Mat stego, int height) {
+  cv::resize(original, original,
+             cv::Size(original.cols * height / original.rows, height));
+  cv::resize(stego, stego, cv::Size(stego.cols * height / stego.rows, height));
 
-  cv::Scalar s = sum(s1); // sum all elements per channel
+  // Combine them side by side
+  cv::Mat combined_image;
+  cv::hconcat(original, stego, combined_image);
 
-  double sse = s.val[0] + s.val[1] + s.val[2]; // sum channels
+  // ----- Add label "Original" -----
+  std::string text1 = "Original";
+  int fontFace = cv::FONT_HERSHEY_SIMPLEX;
+  double fontScale = 1.0;
+  int thickness = 2;
 
-  if (sse <= 1e-10) { // if small enough -> identical images
-    return INFINITY;
-  } else {
-    double mse = sse / (double)(I1.channels() * I1.total());
-    double psnr = 10.0 * log10((255 * 255) / mse);
-    return psnr;
-  }
+  int baseline1 = 0;
+  cv::Size textSize1 =
+      cv::getTextSize(text1, fontFace, fontScale, thickness, &baseline1);
+
+  cv::Point textOrg1(10, 30);
+  cv::Rect bgRect1(textOrg1 + cv::Point(0, baseline1), textSize1);
+
+  cv::Mat roi1 = combined_image(bgRect1);
+  cv::Mat overlay1;
+  roi1.copyTo(overlay1);
+  cv::rectangle(overlay1, cv::Point(0, 0), textSize1, cv::Scalar(0, 0, 0),
+                cv::FILLED);
+
+  double alpha = 0.5;
+  cv::addWeighted(overlay1, alpha, roi1, 1.0 - alpha, 0, roi1);
+
+  cv::putText(combined_image, text1, textOrg1 + cv::Point(0, textSize1.height),
+              fontFace, fontScale, cv::Scalar(255, 255, 255), thickness);
+
+  // ----- Add label "Stego Image" -----
+  std::string text2 = "Stego Image";
+  int baseline2 = 0;
+  cv::Size textSize2 =
+      cv::getTextSize(text2, fontFace, fontScale, thickness, &baseline2);
+
+  cv::Point textOrg2(original.cols + 10, 30);
+  cv::Rect bgRect2(textOrg2 + cv::Point(0, baseline2), textSize2);
+
+  cv::Mat roi2 = combined_image(bgRect2);
+  cv::Mat overlay2;
+  roi2.copyTo(overlay2);
+  cv::rectangle(overlay2, cv::Point(0, 0), textSize2, cv::Scalar(0, 0, 0),
+                cv::FILLED);
+
+  cv::addWeighted(overlay2, alpha, roi2, 1.0 - alpha, 0, roi2);
+
+  cv::putText(combined_image, text2, textOrg2 + cv::Point(0, textSize2.height),
+              fontFace, fontScale, cv::Scalar(255, 255, 255), thickness);
+
+  // Show combined image
+  cv::namedWindow("Side by Side Images", cv::WINDOW_AUTOSIZE);
+  cv::imshow("Side by Side Images", combined_image);
+  // REQUIRED! Process window events or wait for key input
+  cv::waitKey(1000); // Wait 1000 ms for image to process
+}
+
+// Capacity, payload and timings of an embed, from line `y` down
+void printEmbedMetrics(int y, const Stegano::EmbedResult &result) {
+  mvprintw(y, 1, "Cover capacity %zu bytes", result.capacityBytes);
+  mvprintw(y + 1, 1, "Payload + header: %zu bytes", result.payloadBytes);
+  mvprintw(y + 2, 1, "Embed %.1f ms, write %.1f ms", result.embedMs,
+           result.writeMs);
 }
 
 // Function to draw the TUI interface in a grid layout
@@ -249,6 +301,7 @@ void embedFlow(std::string path, std::string saveAs) {
 
   char message[1024], key[26];
   int encryptChoice = 0;
+  int bitsPerSample = 1;
 
   echo();
   mvprintw(5, 1, "Message to embed: ");
@@ -264,89 +317,36 @@ void embedFlow(std::string path, std::string saveAs) {
     getstr(key);
     finalMessage = Vigenere::vigenere_encrypt(finalMessage, key);
   }
-  noecho();
 
-  finalMessage.push_back('\0');
+  // More bits per channel hold more text but lower the PSNR
+  mvprintw(8, 1, "Bits per channel (1-4): ");
+  scanw("%d", &bitsPerSample);
+  noecho();
 
-  if (Stegano::embedMessage(inputImage, outputImage, finalMessage)) {
+  Stegano::EmbedResult result =
+      Stegano::embedMessage(inputImage, outputImage, finalMessage,
+                            encryptChoice == 1, 6, bitsPerSample);
+  if (result.ok) {
     mvprintw(9, 1, "Message embedded successfully!");
   } else {
-    mvprintw(9, 1, "Failed to embed message!");
+    mvprintw(9, 1, "Failed to embed message! %s", result.error.c_str());
   }
 
   cv::Mat inputMat = cv::imread(inputImage);
-  cv::Mat outputMat = cv::imread(outputImage);
+  cv::Mat outputMat = result.stego;
 
   mvprintw(11, 1, "Source Image: %s", inputImage.c_str());
   mvprintw(12, 1, "  Size: %dx%d", inputMat.cols, inputMat.rows);
   mvprintw(14, 1, "Stego Image: %s", outputImage.c_str());
   mvprintw(15, 1, "  Size: %dx%d", outputMat.cols, outputMat.rows);
+  printEmbedMetrics(16, result);
 
-  // Resize both images to the same height
-  int height = std::max(inputMat.rows, outputMat.rows);
-  cv::resize(inputMat, inputMat,
-             cv::Size(inputMat.cols * height / inputMat.rows, height));
-  cv::resize(outputMat, outputMat,
-             cv::Size(outputMat.cols * height / outputMat.rows, height));
-
-  // Combine them side by side
-  cv::Mat combined_image;
-  cv::hconcat(inputMat, outputMat, combined_image);
-
-  // ----- Add label "Original" -----
-  std::string text1 = "Original";
-  int fontFace = cv::FONT_HERSHEY_SIMPLEX;
-  double fontScale = 1.0;
-  int thickness = 2;
-
-  int baseline1 = 0;
-  cv::Size textSize1 =
-      cv::getTextSize(text1, fontFace, fontScale, thickness, &baseline1);
-
-  cv::Point textOrg1(10, 30);
-  cv::Rect bgRect1(textOrg1 + cv::Point(0, baseline1), textSize1);
-
-  cv::Mat roi1 = combined_image(bgRect1);
-  cv::Mat overlay1;
-  roi1.copyTo(overlay1);
-  cv::rectangle(overlay1, cv::Point(0, 0), textSize1, cv::Scalar(0, 0, 0),
-                cv::FILLED);
-
-  double alpha = 0.5;
-  cv::addWeighted(overlay1, alpha, roi1, 1.0 - alpha, 0, roi1);
-
-  cv::putText(combined_image, text1, textOrg1 + cv::Point(0, textSize1.height),
-              fontFace, fontScale, cv::Scalar(255, 255, 255), thickness);
-
-  // ----- Add label "Stego Image" -----
-  std::string text2 = "Stego Image";
-  int baseline2 = 0;
-  cv::Size textSize2 =
-      cv::getTextSize(text2, fontFace, fontScale, thickness, &baseline2);
-
-  cv::Point textOrg2(inputMat.cols + 10, 30);
-  cv::Rect bgRect2(textOrg2 + cv::Point(0, baseline2), textSize2);
-
-  cv::Mat roi2 = combined_image(bgRect2);
-  cv::Mat overlay2;
-  roi2.copyTo(overlay2);
-  cv::rectangle(overlay2, cv::Point(0, 0), textSize2, cv::Scalar(0, 0, 0),
-                cv::FILLED);
-
-  cv::addWeighted(overlay2, alpha, roi2, 1.0 - alpha, 0, roi2);
-
-  cv::putText(combined_image, text2, textOrg2 + cv::Point(0, textSize2.height),
-              fontFace, fontScale, cv::Scalar(255, 255, 255), thickness);
-
-  // Show combined image
-  cv::namedWindow("Side by Side Images", cv::WINDOW_AUTOSIZE);
-  cv::imshow("Side by Side Images", combined_image);
-  // REQUIRED! Process window events or wait for key input
-  cv::waitKey(1000); // Wait 1000 ms for image to process
-
-  // Display the combined image
-  cv::imshow("Side by Side Images", combined_image);
-  mvprintw(17, 1, "Press any key to continue...");
+  if (result.ok) {
+    // Resize both images to the same height
+    showSideBySide(inputMat, outputMat,
+                   std::max(inputMat.rows, outputMat.rows));
+  }
+  mvprintw(20, 1, "Press any key to continue...");
   getch();
   cv::destroyAllWindows();
 }
@@ -359,21 +359,19 @@ void extractFlow(std::string path) {
   if (inputImage.empty())
     return;
 
-  std::string extractedMessage;
-  int decryptChoice = 0;
   char key[26];
 
-  if (!Stegano::extractMessage(inputImage, extractedMessage)) {
-    mvprintw(5, 1, "Failed to extract message!");
+  Stegano::ExtractResult result = Stegano::extractMessage(inputImage);
+  std::string extractedMessage = result.message;
+  if (!result.ok) {
+    mvprintw(5, 1, "Failed to extract message! %s", result.error.c_str());
   } else {
-    mvprintw(5, 1, "Is message Encrypted? (1 = Yes, 0 = No): ");
-    echo();
-    char choices[4]; // Leave space for null-terminator!
-    getstr(choices); // Get the input (expecting 1 char input)
-    noecho();
-    decryptChoice = static_cast<int>(choices[0]);
-
-    if (decryptChoice == 49) {
+    // The header says whether the message was encrypted
+    mvprintw(5, 1, "Message is %s (%zu bytes, %d bits per channel)",
+             result.encrypted ? "encrypted" : "not encrypted",
+             result.message.size(), result.bitsPerSample);
+
+    if (result.encrypted) {
       mvprintw(6, 1, "Enter decryption key: ");
       echo();
       getstr(key);
@@ -398,25 +396,11 @@ void extractFlow(std::string path) {
 std::vector<unsigned char> extractData(const cv::Mat &stegoImage,
                                        int dataSizeInBytes) {
   std::vector<unsigned char> extracted(dataSizeInBytes, 0);
-
-  int totalBits = dataSizeInBytes * 8;
-  int bitIndex = 0;
-
-  for (int row = 0; row < stegoImage.rows && bitIndex < totalBits; row++) {
-    for (int col = 0; col < stegoImage.cols && bitIndex < totalBits; col++) {
-      cv::Vec3b pixel = stegoImage.at<cv::Vec3b>(row, col);
-
-      for (int channel = 0; channel < 3 && bitIndex < totalBits; channel++) {
-        int byteIndex = bitIndex / 8;
-        int bitInByte = 7 - (bitIndex % 8);
-
-        unsigned char bit = pixel[channel] & 1;
-
-        extracted[byteIndex] |= (bit << bitInByte);
-        bitIndex++;
-      }
-    }
-  }
+  size_t available = stegoImage.total() * 3 / 8;
+  cv::Mat flat = stegoImage.isContinuous() ? stegoImage : stegoImage.clone();
+  LsbKernels::extract(flat.data, extracted.data(),
+                      std::min(extracted.size(), available),
+                      LsbKernels::BitOrder::MsbFirst);
 
   return extracted;
 }
@@ -475,7 +459,7 @@ int main() {
         clear();
 
         mvprintw(1, 1, "Scoring Menu\n");
-        mvprintw(2, 1, "PSNR score %f \n", getPSNR(stego, ori));
+        mvprintw(2, 1, "PSNR score %f \n", Stegano::psnr(stego, ori));
 
         refresh();
       } else if (choice == 1) {
@@ -520,6 +504,9 @@ int main() {
 
         char key[26];
 
+        // no random key
+        // using no key give crashes
+        std::string embedKey = "hello";
         if (encryptChoice) {
 
           mvprintw(2, 1, "Enter encryption key (max 25 chars): ");
@@ -528,35 +515,34 @@ int main() {
           mvprintw(3, 1, "Your key : %s", key);
           refresh();
           getchar();
+          embedKey = key;
+        }
 
-          bool success =
-              Stegano::embedImage(payload_img, embedded_img, key, saveAs);
-
-          if (!success) {
-            mvprintw(5, 1, "Failed to embed\n");
-            refresh();
-            endwin();
-          }
-        } else {
-
-          // no random key
-          // using no key give crashes
-          bool success =
-              Stegano::embedImage(payload_img, embedded_img, "hello", saveAs);
-
-          if (!success) {
-            mvprintw(5, 1, "Failed to embed\n");
-            refresh();
-            endwin();
-          }
-          cv::Mat stego = cv::imread(saveAs);
+        int bitsPerSample = 1;
+        mvprintw(5, 1, "Bits per channel (1-4): ");
+        scanw("%d", &bitsPerSample);
 
-          clear();
+        Stegano::EmbedResult result = Stegano::embedImage(
+            payload_img, embedded_img, embedKey, saveAs, 6, bitsPerSample);
 
-          mvprintw(1, 1, "Scoring Menu\n");
-          mvprintw(2, 1, "PSNR score %f \n", getPSNR(stego, payload_img));
+        clear();
+        printEmbedMetrics(2, result);
+        if (!result.ok) {
+          mvprintw(5, 1, "Failed to embed: %s", result.error.c_str());
+          mvprintw(6, 1, "Press any key to continue...");
           refresh();
+          getch();
+          continue;
         }
+
+        mvprintw(5, 1, "Successfully embedded and saved to %s", saveAs);
+        mvprintw(6, 1, "PSNR score %f",
+                 Stegano::psnr(result.stego, payload_img));
+        mvprintw(8, 1, "Press any key to continue...");
+        refresh();
+        showSideBySide(payload_img, result.stego, 480);
+        getch();
+        cv::destroyAllWindows();
       } else if (choice == 2) {
         std::string file_path = get_file_path();
         if (file_path == "None")
@@ -570,54 +556,41 @@ int main() {
         scanw("%d", &encryptChoice);
 
         char key[26];
-
+        std::string extractKey = "hello";
         if (encryptChoice) {
-
           mvprintw(2, 1, "Enter encryption key (max 25 chars): ");
           getstr(key);
+          extractKey = key;
+        }
 
-          cv::Mat inputImg = cv::imread(file_path);
-          if (inputImg.empty()) {
-            mvprintw(3, 1, "File Empty %s\n", file_path.c_str());
-            refresh();
-            continue;
-          }
-
-          mvprintw(3, 1, "Selected path: %s\n", file_path.c_str());
-          mvprintw(4, 1, "Press any key to continue... \n");
+        cv::Mat inputImg = cv::imread(file_path);
+        if (inputImg.empty()) {
+          mvprintw(3, 1, "File Empty %s\n", file_path.c_str());
           refresh();
-          getch();
-
-          bool success = Stegano::extractImage(inputImg, key, "extracted.png");
-          if (success) {
-            mvprintw(7, 1, "Extract Success\n");
-            mvprintw(8, 1, "Press any key to continue... \n");
-            refresh();
-            getch();
-          }
-        } else {
-
-          cv::Mat inputImg = cv::imread(file_path);
-          if (inputImg.empty()) {
-            mvprintw(3, 1, "File Empty %s\n", file_path.c_str());
-            refresh();
-            continue;
-          }
+          continue;
+        }
 
-          mvprintw(3, 1, "Selected path: %s\n", file_path.c_str());
-          mvprintw(4, 1, "Press any key to continue... \n");
-          refresh();
-          getch();
+        mvprintw(3, 1, "Selected path: %s\n", file_path.c_str());
+        mvprintw(4, 1, "Press any key to continue... \n");
+        refresh();
+        getch();
 
-          bool success =
-              Stegano::extractImage(inputImg, "hello", "extracted.png");
-          if (success) {
-            mvprintw(7, 1, "Extract Success\n");
-            mvprintw(8, 1, "Press any key to continue... \n");
-            refresh();
-            getch();
-          }
+        Stegano::ExtractResult result =
+            Stegano::extractImage(inputImg, extractKey, "extracted.png");
+        if (result.ok) {
+          mvprintw(5, 1, "Successfully extracted and saved to extracted.png");
+          mvprintw(6, 1,
+                   "Payload %zu bytes at %d bits per channel, extract %.1f ms, "
+                   "write %.1f ms",
+                   result.payloadBytes, result.bitsPerSample, result.extractMs,
+                   result.writeMs);
+          mvprintw(7, 1, "Extract Success\n");
+        } else {
+          mvprintw(5, 1, "%s\n", result.error.c_str());
         }
+        mvprintw(8, 1, "Press any key to continue... \n");
+        refresh();
+        getch();
       } else if (choice == 3) {
         std::string file_path = get_file_path();
         if (file_path == "None")
@@ -0,0 +1,99 @@
+#include "mappedBMP.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const size_t FILE_HEADER_SIZE = 14;
+static const size_t INFO_HEADER_SIZE = 40;
+
+template <typename T>
+static T field(const uint8_t* data, size_t offset) {
+    T value;
+    std::memcpy(&value, data + offset, sizeof(value));
+    return value;
+}
+
+MappedBMP::MappedBMP(const std::string& filename, Access access) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Failed to open BMP file");
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(FILE_HEADER_SIZE + INFO_HEADER_SIZE)) {
+        close(fd);
+        throw std::runtime_error("Unsupported BMP format");
+    }
+    length = static_cast<size_t>(st.st_size);
+
+    int protection = access == Access::CopyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+    int flags = access == Access::CopyOnWrite ? MAP_PRIVATE : MAP_SHARED;
+    void* mapped = mmap(nullptr, length, protection, flags, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) throw std::runtime_error("Failed to map BMP file");
+    mapping = static_cast<uint8_t*>(mapped);
+
+    uint32_t offsetData = field<uint32_t>(mapping, 10);
+    int32_t w = field<int32_t>(mapping, 18);
+    int32_t h = field<int32_t>(mapping, 22);
+    if (field<uint16_t>(mapping, 0) != 0x4D42 || field<uint32_t>(mapping, 14) != INFO_HEADER_SIZE ||
+        field<uint16_t>(mapping, 28) != 24 || field<uint32_t>(mapping, 30) != 0 ||
+        w <= 0 || h == 0 || h == INT32_MIN) {
+        munmap(mapping, length);
+        throw std::runtime_error("Unsupported BMP format");
+    }
+
+    imageWidth = w;
+    imageHeight = std::abs(h);
+    size_t rowSize = (static_cast<size_t>(imageWidth) * 3 + 3) & ~static_cast<size_t>(3);
+    if (offsetData > length || rowSize * imageHeight > length - offsetData) {
+        munmap(mapping, length);
+        throw std::runtime_error("BMP data truncated");
+    }
+
+    // A positive height means the bottom row is stored first
+    uint8_t* pixels = mapping + offsetData;
+    if (h > 0) {
+        firstRow = pixels + rowSize * (imageHeight - 1);
+        rowStride = -static_cast<ptrdiff_t>(rowSize);
+    } else {
+        firstRow = pixels;
+        rowStride = static_cast<ptrdiff_t>(rowSize);
+    }
+
+    // Block scans sweep the whole image several times; fault it in ahead of the first one
+    madvise(mapping, length, MADV_WILLNEED);
+}
+
+MappedBMP::~MappedBMP() {
+    if (mapping) munmap(mapping, length);
+}
+
+void MappedBMP::write(const std::string& filename) const {
+    // The output may be the very file that is mapped. Truncating it would pull the pages
+    // not yet copied out from under the mapping, so write beside it and rename over it.
+    std::string tempName = filename + ".tmp." + std::to_string(getpid());
+    int fd = open(tempName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw std::runtime_error("Failed to create BMP file");
+
+    const uint8_t* p = mapping;
+    size_t remaining = length;
+    while (remaining > 0) {
+        ssize_t written = ::write(fd, p, remaining);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            close(fd);
+            unlink(tempName.c_str());
+            throw std::runtime_error("Failed to write BMP file");
+        }
+        p += written;
+        remaining -= static_cast<size_t>(written);
+    }
+    if (close(fd) != 0 || rename(tempName.c_str(), filename.c_str()) != 0) {
+        unlink(tempName.c_str());
+        throw std::runtime_error("Failed to write BMP file");
+    }
+}
@@ -0,0 +1,75 @@
+#include "pngWriter.h"
+#include "pngStripe.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+bool PngWriter::write(const std::string &path, const cv::Mat &image,
+                      int level) {
+  int channels = image.channels();
+  if (image.empty() || image.depth() != CV_8U ||
+      (channels != 1 && channels != 3 && channels != 4))
+    return false;
+  level = std::clamp(level, 0, 9);
+
+  std::vector<const uint8_t *> rows(image.rows);
+  for (int y = 0; y < image.rows; ++y)
+    rows[y] = image.ptr<uchar>(y);
+
+  int stripeRows = pngStripeRows(image.cols, channels);
+  int stripes = (image.rows + stripeRows - 1) / stripeRows;
+
+  std::vector<PngStripe> encoded(stripes);
+  std::atomic<bool> failed{false};
+  cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range &range) {
+    for (int s = range.start; s < range.end; ++s) {
+      int y0 = s * stripeRows;
+      int y1 = std::min(image.rows, y0 + stripeRows);
+      if (!encodePngStripe(rows.data(), image.cols, channels, true, y0, y1,
+                           level, s == stripes - 1, encoded[s]))
+        failed = true;
+    }
+  });
+  if (failed)
+    return false;
+  finishPngStripes(encoded);
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file)
+    return false;
+
+  // One IDAT per stripe, each written and freed in turn
+  std::string chunk;
+  appendPngHeader(chunk, image.cols, image.rows, channels);
+  if (!file.write(chunk.data(), chunk.size()))
+    return false;
+  for (auto &stripe : encoded) {
+    chunk.clear();
+    appendPngChunk(chunk, "IDAT", stripe.deflated.data(),
+                   stripe.deflated.size());
+    std::vector<uint8_t>().swap(stripe.deflated);
+    if (!file.write(chunk.data(), chunk.size()))
+      return false;
+  }
+
+  chunk.clear();
+  appendPngChunk(chunk, "IEND", nullptr, 0);
+  file.write(chunk.data(), chunk.size());
+  file.close();
+  return !file.fail();
+}
+
+bool PngWriter::writeImage(const std::string &path, const cv::Mat &image,
+                           int level) {
+  std::string extension = path.size() >= 4 ? path.substr(path.size() - 4) : "";
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  int channels = image.channels();
+  if (extension == ".png" && image.depth() == CV_8U &&
+      (channels == 1 || channels == 3 || channels == 4))
+    return write(path, image, level);
+  return cv::imwrite(path, image);
+}
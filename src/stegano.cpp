@@ -1,418 +1,329 @@
 #include "stegano.h"
+#include "lsbKernels.h"
+#include "pngWriter.h"
 #include "vigenere.h"
-#include <iostream>
-#include <ncurses.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 
-bool Stegano::embedMessage(const std::string &inputImage,
-                           const std::string &outputImage,
-                           const std::string &message) {
-  cv::Mat img = cv::imread(inputImage, cv::IMREAD_COLOR);
-  if (img.empty()) {
-    return false;
-  }
+using LsbKernels::BitOrder;
 
-  int msgLen = message.length();
-  if (msgLen * 8 > img.rows * img.cols * 3) {
-    return false; // message too big
-  }
-
-  int msgIndex = 0;
-  int bitIndex = 0;
-
-  for (int row = 0; row < img.rows && msgIndex < msgLen; ++row) {
-    for (int col = 0; col < img.cols && msgIndex < msgLen; ++col) {
-      for (int ch = 0; ch < img.channels(); ++ch) {
-        uchar &pixel = img.at<cv::Vec3b>(row, col)[ch];
-        pixel &= 0xFE; // clear LSB
-        pixel |= ((message[msgIndex] >> bitIndex) & 1);
-        ++bitIndex;
-        if (bitIndex == 8) {
-          bitIndex = 0;
-          ++msgIndex;
-        }
-      }
-    }
-  }
+using Clock = std::chrono::steady_clock;
 
-  return cv::imwrite(outputImage, img);
-}
+// Payload bytes per stripe below which another thread isn't worth waking:
+// 128 KiB of payload is 1 MiB of carrier
+static const size_t MIN_STRIPE_BYTES = 128 * 1024;
 
-bool Stegano::embedImage(const cv::Mat &carrier, const cv::Mat &secret,
-                         const std::string &outputPath) {
+static std::atomic<int> lsbThreads{0};
 
-  cv::Mat carrier_img = carrier.clone();
-  cv::Mat original_img = carrier.clone();
-  cv::Mat secret_img = secret.clone();
+// Text message header: magic, version, flags, 32-bit big-endian length
+static const char MESSAGE_MAGIC[3] = {'S', 'N', 'M'};
+static const uint8_t MESSAGE_VERSION = 1;
+static const uint8_t MESSAGE_ENCRYPTED = 0x01;
+static const int MESSAGE_BITS_SHIFT = 1; // flags bits 1-2: bits per sample - 1
+static const size_t MESSAGE_HEADER_BYTES = 9;
 
-  // Encode secret image to a compressed PNG byte array
-  std::vector<unsigned char> secretBuffer;
-  cv::imencode(".png", secret, secretBuffer);
-  // Total number of bits to embed
-  size_t dataSize = secretBuffer.size();
-  size_t totalBits = (sizeof(size_t) * 8) + (dataSize * 8); // size + data
+// Image payloads keep bits per sample - 1 in the top byte of the size header,
+// which is zero in images from before k-bit mode
+static const int PAYLOAD_BITS_SHIFT = sizeof(size_t) * 8 - 8;
 
-  // Capacity: rows * cols * 3 channels
-  size_t capacity = carrier_img.rows * carrier_img.cols * 3;
-
-  getchar();
-  clear();
-  mvprintw(2, 1, "Cover capacity %d bytes\n", capacity);
-  mvprintw(2, 1, "Secret image data + header: %d bytes\n", dataSize);
-  refresh();
-
-  if (totalBits > capacity) {
-    mvprintw(3, 1,
-             "Error: Secret image too big! Resize it or use a bigger "
-             "cover image.");
-    refresh();
-    return false;
-  }
+static bool validBits(int bits) {
+  return bits >= 1 && bits <= LsbKernels::MAX_BITS;
+}
 
-  // Prepare data: first embed data size
-  std::vector<unsigned char> sizeBuffer(sizeof(size_t));
-  std::memcpy(sizeBuffer.data(), &dataSize, sizeof(size_t));
+// Payload bytes that fit in `carrierBytes` samples at `bits` bits each
+static size_t fittingBytes(size_t carrierBytes, int bits) {
+  return carrierBytes * bits / 8;
+}
 
-  // Merge sizeBuffer and encryptedData into one vector
-  std::vector<unsigned char> payload(sizeBuffer);
-  payload.insert(payload.end(), secretBuffer.begin(), secretBuffer.end());
+void Stegano::setThreads(int threads) {
+  lsbThreads.store(std::max(threads, 0), std::memory_order_relaxed);
+}
 
-  // Start embedding bits
-  size_t bitIndex = 0;
-  for (int row = 0; row < carrier_img.rows; ++row) {
-    for (int col = 0; col < carrier_img.cols; ++col) {
-      cv::Vec3b &pixel = carrier_img.at<cv::Vec3b>(row, col);
+// How many stripes to cut `bytes` payload bytes into
+static int stripeCount(size_t bytes) {
+  int threads = lsbThreads.load(std::memory_order_relaxed);
+  if (threads == 0)
+    threads = cv::getNumThreads();
+  size_t stripes = std::min(bytes / MIN_STRIPE_BYTES,
+                            static_cast<size_t>(std::max(threads, 1)));
+  return static_cast<int>(std::max<size_t>(stripes, 1));
+}
 
-      for (int channel = 0; channel < 3; ++channel) {
-        if (bitIndex >= totalBits) {
-          break;
+// At k bits per sample every block of k payload bytes touches only its own 8
+// carrier bytes, so each stripe of the payload embeds into its own slice of
+// the carrier with no coordination. Stripes are equal, one per thread, and
+// start on a block boundary.
+template <typename F>
+static void forEachStripe(size_t bytes, int bits, F &&stripe) {
+  int stripes = stripeCount(bytes);
+  if (stripes == 1) {
+    stripe(0, bytes);
+    return;
+  }
+  size_t blocks = (bytes + bits - 1) / bits;
+  cv::parallel_for_(
+      cv::Range(0, stripes),
+      [&](const cv::Range &range) {
+        for (int s = range.start; s < range.end; ++s) {
+          size_t begin = std::min(bytes, blocks * s / stripes * bits);
+          size_t end = s + 1 == stripes
+                           ? bytes
+                           : std::min(bytes, blocks * (s + 1) / stripes * bits);
+          stripe(begin, end);
         }
+      },
+      stripes);
+}
 
-        size_t byteIndex = bitIndex / 8;
-        int bitPosition = 7 - (bitIndex % 8);
-
-        int bit = (payload[byteIndex] >> bitPosition) & 1;
+static void embedBits(uint8_t *carrier, const uint8_t *payload, size_t bytes,
+                      BitOrder order, int bits) {
+  forEachStripe(bytes, bits, [&](size_t begin, size_t end) {
+    LsbKernels::embed(carrier + begin * 8 / bits, payload + begin,
+                      end - begin, order, bits);
+  });
+}
 
-        pixel[channel] &= 0xFE; // Clear LSB
-        pixel[channel] |= bit;  // Set LSB
+static void extractBits(const uint8_t *carrier, uint8_t *payload,
+                        size_t bytes, BitOrder order, int bits) {
+  forEachStripe(bytes, bits, [&](size_t begin, size_t end) {
+    LsbKernels::extract(carrier + begin * 8 / bits, payload + begin,
+                        end - begin, order, bits);
+  });
+}
 
-        ++bitIndex;
-      }
+static double msSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
 
-      if (bitIndex >= totalBits) {
-        break;
-      }
-    }
+// Save `image` unless no output was asked for
+static bool saveOutput(const std::string &path, const cv::Mat &image,
+                       int pngLevel, double &writeMs, std::string &error) {
+  if (path.empty())
+    return true;
+  Clock::time_point start = Clock::now();
+  bool saved = PngWriter::writeImage(path, image, pngLevel);
+  writeMs = msSince(start);
+  if (!saved)
+    error = "Failed to save output image to " + path;
+  return saved;
+}
 
-    if (bitIndex >= totalBits) {
-      break;
-    }
+Stegano::EmbedResult Stegano::embedMessage(const std::string &inputImage,
+                                           const std::string &outputImage,
+                                           const std::string &message,
+                                           bool encrypted, int pngLevel,
+                                           int bitsPerSample) {
+  EmbedResult result;
+  if (!validBits(bitsPerSample)) {
+    result.error = "Bits per sample must be 1-4";
+    return result;
+  }
+  cv::Mat img = cv::imread(inputImage, cv::IMREAD_COLOR);
+  if (img.empty()) {
+    result.error = "Could not read " + inputImage;
+    return result;
   }
 
-  cv::Mat anotherCarrier = carrier_img.clone();
-  // Save the output image
-  if (!cv::imwrite(outputPath, carrier_img)) {
-    std::cerr << "Failed to save output image!" << std::endl;
-    return false;
+  // The header always takes one bit per sample, the message k
+  size_t msgLen = message.length();
+  size_t samples = img.total() * 3;
+  if (samples < MESSAGE_HEADER_BYTES * 8) {
+    result.error = "Cover too small to hold a message";
+    return result;
+  }
+  result.capacityBytes =
+      MESSAGE_HEADER_BYTES +
+      fittingBytes(samples - MESSAGE_HEADER_BYTES * 8, bitsPerSample);
+  result.payloadBytes = MESSAGE_HEADER_BYTES + msgLen;
+  if (msgLen > UINT32_MAX || result.payloadBytes > result.capacityBytes) {
+    result.error = "Message too big for this cover";
+    return result;
   }
 
-  mvprintw(5, 1, "Successfully embedded and saved to %s", outputPath.c_str());
-
-  // Resize both images to the same height
-  int height = std::max(anotherCarrier.rows, original_img.rows);
-  cv::Mat stego_display;
-
-  cv::resize(original_img, original_img, cv::Size(640, 480));
-  cv::resize(anotherCarrier, anotherCarrier, cv::Size(640, 480));
-
-  // Combine them side by side
-  cv::Mat combined_image;
-  cv::hconcat(original_img, anotherCarrier, combined_image);
-
-  // ----- Add label "Original" -----
-  std::string text1 = "Original";
-  int fontFace = cv::FONT_HERSHEY_SIMPLEX;
-  double fontScale = 1.0;
-  int thickness = 2;
-
-  int baseline1 = 0;
-  cv::Size textSize1 =
-      cv::getTextSize(text1, fontFace, fontScale, thickness, &baseline1);
-
-  cv::Point textOrg1(10, 30);
-  cv::Rect bgRect1(textOrg1 + cv::Point(0, baseline1), textSize1);
-
-  cv::Mat roi1 = combined_image(bgRect1);
-  cv::Mat overlay1;
-  roi1.copyTo(overlay1);
-  cv::rectangle(overlay1, cv::Point(0, 0), textSize1, cv::Scalar(0, 0, 0),
-                cv::FILLED);
-
-  double alpha = 0.5;
-  cv::addWeighted(overlay1, alpha, roi1, 1.0 - alpha, 0, roi1);
-
-  cv::putText(combined_image, text1, textOrg1 + cv::Point(0, textSize1.height),
-              fontFace, fontScale, cv::Scalar(255, 255, 255), thickness);
-
-  // ----- Add label "Stego Image" -----
-  std::string text2 = "Stego Image";
-  int baseline2 = 0;
-  cv::Size textSize2 =
-      cv::getTextSize(text2, fontFace, fontScale, thickness, &baseline2);
-
-  cv::Point textOrg2(anotherCarrier.cols + 10, 30);
-  cv::Rect bgRect2(textOrg2 + cv::Point(0, baseline2), textSize2);
-
-  cv::Mat roi2 = combined_image(bgRect2);
-  cv::Mat overlay2;
-  roi2.copyTo(overlay2);
-  cv::rectangle(overlay2, cv::Point(0, 0), textSize2, cv::Scalar(0, 0, 0),
-                cv::FILLED);
-
-  cv::addWeighted(overlay2, alpha, roi2, 1.0 - alpha, 0, roi2);
-
-  cv::putText(combined_image, text2, textOrg2 + cv::Point(0, textSize2.height),
-              fontFace, fontScale, cv::Scalar(255, 255, 255), thickness);
-
-  // Show combined image
-  cv::namedWindow("Side by Side Images", cv::WINDOW_AUTOSIZE);
-  cv::imshow("Side by Side Images", combined_image);
-  // REQUIRED! Process window events or wait for key input
-  cv::waitKey(1000); // Wait 1000 ms for image to process
-
-  // Display the combined image
-  cv::imshow("Side by Side Images", combined_image);
-  mvprintw(4, 1, "Success to embed!\n");
-  mvprintw(6, 1, "Press any key to continue...\n");
-  refresh();
-  getch();
-  cv::destroyAllWindows();
-  return true;
+  uint8_t header[MESSAGE_HEADER_BYTES];
+  std::memcpy(header, MESSAGE_MAGIC, sizeof(MESSAGE_MAGIC));
+  header[3] = MESSAGE_VERSION;
+  header[4] = (encrypted ? MESSAGE_ENCRYPTED : 0) |
+              (bitsPerSample - 1) << MESSAGE_BITS_SHIFT;
+  for (int i = 0; i < 4; ++i)
+    header[5 + i] = static_cast<uint8_t>(msgLen >> (24 - 8 * i));
+
+  // imread hands back a continuous BGR image: k bits per byte, in order
+  Clock::time_point start = Clock::now();
+  LsbKernels::embed(img.data, header, MESSAGE_HEADER_BYTES,
+                    BitOrder::LsbFirst);
+  embedBits(img.data + MESSAGE_HEADER_BYTES * 8,
+            reinterpret_cast<const uint8_t *>(message.data()), msgLen,
+            BitOrder::LsbFirst, bitsPerSample);
+  result.embedMs = msSince(start);
+
+  result.stego = img;
+  result.ok =
+      saveOutput(outputImage, img, pngLevel, result.writeMs, result.error);
+  return result;
 }
 
-// Embed data size and encrypted data into the carrier image
-bool Stegano::embedImage(const cv::Mat &carrier, const cv::Mat &secret,
-                         const std::string &key,
-                         const std::string &outputPath) {
-  cv::Mat carrier_img = carrier.clone();
-  cv::Mat original_img = carrier.clone();
-  cv::Mat secret_img = secret.clone();
-
-  // Encode secret image to a compressed PNG byte array
-  std::vector<unsigned char> secretBuffer;
-  cv::imencode(".png", secret, secretBuffer);
-
-  // Encrypt the data
-  std::vector<unsigned char> encryptedData =
-      Vigenere::vigenereEncrypt(secretBuffer, key);
+// Embed data size and the (possibly encrypted) secret bytes into a copy of the
+// carrier
+static Stegano::EmbedResult
+embedPayload(const cv::Mat &carrier, const std::vector<unsigned char> &data,
+             const std::string &outputPath, int pngLevel, int bitsPerSample) {
+  Stegano::EmbedResult result;
+  if (carrier.type() != CV_8UC3) {
+    result.error = "Cover must be an 8-bit colour image";
+    return result;
+  }
+  if (!validBits(bitsPerSample)) {
+    result.error = "Bits per sample must be 1-4";
+    return result;
+  }
 
-  // Total number of bits to embed
-  size_t dataSize = encryptedData.size();
-  size_t totalBits = (sizeof(size_t) * 8) + (dataSize * 8); // size + data
+  // The size header takes one bit per sample, the data k
+  size_t dataSize = data.size();
+  size_t headerSamples = sizeof(size_t) * 8;
 
   // Capacity: rows * cols * 3 channels
-  size_t capacity = carrier_img.rows * carrier_img.cols * 3;
-
-  clear();
-  mvprintw(2, 1, "Cover capacity %d bytes\n", capacity);
-  mvprintw(2, 1, "Secret image data + header: %d bytes\n", dataSize);
-  refresh();
-
-  if (totalBits > capacity) {
-    mvprintw(3, 1,
-             "Error: Secret image too big! Resize it or use a bigger "
-             "cover image.");
-    refresh();
-    return false;
+  size_t capacity = carrier.total() * 3;
+  result.capacityBytes =
+      capacity < headerSamples
+          ? 0
+          : sizeof(size_t) +
+                fittingBytes(capacity - headerSamples, bitsPerSample);
+  result.payloadBytes = sizeof(size_t) + dataSize;
+
+  if (result.payloadBytes > result.capacityBytes) {
+    result.error = "Secret image too big! Resize it or use a bigger cover "
+                   "image.";
+    return result;
   }
 
-  // Prepare data: first embed data size
-  std::vector<unsigned char> sizeBuffer(sizeof(size_t));
-  std::memcpy(sizeBuffer.data(), &dataSize, sizeof(size_t));
-
-  // Merge sizeBuffer and encryptedData into one vector
-  std::vector<unsigned char> payload(sizeBuffer);
-  payload.insert(payload.end(), encryptedData.begin(), encryptedData.end());
-
-  // Start embedding bits
-  size_t bitIndex = 0;
-  for (int row = 0; row < carrier_img.rows; ++row) {
-    for (int col = 0; col < carrier_img.cols; ++col) {
-      cv::Vec3b &pixel = carrier_img.at<cv::Vec3b>(row, col);
-
-      for (int channel = 0; channel < 3; ++channel) {
-        if (bitIndex >= totalBits) {
-          break;
-        }
-
-        size_t byteIndex = bitIndex / 8;
-        int bitPosition = 7 - (bitIndex % 8);
-
-        int bit = (payload[byteIndex] >> bitPosition) & 1;
-
-        pixel[channel] &= 0xFE; // Clear LSB
-        pixel[channel] |= bit;  // Set LSB
-
-        ++bitIndex;
-      }
+  Clock::time_point start = Clock::now();
+  cv::Mat carrier_img = carrier.clone();
 
-      if (bitIndex >= totalBits) {
-        break;
-      }
-    }
+  // Prepare data: first embed data size, tagged with bits per sample
+  size_t sizeHeader = dataSize | static_cast<size_t>(bitsPerSample - 1)
+                                     << PAYLOAD_BITS_SHIFT;
+  std::vector<unsigned char> sizeBuffer(sizeof(size_t));
+  std::memcpy(sizeBuffer.data(), &sizeHeader, sizeof(size_t));
+
+  // A clone is continuous, so sample i is byte i of the flattened image
+  LsbKernels::embed(carrier_img.data, sizeBuffer.data(), sizeBuffer.size(),
+                    BitOrder::MsbFirst);
+  embedBits(carrier_img.data + headerSamples, data.data(), dataSize,
+            BitOrder::MsbFirst, bitsPerSample);
+  result.embedMs = msSince(start);
+
+  result.stego = carrier_img;
+  result.ok = saveOutput(outputPath, carrier_img, pngLevel, result.writeMs,
+                         result.error);
+  return result;
+}
 
-    if (bitIndex >= totalBits) {
-      break;
-    }
+Stegano::EmbedResult Stegano::embedImage(const cv::Mat &carrier,
+                                         const cv::Mat &secret,
+                                         const std::string &outputPath,
+                                         int pngLevel, int bitsPerSample) {
+  // Encode secret image to a compressed PNG byte array
+  std::vector<unsigned char> secretBuffer;
+  if (secret.empty() || !cv::imencode(".png", secret, secretBuffer)) {
+    EmbedResult result;
+    result.error = "Could not encode the secret image";
+    return result;
   }
+  return embedPayload(carrier, secretBuffer, outputPath, pngLevel,
+                      bitsPerSample);
+}
 
-  cv::Mat anotherCarrier = carrier_img.clone();
-  // Save the output image
-  if (!cv::imwrite(outputPath, carrier_img)) {
-    std::cerr << "Failed to save output image!" << std::endl;
-    return false;
+// Embed data size and encrypted data into the carrier image
+Stegano::EmbedResult Stegano::embedImage(const cv::Mat &carrier,
+                                         const cv::Mat &secret,
+                                         const std::string &key,
+                                         const std::string &outputPath,
+                                         int pngLevel, int bitsPerSample) {
+  // Encode secret image to a compressed PNG byte array
+  std::vector<unsigned char> secretBuffer;
+  if (secret.empty() || !cv::imencode(".png", secret, secretBuffer)) {
+    EmbedResult result;
+    result.error = "Could not encode the secret image";
+    return result;
   }
 
-  mvprintw(5, 1, "Successfully embedded and saved to %s", outputPath.c_str());
-
-  // Resize both images to the same height
-  int height = std::max(anotherCarrier.rows, original_img.rows);
-  cv::Mat stego_display;
-
-  cv::resize(original_img, original_img, cv::Size(640, 480));
-  cv::resize(anotherCarrier, anotherCarrier, cv::Size(640, 480));
-
-  // Combine them side by side
-  cv::Mat combined_image;
-  cv::hconcat(original_img, anotherCarrier, combined_image);
-
-  // ----- Add label "Original" -----
-  std::string text1 = "Original";
-  int fontFace = cv::FONT_HERSHEY_SIMPLEX;
-  double fontScale = 1.0;
-  int thickness = 2;
-
-  int baseline1 = 0;
-  cv::Size textSize1 =
-      cv::getTextSize(text1, fontFace, fontScale, thickness, &baseline1);
-
-  cv::Point textOrg1(10, 30);
-  cv::Rect bgRect1(textOrg1 + cv::Point(0, baseline1), textSize1);
-
-  cv::Mat roi1 = combined_image(bgRect1);
-  cv::Mat overlay1;
-  roi1.copyTo(overlay1);
-  cv::rectangle(overlay1, cv::Point(0, 0), textSize1, cv::Scalar(0, 0, 0),
-                cv::FILLED);
-
-  double alpha = 0.5;
-  cv::addWeighted(overlay1, alpha, roi1, 1.0 - alpha, 0, roi1);
-
-  cv::putText(combined_image, text1, textOrg1 + cv::Point(0, textSize1.height),
-              fontFace, fontScale, cv::Scalar(255, 255, 255), thickness);
-
-  // ----- Add label "Stego Image" -----
-  std::string text2 = "Stego Image";
-  int baseline2 = 0;
-  cv::Size textSize2 =
-      cv::getTextSize(text2, fontFace, fontScale, thickness, &baseline2);
-
-  cv::Point textOrg2(anotherCarrier.cols + 10, 30);
-  cv::Rect bgRect2(textOrg2 + cv::Point(0, baseline2), textSize2);
-
-  cv::Mat roi2 = combined_image(bgRect2);
-  cv::Mat overlay2;
-  roi2.copyTo(overlay2);
-  cv::rectangle(overlay2, cv::Point(0, 0), textSize2, cv::Scalar(0, 0, 0),
-                cv::FILLED);
-
-  cv::addWeighted(overlay2, alpha, roi2, 1.0 - alpha, 0, roi2);
-
-  cv::putText(combined_image, text2, textOrg2 + cv::Point(0, textSize2.height),
-              fontFace, fontScale, cv::Scalar(255, 255, 255), thickness);
-
-  // Show combined image
-  cv::namedWindow("Side by Side Images", cv::WINDOW_AUTOSIZE);
-  cv::imshow("Side by Side Images", combined_image);
-  // REQUIRED! Process window events or wait for key input
-  cv::waitKey(1000); // Wait 1000 ms for image to process
-
-  // Display the combined image
-  cv::imshow("Side by Side Images", combined_image);
-  mvprintw(4, 1, "Success to embed!\n");
-  mvprintw(6, 1, "Press any key to continue...\n");
-  refresh();
-  getch();
-  cv::destroyAllWindows();
-  return true;
+  // Encrypt the data
+  std::vector<unsigned char> encryptedData =
+      Vigenere::vigenereEncrypt(secretBuffer, key);
+  return embedPayload(carrier, encryptedData, outputPath, pngLevel,
+                      bitsPerSample);
 }
 
-bool Stegano::extractMessage(const std::string &inputImage,
-                             std::string &message) {
+Stegano::ExtractResult Stegano::extractMessage(const std::string &inputImage) {
+  ExtractResult result;
   cv::Mat img = cv::imread(inputImage, cv::IMREAD_COLOR);
   if (img.empty()) {
-    return false;
+    result.error = "Could not read " + inputImage;
+    return result;
   }
 
-  std::string extracted;
-  char ch = 0;
-  int bitIndex = 0;
-
-  for (int row = 0; row < img.rows; ++row) {
-    for (int col = 0; col < img.cols; ++col) {
-      for (int c = 0; c < img.channels(); ++c) {
-        uchar pixel = img.at<cv::Vec3b>(row, col)[c];
-        ch |= (pixel & 1) << bitIndex;
-        ++bitIndex;
-        if (bitIndex == 8) {
-          if (ch == '\0') {
-            message = extracted;
-            return true;
-          }
-          extracted += ch;
-          ch = 0;
-          bitIndex = 0;
-        }
-      }
-    }
+  size_t samples = img.total() * 3;
+  if (samples < MESSAGE_HEADER_BYTES * 8) {
+    result.error = "No hidden message found";
+    return result;
   }
 
-  message = extracted;
-  return true;
+  Clock::time_point start = Clock::now();
+  uint8_t header[MESSAGE_HEADER_BYTES];
+  LsbKernels::extract(img.data, header, MESSAGE_HEADER_BYTES,
+                      BitOrder::LsbFirst);
+  result.extractMs = msSince(start);
+  if (std::memcmp(header, MESSAGE_MAGIC, sizeof(MESSAGE_MAGIC)) != 0) {
+    result.error = "No hidden message found";
+    return result;
+  }
+  if (header[3] != MESSAGE_VERSION) {
+    result.error =
+        "Unsupported message format version " + std::to_string(header[3]);
+    return result;
+  }
+  int bits = ((header[4] >> MESSAGE_BITS_SHIFT) & 0x03) + 1;
+  size_t length = 0;
+  for (int i = 0; i < 4; ++i)
+    length = length << 8 | header[5 + i];
+  if (length > fittingBytes(samples - MESSAGE_HEADER_BYTES * 8, bits)) {
+    result.error = "Message header is corrupt";
+    return result;
+  }
+
+  result.message.resize(length);
+  extractBits(img.data + MESSAGE_HEADER_BYTES * 8,
+              reinterpret_cast<uint8_t *>(&result.message[0]), length,
+              BitOrder::LsbFirst, bits);
+  result.extractMs = msSince(start);
+
+  result.encrypted = (header[4] & MESSAGE_ENCRYPTED) != 0;
+  result.bitsPerSample = bits;
+  result.payloadBytes = MESSAGE_HEADER_BYTES + length;
+  result.ok = true;
+  return result;
 }
 
 bool Stegano::embedData(const cv::Mat &coverImage,
                         const std::vector<unsigned char> &data,
-                        cv::Mat &stegoImage) {
+                        cv::Mat &stegoImage, int bitsPerSample) {
 
-  int totalBits = data.size() * 8;
-  int maxCapacity = coverImage.rows * coverImage.cols * 3;
+  size_t samples = LsbKernels::carrierBytes(data.size(), bitsPerSample);
+  size_t maxCapacity = coverImage.total() * 3;
 
-  if (totalBits > maxCapacity) {
-    std::cout << "Error: Data too big to embed! Max bytes = "
-              << (maxCapacity / 8) << std::endl;
+  if (coverImage.type() != CV_8UC3 || !validBits(bitsPerSample) ||
+      samples > maxCapacity) {
     return false;
   }
 
   stegoImage = coverImage.clone();
-
-  int bitIndex = 0;
-  for (int row = 0; row < coverImage.rows && bitIndex < totalBits; row++) {
-    for (int col = 0; col < coverImage.cols && bitIndex < totalBits; col++) {
-      cv::Vec3b pixel = stegoImage.at<cv::Vec3b>(row, col);
-
-      for (int channel = 0; channel < 3 && bitIndex < totalBits; channel++) {
-        int byteIndex = bitIndex / 8;
-        int bitInByte = 7 - (bitIndex % 8);
-        unsigned char bit = (data[byteIndex] >> bitInByte) & 1;
-
-        pixel[channel] = (pixel[channel] & 0xFE) | bit;
-        bitIndex++;
-      }
-
-      stegoImage.at<cv::Vec3b>(row, col) = pixel;
-    }
-  }
-
+  embedBits(stegoImage.data, data.data(), data.size(), BitOrder::MsbFirst,
+            bitsPerSample);
   return true;
 }
 
@@ -431,159 +342,93 @@ int Stegano::bytesToInt(const std::vector<unsigned char> &bytes) {
   return (bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
 }
 
-// Extract encrypted data and decrypt to recover the hidden image
-bool Stegano::extractImage(const cv::Mat &carrier_img, const std::string &key,
-                           const std::string &outputPath) {
-  size_t bitIndex = 0;
-
-  // First extract data size
-  size_t dataSize = 0;
-  std::vector<unsigned char> sizeBuffer(sizeof(size_t));
-
-  for (size_t i = 0; i < sizeBuffer.size(); ++i) {
-    unsigned char currentByte = 0;
-
-    for (int bitPos = 7; bitPos >= 0; --bitPos) {
-      int row = bitIndex / (carrier_img.cols * 3);
-      int col = (bitIndex / 3) % carrier_img.cols;
-      int channel = bitIndex % 3;
-
-      cv::Vec3b pixel = carrier_img.at<cv::Vec3b>(row, col);
-      int lsb = pixel[channel] & 1;
-
-      currentByte |= (lsb << bitPos);
-
-      ++bitIndex;
-    }
-
-    sizeBuffer[i] = currentByte;
+// Read back the size header and the bytes embedPayload wrote, then decrypt
+// (when a key is given) and decode them as an image
+static Stegano::ExtractResult extractPayload(const cv::Mat &carrier_img,
+                                             const std::string *key,
+                                             const std::string &outputPath) {
+  Stegano::ExtractResult result;
+  if (carrier_img.type() != CV_8UC3) {
+    result.error = "Stego image must be an 8-bit colour image";
+    return result;
+  }
+  size_t samples = carrier_img.total() * 3;
+  size_t headerSamples = sizeof(size_t) * 8;
+  if (samples < headerSamples) {
+    result.error = "Image too small to hold a payload";
+    return result;
   }
 
-  mvprintw(3, 1, "Selected path:\n");
-  refresh();
-  getch();
-  std::memcpy(&dataSize, sizeBuffer.data(), sizeof(size_t));
-  // std::cout << "Data size to extract: " << dataSize << " bytes" << std::endl;
-
-  // Now extract the actual encrypted data
-  std::vector<unsigned char> encryptedData(dataSize);
-
-  for (size_t i = 0; i < encryptedData.size(); ++i) {
-    unsigned char currentByte = 0;
-
-    for (int bitPos = 7; bitPos >= 0; --bitPos) {
-      int row = bitIndex / (carrier_img.cols * 3);
-      int col = (bitIndex / 3) % carrier_img.cols;
-      int channel = bitIndex % 3;
-
-      cv::Vec3b pixel = carrier_img.at<cv::Vec3b>(row, col);
-      int lsb = pixel[channel] & 1;
-
-      currentByte |= (lsb << bitPos);
-
-      ++bitIndex;
-    }
+  Clock::time_point start = Clock::now();
+  cv::Mat flat = carrier_img.isContinuous() ? carrier_img : carrier_img.clone();
 
-    encryptedData[i] = currentByte;
+  // First extract data size and bits per sample
+  size_t sizeHeader = 0;
+  std::vector<unsigned char> sizeBuffer(sizeof(size_t));
+  LsbKernels::extract(flat.data, sizeBuffer.data(), sizeBuffer.size(),
+                      BitOrder::MsbFirst);
+  std::memcpy(&sizeHeader, sizeBuffer.data(), sizeof(size_t));
+  size_t tag = sizeHeader >> PAYLOAD_BITS_SHIFT;
+  int bits = static_cast<int>(tag) + 1;
+  size_t dataSize =
+      sizeHeader & ((static_cast<size_t>(1) << PAYLOAD_BITS_SHIFT) - 1);
+
+  // A cover without a payload yields an arbitrary size and tag
+  if (tag >= static_cast<size_t>(LsbKernels::MAX_BITS) ||
+      dataSize > fittingBytes(samples - headerSamples, bits)) {
+    result.error = "No hidden image found";
+    return result;
   }
 
+  // Now extract the actual (possibly encrypted) data
+  std::vector<unsigned char> data(dataSize);
+  extractBits(flat.data + headerSamples, data.data(), data.size(),
+              BitOrder::MsbFirst, bits);
+  result.bitsPerSample = bits;
+  result.payloadBytes = sizeof(size_t) + dataSize;
+
   // Decrypt data
-  std::vector<unsigned char> decryptedData =
-      Vigenere::vigenereDecrypt(encryptedData, key);
+  if (key)
+    data = Vigenere::vigenereDecrypt(data, *key);
 
   // Decode the image
-  cv::Mat extracted_img = cv::imdecode(decryptedData, cv::IMREAD_UNCHANGED);
-
-  if (extracted_img.empty()) {
-    mvprintw(5, 1, "Failed to decode extracted image!\n");
+  result.image = cv::imdecode(data, cv::IMREAD_UNCHANGED);
+  result.extractMs = msSince(start);
 
-    mvprintw(6, 1, "Press any key to continue... \n");
-    refresh();
-    getch();
-    return false;
+  if (result.image.empty()) {
+    result.error = "Failed to decode extracted image!";
+    return result;
   }
-  cv::imwrite(outputPath, extracted_img);
-
-  mvprintw(5, 1, "Successfully extracted and saved to %s", outputPath.c_str());
-
-  mvprintw(6, 1, "Press any key to continue... \n");
-  refresh();
-  getch();
-  return true;
+  result.ok = saveOutput(outputPath, result.image, 6, result.writeMs,
+                         result.error);
+  return result;
 }
 
-bool Stegano::extractImage(const cv::Mat &carrier_img,
-                           const std::string &outputPath) {
-  size_t bitIndex = 0;
-
-  // First extract data size
-  size_t dataSize = 0;
-  std::vector<unsigned char> sizeBuffer(sizeof(size_t));
-
-  for (size_t i = 0; i < sizeBuffer.size(); ++i) {
-    unsigned char currentByte = 0;
-
-    for (int bitPos = 7; bitPos >= 0; --bitPos) {
-      int row = bitIndex / (carrier_img.cols * 3);
-      int col = (bitIndex / 3) % carrier_img.cols;
-      int channel = bitIndex % 3;
-
-      cv::Vec3b pixel = carrier_img.at<cv::Vec3b>(row, col);
-      int lsb = pixel[channel] & 1;
-
-      currentByte |= (lsb << bitPos);
-
-      ++bitIndex;
-    }
-
-    sizeBuffer[i] = currentByte;
-  }
-
-  mvprintw(3, 1, "Selected path:\n");
-  refresh();
-  getch();
-  std::memcpy(&dataSize, sizeBuffer.data(), sizeof(size_t));
-  // std::cout << "Data size to extract: " << dataSize << " bytes" << std::endl;
-
-  // Now extract the actual encrypted data
-  std::vector<unsigned char> encryptedData(dataSize);
-
-  for (size_t i = 0; i < encryptedData.size(); ++i) {
-    unsigned char currentByte = 0;
-
-    for (int bitPos = 7; bitPos >= 0; --bitPos) {
-      int row = bitIndex / (carrier_img.cols * 3);
-      int col = (bitIndex / 3) % carrier_img.cols;
-      int channel = bitIndex % 3;
-
-      cv::Vec3b pixel = carrier_img.at<cv::Vec3b>(row, col);
-      int lsb = pixel[channel] & 1;
-
-      currentByte |= (lsb << bitPos);
+// Extract encrypted data and decrypt to recover the hidden image
+Stegano::ExtractResult Stegano::extractImage(const cv::Mat &carrier_img,
+                                             const std::string &key,
+                                             const std::string &outputPath) {
+  return extractPayload(carrier_img, &key, outputPath);
+}
 
-      ++bitIndex;
-    }
+Stegano::ExtractResult Stegano::extractImage(const cv::Mat &carrier_img,
+                                             const std::string &outputPath) {
+  return extractPayload(carrier_img, nullptr, outputPath);
+}
 
-    encryptedData[i] = currentByte;
-  }
+double Stegano::psnr(const cv::Mat &original, const cv::Mat &stego) {
+  cv::Mat s1;
+  cv::absdiff(original, stego, s1); // |I1 - I2|
+  s1.convertTo(s1, CV_32F);         // make sure it's float
+  s1 = s1.mul(s1);                  // square the difference
 
-  // Decode the image
-  cv::Mat extracted_img = cv::imdecode(encryptedData, cv::IMREAD_UNCHANGED);
+  cv::Scalar s = cv::sum(s1); // sum all elements per channel
 
-  if (extracted_img.empty()) {
-    mvprintw(5, 1, "Failed to decode extracted image!\n");
+  double sse = s.val[0] + s.val[1] + s.val[2]; // sum channels
 
-    mvprintw(6, 1, "Press any key to continue... \n");
-    refresh();
-    getch();
-    return false;
+  if (sse <= 1e-10) { // if small enough -> identical images
+    return INFINITY;
   }
-  cv::imwrite(outputPath, extracted_img);
-
-  mvprintw(5, 1, "Successfully extracted and saved to %s", outputPath.c_str());
-
-  mvprintw(6, 1, "Press any key to continue... \n");
-  refresh();
-  getch();
-  return true;
+  double mse = sse / (double)(original.channels() * original.total());
+  return 10.0 * log10((255 * 255) / mse);
 }
@@ -1,7 +1,10 @@
+#include "lsbKernels.h"
+#include <algorithm>
 #include <bitset>
 #include <cmath>
 #include <cstdint>
 #include <iostream>
+#include <numeric>
 #include <opencv2/opencv.hpp>
 #include <random>
 #include <string>
@@ -10,6 +13,17 @@
 using namespace cv;
 using namespace std;
 
+using LsbKernels::Sample;
+
+// Frame 0 holds the metadata byte in pixels 0-7, the message length in bits in
+// pixels 8-39, LAYOUT_MARKER in pixels 40-55 and bits per channel - 1 in
+// pixels 56-57, all one bit each in the blue channel. Videos from before k-bit
+// mode have no marker and are read at one bit per channel.
+const int LENGTH_PIXEL = 8;
+const int MARKER_PIXEL = 40;
+const int BITS_PIXEL = 56;
+const uint16_t LAYOUT_MARKER = 0x6B62; // "kb"
+
 std::string original_path;
 std::string stego_path;
 
@@ -68,8 +82,8 @@ void embedMetadata(cv::Mat &frame, uint8_t metadata) {
     // Extract the relevant bit from metadata (little-endian)
     uint8_t bit = (metadata >> p) & 1;
 
-    // Clear LSB of the blue channel, then set it
-    pixel[0] = (pixel[0] & 0xFE) | bit;
+    // Replace the LSB of the blue channel
+    pixel[0] = Sample<1>::set(pixel[0], bit);
   }
 
   std::cout << "[*] Embedded metadata: " << (int)metadata << "\n";
@@ -94,7 +108,28 @@ vector<bool> getLengthBits(uint32_t lengthInBits) {
   return lengthBits;
 }
 
+// One header bit in the blue channel of pixel `pixelIdx` of frame 0
+void setHeaderBit(Mat &frame, int pixelIdx, bool bit) {
+  int x = pixelIdx % frame.cols;
+  int y = pixelIdx / frame.cols;
+  if (y >= frame.rows)
+    return;
+  uint8_t &blue = frame.at<Vec3b>(y, x)[0];
+  blue = Sample<1>::set(blue, bit);
+}
+
+bool getHeaderBit(const Mat &frame, int pixelIdx) {
+  int x = pixelIdx % frame.cols;
+  int y = pixelIdx / frame.cols;
+  if (y >= frame.rows)
+    return false;
+  return Sample<1>::get(frame.at<Vec3b>(y, x)[0]);
+}
+
 // ====================== Embed Functions ======================
+// Each channel takes the next K message bits, the first in its high bit; the
+// last channel is zero padded
+template <int K>
 void embedBitsInFrame(Mat &frame, const vector<bool> &bits, int &bitIndex,
                       bool randomPixels, mt19937 &rng) {
   int rows = frame.rows;
@@ -114,16 +149,30 @@ void embedBitsInFrame(Mat &frame, const vector<bool> &bits, int &bitIndex,
     for (int c = 0; c < channels; ++c) {
       if (bitIndex >= bits.size())
         return;
-      pixel[c] = (pixel[c] & ~1) | bits[bitIndex++];
+      unsigned field = 0;
+      for (int b = 0; b < K; ++b) {
+        bool bit = bitIndex < bits.size() && bits[bitIndex];
+        field = field << 1 | bit;
+        ++bitIndex;
+      }
+      pixel[c] = Sample<K>::set(pixel[c], field);
     }
     if (bitIndex >= bits.size())
       return;
   }
 }
 
+void embedBitsInFrame(Mat &frame, const vector<bool> &bits, int &bitIndex,
+                      bool randomPixels, mt19937 &rng, int bitsPerChannel) {
+  LsbKernels::withBits(bitsPerChannel, [&](auto k) {
+    embedBitsInFrame<decltype(k)::value>(frame, bits, bitIndex, randomPixels,
+                                         rng);
+  });
+}
+
 void embedMessage() {
   string inputVideoPath, outputVideoPath, message, key;
-  int frameMode, pixelMode, encryptFlag;
+  int frameMode, pixelMode, encryptFlag, bitsPerChannel;
 
   cout << "=== EMBED MODE ===\n";
   cout << "Frame Mode:\n1. Sequential\n2. Random\nChoose: ";
@@ -132,6 +181,12 @@ void embedMessage() {
   cin >> pixelMode;
   cout << "Use Vigenere encryption? (1 = Yes / 0 = No): ";
   cin >> encryptFlag;
+  cout << "Bits per channel (1-4): ";
+  cin >> bitsPerChannel;
+  if (bitsPerChannel < 1 || bitsPerChannel > LsbKernels::MAX_BITS) {
+    cerr << "Bits per channel must be 1-4.\n";
+    return;
+  }
 
   if (encryptFlag) {
     cout << "Enter key: ";
@@ -211,20 +266,17 @@ void embedMessage() {
 
       embedMetadata(frame, metadata);
 
-      for (int p = 0; p < 32; p++) {
-        int pixelIdx = p + 8;
-        int x = pixelIdx % frame.cols;
-        int y = pixelIdx / frame.cols;
-
-        if (y >= frame.rows)
-          break;
-
-        frame.at<Vec3b>(y, x)[0] =
-            (frame.at<Vec3b>(y, x)[0] & ~1) | lengthBits[p];
-      }
+      for (int p = 0; p < 32; p++)
+        setHeaderBit(frame, LENGTH_PIXEL + p, lengthBits[p]);
+      for (int p = 0; p < 16; p++)
+        setHeaderBit(frame, MARKER_PIXEL + p, (LAYOUT_MARKER >> (15 - p)) & 1);
+      for (int p = 0; p < 2; p++)
+        setHeaderBit(frame, BITS_PIXEL + p,
+                     ((bitsPerChannel - 1) >> (1 - p)) & 1);
       cout << "[*] Metadata + length embedded in first frame.\n";
     } else {
-      embedBitsInFrame(frame, messageBits, bitIndex, (pixelMode == 2), rng);
+      embedBitsInFrame(frame, messageBits, bitIndex, (pixelMode == 2), rng,
+                       bitsPerChannel);
     }
 
     writer.write(frame);
@@ -264,7 +316,7 @@ uint8_t extractMetadata(const Mat &frame) {
 
   for (int p = 0; p < 8; p++) {
     // Extract LSB from the blue channel of the first row
-    uint8_t lsb = frame.at<Vec3b>(0, p)[0] & 1;
+    uint8_t lsb = Sample<1>::get(frame.at<Vec3b>(0, p)[0]);
 
     // Shift it to its position and OR it into metadata
     metadata |= (lsb << p); // little-endian
@@ -276,17 +328,24 @@ uint8_t extractMetadata(const Mat &frame) {
 
 uint32_t extractLength(const Mat &frame) {
   uint32_t lengthBits = 0;
-  for (int p = 0; p < 32; p++) {
-    int pixelIdx = p + 8;
-    int x = pixelIdx % frame.cols;
-    int y = pixelIdx / frame.cols;
-    if (y >= frame.rows)
-      break;
-    lengthBits |= (frame.at<Vec3b>(y, x)[0] & 1) << (31 - p);
-  }
+  for (int p = 0; p < 32; p++)
+    lengthBits |= static_cast<uint32_t>(getHeaderBit(frame, LENGTH_PIXEL + p))
+                  << (31 - p);
   return lengthBits;
 }
 
+int extractBitsPerChannel(const Mat &frame) {
+  uint16_t marker = 0;
+  for (int p = 0; p < 16; p++)
+    marker = marker << 1 | getHeaderBit(frame, MARKER_PIXEL + p);
+  if (marker != LAYOUT_MARKER)
+    return 1;
+  return (getHeaderBit(frame, BITS_PIXEL) << 1 |
+          getHeaderBit(frame, BITS_PIXEL + 1)) +
+         1;
+}
+
+template <int K>
 void extractMessageBits(vector<bool> &bits, VideoCapture &cap, int totalBits,
                         bool pixelMode, bool frameMode, int totalFrames,
                         uint32_t seed) {
@@ -324,8 +383,11 @@ void extractMessageBits(vector<bool> &bits, VideoCapture &cap, int totalBits,
       for (int c = 0; c < 3; ++c) {
         if (totalBits <= 0)
           return;
-        bits.push_back(pixel[c] & 1);
-        totalBits--;
+        uint8_t field = Sample<K>::get(pixel[c]);
+        for (int b = K - 1; b >= 0 && totalBits > 0; --b) {
+          bits.push_back((field >> b) & 1);
+          totalBits--;
+        }
       }
       if (totalBits <= 0)
         return;
@@ -333,6 +395,15 @@ void extractMessageBits(vector<bool> &bits, VideoCapture &cap, int totalBits,
   }
 }
 
+void extractMessageBits(vector<bool> &bits, VideoCapture &cap, int totalBits,
+                        bool pixelMode, bool frameMode, int totalFrames,
+                        uint32_t seed, int bitsPerChannel) {
+  LsbKernels::withBits(bitsPerChannel, [&](auto k) {
+    extractMessageBits<decltype(k)::value>(bits, cap, totalBits, pixelMode,
+                                           frameMode, totalFrames, seed);
+  });
+}
+
 void extractRandomBits(const cv::Mat &frame, std::vector<uint8_t> &bits,
                        uint32_t messageLength, uint32_t seed) {
   cout << "Seed : " << seed << std::endl;
@@ -343,7 +414,7 @@ void extractRandomBits(const cv::Mat &frame, std::vector<uint8_t> &bits,
     int x = rng() % frame.cols;
     int y = rng() % frame.rows;
 
-    uint8_t bit = frame.at<cv::Vec3b>(y, x)[0] & 1;
+    uint8_t bit = Sample<1>::get(frame.at<cv::Vec3b>(y, x)[0]);
     bits.push_back(bit);
   }
 }
@@ -370,6 +441,7 @@ void extractMessage() {
 
   uint8_t metadata = extractMetadata(frame);
   uint32_t messageLengthBits = extractLength(frame);
+  int bitsPerChannel = extractBitsPerChannel(frame);
   cout << "Metadata : " << static_cast<int>(metadata) << std::endl;
   bool frameMode = (metadata >> 7) & 1;
   bool pixelMode = (metadata >> 6) & 1;
@@ -382,6 +454,7 @@ void extractMessage() {
   cout << "Encryption: " << (encryptFlag ? "Yes" : "No") << endl;
   cout << "Message length: " << messageLengthBits << " bits ("
        << messageLengthBits / 8 << " bytes)\n";
+  cout << "Bits per channel: " << bitsPerChannel << endl;
   string key;
   if (encryptFlag) {
     cout << "Enter key: ";
@@ -390,7 +463,7 @@ void extractMessage() {
 
   vector<bool> messageBits;
   extractMessageBits(messageBits, cap, messageLengthBits, pixelMode, frameMode,
-                     totalFrames, seed);
+                     totalFrames, seed, bitsPerChannel);
 
   string message = bitsToMessage(messageBits);
   if (encryptFlag) {
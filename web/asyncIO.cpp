@@ -0,0 +1,313 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../include/asyncIO.h"
+#include "../include/workerPool.h"
+
+#if !defined(STEGONINJA_NO_IO_URING) && defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define STEGONINJA_HAVE_IO_URING 1
+#endif
+#endif
+
+// Threads that take over the writes when io_uring is not available
+static const size_t FALLBACK_THREADS = 2;
+// Largest single write request; the kernel may complete less and the rest is resubmitted
+static const size_t MAX_WRITE_CHUNK = 1u << 30;
+
+static PendingWrite completed(int error) {
+    std::promise<int> done;
+    done.set_value(error);
+    return PendingWrite(done.get_future());
+}
+
+static int writeAll(int fd, const char* data, size_t length, uint64_t offset) {
+    while (length > 0) {
+        ssize_t n = pwrite(fd, data, std::min(length, MAX_WRITE_CHUNK), static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        if (n == 0) return EIO;
+        data += n;
+        offset += static_cast<uint64_t>(n);
+        length -= static_cast<size_t>(n);
+    }
+    return 0;
+}
+
+#ifdef STEGONINJA_HAVE_IO_URING
+
+// The ring is driven with raw syscalls so there is no liburing dependency
+struct AsyncFileIO::Ring {
+    struct Write {
+        int fd;
+        const char* data;
+        size_t remaining;
+        uint64_t offset;
+        bool closeFile;
+        struct iovec iov;
+        std::promise<int> done;
+    };
+
+    int fd = -1;
+    io_uring_params params{};
+
+    void* sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    void* cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    std::mutex submitMutex;
+    std::condition_variable slotFree;
+    unsigned inFlight = 0;
+    bool stopping = false;
+    std::thread reaper;
+
+    bool open(unsigned entries) {
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) return false;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMmap) sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) return false;
+        cqRing = singleMmap ? sqRing
+                            : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) return false;
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) return false;
+
+        char* sq = static_cast<char*>(sqRing);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        char* cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        reaper = std::thread(&Ring::reap, this);
+        return true;
+    }
+
+    ~Ring() {
+        if (reaper.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(submitMutex);
+                stopping = true;
+            }
+            // A no-op completion wakes the reaper so it can notice
+            submit(nullptr);
+            reaper.join();
+        }
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (fd >= 0) close(fd);
+    }
+
+    // Queue one writev (or a wake-up no-op when `write` is null). The completion queue is never
+    // allowed to hold more than it can, so submitters wait for free slots.
+    void submit(Write* write) {
+        {
+            std::unique_lock<std::mutex> lock(submitMutex);
+            slotFree.wait(lock, [this] { return inFlight < params.cq_entries; });
+            push(write);
+            ++inFlight;
+        }
+        enter();
+    }
+
+    // Requeue a write whose completion the reaper has just taken, in the slot that
+    // completion held. Waiting for a free slot here could wait forever: only the
+    // reaper frees slots, and request threads may take any it frees first.
+    void resubmit(Write* write) {
+        {
+            std::lock_guard<std::mutex> lock(submitMutex);
+            push(write);
+        }
+        enter();
+    }
+
+    // Fill the next SQE; submitMutex must be held
+    void push(Write* write) {
+        // Submitters are serialised by the mutex, so the tail is ours to read plainly
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        if (write) {
+            write->iov.iov_base = const_cast<char*>(write->data);
+            write->iov.iov_len = std::min(write->remaining, MAX_WRITE_CHUNK);
+            sqe->opcode = IORING_OP_WRITEV;
+            sqe->fd = write->fd;
+            sqe->addr = reinterpret_cast<uint64_t>(&write->iov);
+            sqe->len = 1;
+            sqe->off = write->offset;
+        } else {
+            sqe->opcode = IORING_OP_NOP;
+        }
+        sqe->user_data = reinterpret_cast<uint64_t>(write);
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    void enter() {
+        while (syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0) < 0 && errno == EINTR) {}
+    }
+
+    void releaseSlot() {
+        {
+            std::lock_guard<std::mutex> lock(submitMutex);
+            --inFlight;
+        }
+        slotFree.notify_one();
+    }
+
+    void finish(Write* write, int error) {
+        releaseSlot();
+        if (write->closeFile && close(write->fd) != 0 && error == 0) error = errno;
+        write->done.set_value(error);
+        delete write;
+    }
+
+    void reap() {
+        for (;;) {
+            unsigned head = *cqHead;
+            unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            if (head == tail) {
+                {
+                    std::lock_guard<std::mutex> lock(submitMutex);
+                    if (stopping && inFlight == 0) return;
+                }
+                syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                continue;
+            }
+
+            io_uring_cqe* cqe = &cqes[head & *cqMask];
+            Write* write = reinterpret_cast<Write*>(cqe->user_data);
+            int res = cqe->res;
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+
+            // Continuations keep this completion's slot; finished writes and wake-ups free it
+            if (!write) {
+                releaseSlot();
+                continue;
+            }
+            if (res == -EINTR || res == -EAGAIN) {
+                resubmit(write);
+            } else if (res < 0) {
+                finish(write, -res);
+            } else if (res == 0 && write->remaining > 0) {
+                finish(write, EIO);
+            } else {
+                // Short writes carry on from where the kernel stopped
+                write->data += res;
+                write->offset += static_cast<uint64_t>(res);
+                write->remaining -= static_cast<size_t>(res);
+                if (write->remaining > 0) {
+                    resubmit(write);
+                } else {
+                    finish(write, 0);
+                }
+            }
+        }
+    }
+};
+
+#else
+
+struct AsyncFileIO::Ring {};
+
+#endif
+
+AsyncFileIO::AsyncFileIO(unsigned queueDepth, bool useIoUring) {
+#ifdef STEGONINJA_HAVE_IO_URING
+    if (useIoUring) {
+        auto candidate = std::make_unique<Ring>();
+        if (candidate->open(queueDepth)) {
+            ring = std::move(candidate);
+            return;
+        }
+        std::cerr << "io_uring unavailable (" << std::strerror(errno) << "), using threads for file I/O" << std::endl;
+    }
+#else
+    (void)queueDepth;
+    (void)useIoUring;
+#endif
+    fallback = std::make_unique<WorkerPool>(FALLBACK_THREADS);
+}
+
+AsyncFileIO::~AsyncFileIO() = default;
+
+const char* AsyncFileIO::backend() const {
+    return ring ? "io_uring" : "threads";
+}
+
+PendingWrite AsyncFileIO::writeFile(const std::string& path, const void* data, size_t length) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return completed(errno);
+
+    const char* bytes = static_cast<const char*>(data);
+    if (length == 0) {
+        return completed(close(fd) == 0 ? 0 : errno);
+    }
+
+#ifdef STEGONINJA_HAVE_IO_URING
+    if (ring) {
+        auto* write = new Ring::Write{fd, bytes, length, 0, true, {}, {}};
+        PendingWrite pending(write->done.get_future());
+        ring->submit(write);
+        return pending;
+    }
+#endif
+    return PendingWrite(fallback->submit([fd, bytes, length] {
+        int error = writeAll(fd, bytes, length, 0);
+        if (close(fd) != 0 && error == 0) error = errno;
+        return error;
+    }));
+}
+
+PendingWrite AsyncFileIO::writeAt(int fd, const void* data, size_t length, uint64_t offset) {
+    const char* bytes = static_cast<const char*>(data);
+    if (length == 0) return completed(0);
+
+#ifdef STEGONINJA_HAVE_IO_URING
+    if (ring) {
+        auto* write = new Ring::Write{fd, bytes, length, offset, false, {}, {}};
+        PendingWrite pending(write->done.get_future());
+        ring->submit(write);
+        return pending;
+    }
+#endif
+    return PendingWrite(fallback->submit([fd, bytes, length, offset] { return writeAll(fd, bytes, length, offset); }));
+}
@@ -0,0 +1,33 @@
+#include "../include/binaryFrame.h"
+
+static uint32_t readBE32(std::string_view data, size_t offset) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data() + offset);
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+bool parseEmbedFrame(std::string_view body, EmbedFrame& frame, std::string& error) {
+    if (body.size() < EMBED_FRAME_HEADER_SIZE || body.substr(0, 4) != "SNB1") {
+        error = "Invalid frame header";
+        return false;
+    }
+
+    uint64_t coverLength = readBE32(body, 4);
+    uint64_t secretLength = readBE32(body, 8);
+    if (EMBED_FRAME_HEADER_SIZE + coverLength + secretLength != body.size()) {
+        error = "Frame lengths do not match body size";
+        return false;
+    }
+    if (coverLength == 0) {
+        error = "No Cover Image uploaded";
+        return false;
+    }
+    if (secretLength == 0) {
+        error = "No Secret File uploaded";
+        return false;
+    }
+
+    frame.cover = body.substr(EMBED_FRAME_HEADER_SIZE, coverLength);
+    frame.secret = body.substr(EMBED_FRAME_HEADER_SIZE + coverLength, secretLength);
+    return true;
+}
@@ -0,0 +1,66 @@
+#include "../include/bpcsScan.h"
+#include "../include/jobs.h"
+
+static inline uint8_t channelValue(const RGB& pixel, int channel) {
+    return (channel == 0) ? pixel.r : (channel == 1) ? pixel.g : pixel.b;
+}
+
+uint64_t packBlock(const std::vector<RGB>& pixels, int width, int channel, int bitPlane, int x, int y) {
+    int shift = 7 - bitPlane;
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; ++i) {
+        // Blocks past the right edge continue into the next row, as they always have
+        const RGB* row = pixels.data() + static_cast<size_t>(y + i) * width + x;
+        uint64_t rowBits = 0;
+        for (int j = 0; j < 8; ++j) {
+            rowBits |= static_cast<uint64_t>((channelValue(row[j], channel) >> shift) & 1) << j;
+        }
+        bits |= rowBits << (i * 8);
+    }
+    return bits;
+}
+
+int blockComplexity(uint64_t bits) {
+    // Horizontal neighbours differ where a row XORs with itself shifted by one column;
+    // vertical neighbours where it XORs with the row below.
+    uint64_t horizontal = (bits ^ (bits >> 1)) & 0x7F7F7F7F7F7F7F7FULL;
+    uint64_t vertical = (bits ^ (bits >> 8)) & 0x00FFFFFFFFFFFFFFULL;
+    return __builtin_popcountll(horizontal) + __builtin_popcountll(vertical);
+}
+
+std::vector<BlockPosition> findEligibleBlocks(const std::vector<RGB>& pixels, int width, int height) {
+    std::vector<BlockPosition> eligibleBlocks;
+
+    // Progress and cancellation are checked once per block row
+    JobProgress* job = currentJob();
+    uint64_t blocksPerRow = (width + 7) / 8;
+    if (job) {
+        setJobPhase(job, JobPhase::Scanning);
+        job->blocksScanned.store(0, std::memory_order_relaxed);
+        job->blocksTotal.store(3 * 8 * blocksPerRow * (height / 8), std::memory_order_relaxed);
+    }
+    uint64_t scanned = 0;
+
+    // Only whole block rows are scanned; a partial last row would read past the image.
+    // A block that wraps past the right edge needs a row below it, so the last block row stops short.
+    for (int channel = 0; channel < 3; ++channel) {
+        for (int bitPlane = 7; bitPlane >= 0; --bitPlane) {
+            for (int y = 0; y + 8 <= height; y += 8) {
+                if (job) {
+                    checkCancelled(job);
+                    job->blocksScanned.store(scanned, std::memory_order_relaxed);
+                    scanned += blocksPerRow;
+                }
+                int rowEnd = (y + 8 < height) ? width : width - 7;
+                for (int x = 0; x < rowEnd; x += 8) {
+                    if (blockComplexity(packBlock(pixels, width, channel, bitPlane, x, y)) >= BPCS_THRESHOLD) {
+                        eligibleBlocks.push_back({channel, bitPlane, x, y});
+                    }
+                }
+            }
+        }
+    }
+
+    if (job) job->blocksScanned.store(scanned, std::memory_order_relaxed);
+    return eligibleBlocks;
+}
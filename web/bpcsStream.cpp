@@ -0,0 +1,411 @@
+#include "../include/bpcsStream.h"
+#include "../include/bpcsScan.h"
+#include "../include/capacity.h"
+#include "../include/imageEncode.h"
+#include "../include/imageIO.h"
+#include "../include/imgBPCSEmbed.h"
+#include "../include/jobs.h"
+#include "../include/metrics.h"
+#include "../include/resultStore.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <unistd.h>
+
+// Bit planes across the three channels; plane p is channel p / 8, bit plane 7 - p % 8,
+// which is the order findEligibleBlocks emits them in
+static const int PLANES = 24;
+
+// The 8 rows of a block row and the row below, which blocks past the right edge wrap into
+static const int WINDOW_ROWS = 9;
+
+// Largest header: name length byte, a 255-byte name and the 32-bit secret length
+static const size_t MAX_HEADER_BYTES = 1 + 255 + 4;
+
+static const char* TOO_LARGE = "Image too large to decode in memory; send it as a non-interlaced PNG or an uncompressed BMP";
+
+// Feeds an image through a RowDecoder one block row at a time. The window is laid out like
+// an image that starts at the block row, so packBlock(pixels(), width, c, p, x, 0) reads the
+// same pixels as packBlock on the whole image at (x, top()).
+class BlockRowWindow {
+public:
+    explicit BlockRowWindow(RowDecoder& decoder)
+        : decoder(decoder), imageWidth(decoder.width()), imageHeight(decoder.height()),
+          window(static_cast<size_t>(decoder.width()) * WINDOW_ROWS) {}
+
+    int width() const { return imageWidth; }
+    int blockRows() const { return imageHeight / 8; }
+    const std::vector<RGB>& pixels() const { return window; }
+    // Window rows holding image rows: 9, or 8 when the block row touches the bottom edge
+    int rows() const { return loaded; }
+    // Image rows taken from the decoder so far
+    int consumed() const { return top < 0 ? 0 : top + loaded; }
+    // Same limit as findEligibleBlocks: the bottom block row has no row to wrap into
+    int rowEnd() const { return top + 8 < imageHeight ? imageWidth : imageWidth - 7; }
+
+    // Load the next block row; the first call loads block row 0
+    void advance() {
+        if (top < 0) {
+            top = 0;
+            loaded = std::min(WINDOW_ROWS, imageHeight);
+            decoder.readRows(window.data(), loaded);
+            return;
+        }
+        // The row below the last block row is the first row of this one
+        top += 8;
+        std::memcpy(window.data(), window.data() + static_cast<size_t>(8) * imageWidth, static_cast<size_t>(imageWidth) * sizeof(RGB));
+        int fresh = std::min(WINDOW_ROWS - 1, imageHeight - (top + 1));
+        decoder.readRows(window.data() + imageWidth, fresh);
+        loaded = 1 + fresh;
+    }
+
+private:
+    RowDecoder& decoder;
+    int imageWidth;
+    int imageHeight;
+    std::vector<RGB> window;
+    int top = -1;
+    int loaded = 0;
+};
+
+// Calls visit(x) for every eligible block of `plane` in the window's block row, left to right
+template <typename Visit>
+static void forEachEligible(const BlockRowWindow& window, int plane, Visit visit) {
+    int channel = plane / 8;
+    int bitPlane = 7 - plane % 8;
+    for (int x = 0; x < window.rowEnd(); x += 8) {
+        if (blockComplexity(packBlock(window.pixels(), window.width(), channel, bitPlane, x, 0)) >= BPCS_THRESHOLD) {
+            visit(x);
+        }
+    }
+}
+
+// Eligible blocks per block row and plane, counts[blockRow * PLANES + plane]
+static std::vector<uint32_t> countEligible(RowDecoder& decoder) {
+    BlockRowWindow window(decoder);
+    int blockRows = window.blockRows();
+    std::vector<uint32_t> counts(static_cast<size_t>(blockRows) * PLANES);
+
+    JobProgress* job = currentJob();
+    uint64_t blocksPerRow = (window.width() + 7) / 8;
+    if (job) {
+        setJobPhase(job, JobPhase::Scanning);
+        job->blocksScanned.store(0, std::memory_order_relaxed);
+        job->blocksTotal.store(PLANES * blocksPerRow * blockRows, std::memory_order_relaxed);
+    }
+
+    for (int br = 0; br < blockRows; ++br) {
+        if (job) {
+            checkCancelled(job);
+            job->blocksScanned.store(PLANES * blocksPerRow * br, std::memory_order_relaxed);
+        }
+        window.advance();
+        for (int p = 0; p < PLANES; ++p) {
+            uint32_t& count = counts[static_cast<size_t>(br) * PLANES + p];
+            forEachEligible(window, p, [&](int) { ++count; });
+        }
+    }
+
+    if (job) job->blocksScanned.store(PLANES * blocksPerRow * blockRows, std::memory_order_relaxed);
+    return counts;
+}
+
+static uint64_t totalBlocks(const std::vector<uint32_t>& counts) {
+    uint64_t total = 0;
+    for (uint32_t count : counts) total += count;
+    return total;
+}
+
+// Bitstream index, in blocks, of each plane's first block in block row 0. Advancing an entry
+// by its plane's count after every block row keeps it at that plane's next block.
+static std::vector<uint64_t> planeStarts(const std::vector<uint32_t>& counts) {
+    std::vector<uint64_t> starts(PLANES, 0);
+    size_t blockRows = counts.size() / PLANES;
+    uint64_t offset = 0;
+    for (int p = 0; p < PLANES; ++p) {
+        starts[p] = offset;
+        for (size_t br = 0; br < blockRows; ++br) offset += counts[br * PLANES + p];
+    }
+    return starts;
+}
+
+static double squaredError(const RGB* before, const RGB* after, size_t count) {
+    double sum = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        sum += std::pow(before[i].r - after[i].r, 2);
+        sum += std::pow(before[i].g - after[i].g, 2);
+        sum += std::pow(before[i].b - after[i].b, 2);
+    }
+    return sum;
+}
+
+std::tuple<std::string, int> imgBPCSEmbedStreamed(const std::string& fileId, const uint8_t* coverData, size_t coverSize, const std::string& coverFilename, const uint8_t* secretData, size_t secretSize, const std::string& secretFilename, const std::string& password, bool encrypt, bool randomize, const OutputOptions& output, ResultStore& store) {
+    std::string staging;
+    try {
+        if (randomize) {
+            return std::make_tuple("{\"status\":\"error\",\"message\":\"Cover too large for a randomized embed\",\"data\":{}}", 413);
+        }
+        std::unique_ptr<RowDecoder> decoder = openRowDecoder(coverData, coverSize);
+        if (!decoder) {
+            return std::make_tuple("{\"status\":\"error\",\"message\":\"" + std::string(TOO_LARGE) + "\",\"data\":{}}", 413);
+        }
+        int width = decoder->width(), height = decoder->height();
+
+        std::pmr::vector<uint8_t> dataToEmbed = buildPayload(secretData, secretSize, secretFilename, password, encrypt);
+
+        std::vector<uint32_t> counts;
+        {
+            StageTimer timer(Stage::ComplexityScan);
+            counts = countEligible(*decoder);
+        }
+
+        // Check capacity
+        size_t availableBits = totalBlocks(counts) * 64;
+        size_t requiredBits = dataToEmbed.size() * 8;
+        if (requiredBits > availableBits) {
+            return std::make_tuple("{\"status\":\"error\",\"message\":\"Secret data too large. Maximum capacity: " + std::to_string(availableBits / 8) + " bytes\",\"data\":{\"maxCapacity\":\"" + std::to_string(availableBits / 8) + "\"}}", 400);
+        }
+
+        JobProgress* job = currentJob();
+        if (job) {
+            setJobPhase(job, JobPhase::Embedding);
+            job->bitsTotal.store(requiredBits, std::memory_order_relaxed);
+        }
+
+        std::string name = resultName(fileId, output.format);
+        staging = store.stagingPath(name);
+        double sum = 0.0;
+        uint64_t encodedSize;
+        {
+            StageTimer timer(Stage::Embed);
+            decoder = openRowDecoder(coverData, coverSize);
+            BlockRowWindow window(*decoder);
+            RowEncoder encoder(staging, width, height, output);
+
+            // The window keeps the cover's pixels for the complexity scan and the PSNR; bits go
+            // into this copy. Its last row carries into the next block row with whatever bits
+            // wrapping blocks put there.
+            std::vector<RGB> pixels(static_cast<size_t>(width) * WINDOW_ROWS);
+            std::vector<uint64_t> next = planeStarts(counts);
+            int blockRows = window.blockRows();
+            size_t bitIndex = 0;
+
+            for (int br = 0; br < blockRows; ++br) {
+                if (job) {
+                    checkCancelled(job);
+                    job->bitsEmbedded.store(bitIndex, std::memory_order_relaxed);
+                }
+                window.advance();
+                const std::vector<RGB>& original = window.pixels();
+                if (br == 0) {
+                    std::copy(original.begin(), original.begin() + static_cast<size_t>(window.rows()) * width, pixels.begin());
+                } else {
+                    std::copy(pixels.begin() + static_cast<size_t>(8) * width, pixels.begin() + static_cast<size_t>(9) * width, pixels.begin());
+                    std::copy(original.begin() + width, original.begin() + static_cast<size_t>(window.rows()) * width, pixels.begin() + width);
+                }
+
+                for (int p = 0; p < PLANES; ++p) {
+                    uint64_t block = next[p];
+                    next[p] += counts[static_cast<size_t>(br) * PLANES + p];
+                    if (block * 64 >= requiredBits) continue;
+
+                    int channel = p / 8;
+                    int shift = p % 8;
+                    // MSB first, row by row within each block, as bpcsEmbed writes them
+                    forEachEligible(window, p, [&](int x) {
+                        size_t bit = block++ * 64;
+                        for (int i = 0; i < 8 && bit < requiredBits; ++i) {
+                            for (int j = 0; j < 8 && bit < requiredBits; ++j) {
+                                RGB& pixel = pixels[static_cast<size_t>(i) * width + x + j];
+                                uint8_t& value = (channel == 0) ? pixel.r : (channel == 1) ? pixel.g : pixel.b;
+                                uint8_t b = (dataToEmbed[bit / 8] >> (7 - bit % 8)) & 1;
+                                value = (value & ~(1 << shift)) | (b << shift);
+                                ++bit;
+                            }
+                        }
+                        bitIndex = std::max(bitIndex, bit);
+                    });
+                    if (block != next[p]) {
+                        throw std::runtime_error("Cover decoded differently on the second pass");
+                    }
+                }
+
+                // Rows above the carried row are final
+                sum += squaredError(original.data(), pixels.data(), static_cast<size_t>(8) * width);
+                encoder.writeRows(pixels.data(), 8);
+            }
+
+            // The row below the last block row, then rows no block reaches
+            if (blockRows > 0 && window.rows() > 8) {
+                sum += squaredError(window.pixels().data() + static_cast<size_t>(8) * width, pixels.data() + static_cast<size_t>(8) * width, width);
+                encoder.writeRows(pixels.data() + static_cast<size_t>(8) * width, 1);
+            }
+            for (int y = window.consumed(); y < height; y += 8) {
+                int rows = std::min(8, height - y);
+                decoder->readRows(pixels.data(), rows);
+                encoder.writeRows(pixels.data(), rows);
+            }
+
+            encoder.finish();
+            encodedSize = encoder.bytesWritten();
+            if (job) job->bitsEmbedded.store(requiredBits, std::memory_order_relaxed);
+        }
+
+        double mse = sum / (3.0 * width * height);
+        if (mse == 0) {
+            unlink(staging.c_str());
+            return std::make_tuple("{\"status\":\"error\",\"message\":\"PSNR: Infinite dB (no changes made)\",\"data\":{}}", 400);
+        }
+        double psnr = 20 * std::log10(256.0 / std::sqrt(mse));
+
+        setJobPhase(job, JobPhase::Writing);
+        {
+            StageTimer timer(Stage::Publish);
+            if (!store.publishStaged(name)) {
+                return std::make_tuple("{\"status\":\"error\",\"message\":\"Failed to save result\",\"data\":{}}", 500);
+            }
+        }
+        addCounter(Counter::ResultBytes, encodedSize);
+        if (job) job->bytesWritten.store(encodedSize, std::memory_order_relaxed);
+
+        return std::make_tuple("{\"status\":\"success\",\"message\":\"Data embedded successfully\",\"data\":{\"result\":\"/results/" + name + "\",\"originalFilename\":\"" + coverFilename + "\",\"psnr\":\"" + std::to_string(psnr) + "\"}}", 200);
+    } catch (const std::exception& e) {
+        if (!staging.empty()) unlink(staging.c_str());
+        return std::make_tuple("{\"status\":\"error\",\"message\":\"" + std::string(e.what()) + "\",\"data\":{}}", 400);
+    }
+}
+
+// Bytes [0, count) of the embedded stream, decrypted. Decoding stops at the block row that
+// holds the last block needed.
+static std::string readPayload(const uint8_t* data, size_t length, const std::vector<uint32_t>& counts, size_t count, const std::string& password, bool encrypt) {
+    uint64_t needed = (count + 7) / 8;
+    std::string bytes(needed * 8, '\0');
+
+    std::unique_ptr<RowDecoder> decoder = openRowDecoder(data, length);
+    if (!decoder) throw std::runtime_error(TOO_LARGE);
+    BlockRowWindow window(*decoder);
+    std::vector<uint64_t> next = planeStarts(counts);
+
+    JobProgress* job = currentJob();
+    if (job) job->bitsTotal.store(count * 8, std::memory_order_relaxed);
+
+    uint64_t remaining = needed;
+    for (int br = 0; br < window.blockRows() && remaining > 0; ++br) {
+        if (job) {
+            checkCancelled(job);
+            job->bitsEmbedded.store((needed - remaining) * 64, std::memory_order_relaxed);
+        }
+        window.advance();
+        for (int p = 0; p < PLANES; ++p) {
+            uint64_t block = next[p];
+            next[p] += counts[static_cast<size_t>(br) * PLANES + p];
+            if (block >= needed) continue;
+
+            int channel = p / 8;
+            int bitPlane = 7 - p % 8;
+            forEachEligible(window, p, [&](int x) {
+                if (block < needed) {
+                    // Each block row becomes one byte, MSB first
+                    uint64_t bits = packBlock(window.pixels(), window.width(), channel, bitPlane, x, 0);
+                    for (int i = 0; i < 8; ++i) {
+                        uint8_t rowBits = (bits >> (i * 8)) & 0xFF;
+                        uint8_t byte = 0;
+                        for (int j = 0; j < 8; ++j) {
+                            byte |= ((rowBits >> j) & 1) << (7 - j);
+                        }
+                        bytes[block * 8 + i] = static_cast<char>(byte);
+                    }
+                    --remaining;
+                }
+                ++block;
+            });
+        }
+    }
+    if (job) job->bitsEmbedded.store(count * 8, std::memory_order_relaxed);
+
+    bytes.resize(count);
+    if (encrypt && !password.empty()) {
+        for (size_t i = 0; i < bytes.size(); ++i) {
+            bytes[i] = static_cast<char>(static_cast<uint8_t>(bytes[i]) - static_cast<uint8_t>(password[i % password.size()]));
+        }
+    }
+    return bytes;
+}
+
+BPCSExtractResult bpcsExtractStreamed(const uint8_t* stegoData, size_t stegoSize, const std::string& password, bool encrypt, bool randomize) {
+    BPCSExtractResult result;
+    if (randomize) {
+        result.code = 413;
+        result.message = "{\"status\":\"error\",\"message\":\"Image too large for a randomized extract\",\"data\":{}}";
+        return result;
+    }
+    std::unique_ptr<RowDecoder> decoder = openRowDecoder(stegoData, stegoSize);
+    if (!decoder) {
+        result.code = 413;
+        result.message = "{\"status\":\"error\",\"message\":\"" + std::string(TOO_LARGE) + "\",\"data\":{}}";
+        return result;
+    }
+
+    std::vector<uint32_t> counts;
+    {
+        StageTimer timer(Stage::ComplexityScan);
+        counts = countEligible(*decoder);
+    }
+    size_t capacity = totalBlocks(counts) * 8;
+
+    StageTimer timer(Stage::Extract);
+    setJobPhase(currentJob(), JobPhase::Extracting);
+
+    if (capacity < 8) {
+        result.code = 400;
+        result.message = "{\"status\":\"error\",\"message\":\"Invalid data: too short\",\"data\":{}}";
+        return result;
+    }
+
+    std::string header = readPayload(stegoData, stegoSize, counts, std::min(capacity, MAX_HEADER_BYTES), password, encrypt);
+
+    // Read filename length
+    uint8_t filenameLength = static_cast<uint8_t>(header[0]);
+    if (filenameLength == 0) {
+        throw std::runtime_error("Invalid filename length");
+    }
+
+    size_t headerSize = 1 + filenameLength + 4;
+    if (header.size() < headerSize) {
+        throw std::runtime_error("Data truncated");
+    }
+    result.filename = header.substr(1, filenameLength);
+
+    uint32_t secretLength;
+    std::memcpy(&secretLength, header.data() + 1 + filenameLength, sizeof(secretLength));
+
+    size_t totalSize = headerSize + secretLength;
+    if (totalSize > capacity) {
+        throw std::runtime_error("Data truncated");
+    }
+
+    if (totalSize <= header.size()) {
+        result.data = header.substr(headerSize, secretLength);
+    } else {
+        result.data = readPayload(stegoData, stegoSize, counts, totalSize, password, encrypt);
+        result.data.erase(0, headerSize);
+    }
+    return result;
+}
+
+bool streamedCapacity(const uint8_t* data, size_t length, CapacityEstimate& estimate) {
+    std::unique_ptr<RowDecoder> decoder = openRowDecoder(data, length);
+    if (!decoder) return false;
+
+    StageTimer timer(Stage::ComplexityScan);
+    estimate.width = decoder->width();
+    estimate.height = decoder->height();
+    estimate.upperBound = capacityUpperBound(estimate.width, estimate.height);
+    estimate.capacity = totalBlocks(countEligible(*decoder)) * 8;
+    estimate.exact = true;
+    estimate.method = "stream";
+    return true;
+}
@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../include/capacity.h"
+#include "../include/BMPstruct.h"
+#include "../include/bpcsScan.h"
+#include "../include/coverCache.h"
+#include "../include/imageIO.h"
+#include "../include/metrics.h"
+
+// Bit planes across the three channels
+static const uint64_t PLANES = 24;
+
+uint64_t capacityUpperBound(int width, int height) {
+    uint64_t blockRows = height / 8;
+    if (blockRows == 0 || width < 8) return 0;
+
+    // Mirrors findEligibleBlocks: the last block row drops its wrapping block
+    uint64_t blocksPerRow = (width + 7) / 8;
+    uint64_t blocks = blockRows * blocksPerRow - (width % 8 != 0 ? 1 : 0);
+    return blocks * PLANES * 8;
+}
+
+CapacityEstimate coverCapacity(const CoverEntry& cover, const char* method) {
+    CapacityEstimate estimate;
+    estimate.width = cover.width;
+    estimate.height = cover.height;
+    estimate.upperBound = capacityUpperBound(cover.width, cover.height);
+    estimate.capacity = static_cast<uint64_t>(cover.eligibleBlocks.size()) * 8;
+    estimate.exact = true;
+    estimate.method = method;
+    return estimate;
+}
+
+// Count eligible blocks in block rows spread evenly over an uncompressed BMP, decoding only
+// the rows the sample touches. Each strip carries the row below it so wrapping blocks match the full scan.
+static bool sampleBMP(const uint8_t* data, size_t length, int sampleRows, CapacityEstimate& estimate) {
+    BMPFileHeader fileHeader;
+    BMPInfoHeader infoHeader;
+    if (length < sizeof(fileHeader) + sizeof(infoHeader)) return false;
+    std::memcpy(&fileHeader, data, sizeof(fileHeader));
+    std::memcpy(&infoHeader, data + sizeof(fileHeader), sizeof(infoHeader));
+
+    if (fileHeader.fileType != 0x4D42 || infoHeader.headerSize < 40 ||
+        infoHeader.bitCount != 24 || infoHeader.compression != 0 || infoHeader.width <= 0 || infoHeader.height == 0) {
+        return false;
+    }
+
+    int width = infoHeader.width;
+    int height = std::abs(infoHeader.height);
+    bool isBottomUp = infoHeader.height > 0;
+    size_t rowSize = (static_cast<size_t>(width) * 3 + 3) & ~static_cast<size_t>(3);
+    if (fileHeader.offsetData > length || rowSize * height > length - fileHeader.offsetData) return false;
+
+    StageTimer timer(Stage::ComplexityScan);
+    int blockRows = height / 8;
+    int sampled = std::min(std::max(sampleRows, 1), blockRows);
+    uint64_t eligible = 0;
+    std::vector<RGB> strip;
+
+    for (int k = 0; k < sampled; ++k) {
+        int y = static_cast<int>(static_cast<int64_t>(k) * blockRows / sampled) * 8;
+        int rows = (y + 8 < height) ? 9 : 8;
+        strip.resize(static_cast<size_t>(width) * rows);
+
+        for (int i = 0; i < rows; ++i) {
+            int srcY = isBottomUp ? height - 1 - (y + i) : y + i;
+            const uint8_t* row = data + fileHeader.offsetData + srcY * rowSize;
+            RGB* dst = strip.data() + static_cast<size_t>(i) * width;
+            for (int x = 0; x < width; ++x) {
+                dst[x].r = row[x * 3 + 2];
+                dst[x].g = row[x * 3 + 1];
+                dst[x].b = row[x * 3 + 0];
+            }
+        }
+
+        eligible += findEligibleBlocks(strip, width, rows).size();
+    }
+
+    estimate.exact = sampled == blockRows;
+    estimate.capacity = sampled == 0 ? 0 : eligible * blockRows / sampled * 8;
+    estimate.method = "sample";
+    return true;
+}
+
+bool estimateCapacity(const uint8_t* data, size_t length, int sampleRows, CapacityEstimate& estimate) {
+    if (!imageDimensions(data, length, estimate.width, estimate.height)) return false;
+
+    estimate.upperBound = capacityUpperBound(estimate.width, estimate.height);
+    estimate.capacity = estimate.upperBound;
+    estimate.exact = false;
+    estimate.method = "header";
+
+    // Compressed formats would need a full decode before any block can be looked at
+    sampleBMP(data, length, sampleRows, estimate);
+    return true;
+}
@@ -0,0 +1,139 @@
+#include "../include/coverCache.h"
+#include "../include/bpcsScan.h"
+#include "../include/metrics.h"
+#include "../include/imageIO.h"
+#include "../include/jobs.h"
+#include <cstring>
+
+static const uint64_t PRIME1 = 11400714785074694791ULL;
+static const uint64_t PRIME2 = 14029467366897019727ULL;
+static const uint64_t PRIME3 = 1609587929392839161ULL;
+static const uint64_t PRIME4 = 9650029242287828579ULL;
+static const uint64_t PRIME5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input) {
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, uint64_t val) {
+    acc ^= round64(0, val);
+    return acc * PRIME1 + PRIME4;
+}
+
+uint64_t contentHash(const void* data, size_t length, uint64_t seed) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + length;
+    uint64_t h;
+
+    if (length >= 32) {
+        uint64_t v1 = seed + PRIME1 + PRIME2;
+        uint64_t v2 = seed + PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME1;
+        const uint8_t* limit = end - 32;
+        do {
+            v1 = round64(v1, read64(p));
+            v2 = round64(v2, read64(p + 8));
+            v3 = round64(v3, read64(p + 16));
+            v4 = round64(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    } else {
+        h = seed + PRIME5;
+    }
+
+    h += static_cast<uint64_t>(length);
+
+    while (p + 8 <= end) {
+        h ^= round64(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p) * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+        ++p;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+std::shared_ptr<const CoverEntry> decodeCover(const uint8_t* data, size_t length) {
+    auto entry = std::make_shared<CoverEntry>();
+    setJobPhase(currentJob(), JobPhase::Decoding);
+    {
+        StageTimer timer(Stage::Decode);
+        entry->pixels = decodeImage(data, length, entry->width, entry->height);
+    }
+    {
+        StageTimer timer(Stage::ComplexityScan);
+        entry->eligibleBlocks = findEligibleBlocks(entry->pixels, entry->width, entry->height);
+    }
+    return entry;
+}
+
+std::shared_ptr<const CoverEntry> CoverCache::find(uint64_t hash, uint64_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = slots.find(hash);
+    if (it == slots.end() || it->second.size != size) return nullptr;
+    order.splice(order.begin(), order, it->second.pos);
+    return it->second.entry;
+}
+
+void CoverCache::insert(uint64_t hash, uint64_t size, std::shared_ptr<const CoverEntry> entry) {
+    uint64_t footprint = entry->footprint();
+    if (footprint > byteBudget) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto existing = slots.find(hash);
+    if (existing != slots.end()) {
+        usedBytes -= existing->second.entry->footprint();
+        order.erase(existing->second.pos);
+        slots.erase(existing);
+    }
+
+    while (usedBytes + footprint > byteBudget && !order.empty()) {
+        auto victim = slots.find(order.back());
+        usedBytes -= victim->second.entry->footprint();
+        slots.erase(victim);
+        order.pop_back();
+    }
+
+    order.push_front(hash);
+    slots[hash] = {size, std::move(entry), order.begin()};
+    usedBytes += footprint;
+}
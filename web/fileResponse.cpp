@@ -0,0 +1,209 @@
+#include "../include/fileResponse.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace httpserver;
+
+// Response backed by an already opened descriptor. MHD takes ownership of the
+// fd once the raw response is created and sends it with sendfile.
+class ranged_file_response : public http_response {
+public:
+    ranged_file_response(int fd, uint64_t offset, uint64_t length, int code, const std::string& contentType)
+        : http_response(code, contentType), fd(fd), offset(offset), length(length) {}
+
+    ~ranged_file_response() override {
+        if (fd >= 0) close(fd);
+    }
+
+    MHD_Response* get_raw_response() override {
+        MHD_Response* response = MHD_create_response_from_fd_at_offset64(length, fd, offset);
+        if (response) fd = -1;
+        return response;
+    }
+
+private:
+    int fd;
+    uint64_t offset;
+    uint64_t length;
+};
+
+// Response pointing straight into a shared in-memory body. The buffer is kept
+// alive by this object, which libhttpserver holds until the request completes.
+class shared_buffer_response : public http_response {
+public:
+    shared_buffer_response(std::shared_ptr<const std::string> body, uint64_t offset, uint64_t length, int code, const std::string& contentType)
+        : http_response(code, contentType), body(std::move(body)), offset(offset), length(length) {}
+
+    MHD_Response* get_raw_response() override {
+        return MHD_create_response_from_buffer(length, const_cast<char*>(body->data() + offset), MHD_RESPMEM_PERSISTENT);
+    }
+
+private:
+    std::shared_ptr<const std::string> body;
+    uint64_t offset;
+    uint64_t length;
+};
+
+std::string fileETag(const struct stat& st) {
+    char buf[80];
+    std::snprintf(buf, sizeof(buf), "\"%llx-%llx-%llx\"",
+                  static_cast<unsigned long long>(st.st_ino),
+                  static_cast<unsigned long long>(st.st_size),
+                  static_cast<unsigned long long>(st.st_mtim.tv_sec) * 1000000000ULL + st.st_mtim.tv_nsec);
+    return buf;
+}
+
+std::string attachmentDisposition(const std::string& filename) {
+    std::string safe;
+    safe.reserve(filename.size());
+    for (unsigned char c : filename) {
+        safe += (c < 0x20 || c == 0x7F || c == '"' || c == '\\' || c == '/') ? '_' : static_cast<char>(c);
+    }
+    return "attachment; filename=\"" + safe + "\"";
+}
+
+// If-None-Match uses weak comparison, so "W/" prefixes are ignored.
+static bool etagMatches(std::string_view header, const std::string& etag) {
+    std::string_view strong(etag);
+    size_t pos = 0;
+    while (pos < header.size()) {
+        size_t end = header.find(',', pos);
+        if (end == std::string_view::npos) end = header.size();
+        std::string_view tag = header.substr(pos, end - pos);
+        while (!tag.empty() && tag.front() == ' ') tag.remove_prefix(1);
+        while (!tag.empty() && tag.back() == ' ') tag.remove_suffix(1);
+        if (tag.substr(0, 2) == "W/") tag.remove_prefix(2);
+        if (tag == "*" || tag == strong) return true;
+        pos = end + 1;
+    }
+    return false;
+}
+
+static bool parseNumber(std::string_view s, uint64_t& out) {
+    if (s.empty() || s.size() > 19) return false;
+    out = 0;
+    for (char c : s) {
+        if (c < '0' || c > '9') return false;
+        out = out * 10 + (c - '0');
+    }
+    return true;
+}
+
+enum class RangeResult { Full, Partial, Unsatisfiable };
+
+// Only a single "bytes=" range is honoured; multi-range requests fall back to
+// the full body, which RFC 9110 allows.
+static RangeResult parseRange(std::string_view header, uint64_t size, uint64_t& first, uint64_t& last) {
+    if (header.substr(0, 6) != "bytes=") return RangeResult::Full;
+    std::string_view spec = header.substr(6);
+    if (spec.find(',') != std::string_view::npos) return RangeResult::Full;
+
+    size_t dash = spec.find('-');
+    if (dash == std::string_view::npos) return RangeResult::Full;
+    std::string_view from = spec.substr(0, dash);
+    std::string_view to = spec.substr(dash + 1);
+
+    uint64_t a = 0, b = 0;
+    if (from.empty()) {
+        // Suffix range: the last N bytes
+        if (!parseNumber(to, b) || b == 0 || size == 0) return RangeResult::Unsatisfiable;
+        first = b >= size ? 0 : size - b;
+        last = size - 1;
+        return RangeResult::Partial;
+    }
+    if (!parseNumber(from, a)) return RangeResult::Full;
+    if (a >= size) return RangeResult::Unsatisfiable;
+    if (to.empty()) {
+        b = size - 1;
+    } else if (!parseNumber(to, b) || b < a) {
+        return RangeResult::Full;
+    }
+    first = a;
+    last = b >= size ? size - 1 : b;
+    return RangeResult::Partial;
+}
+
+// Shared conditional/range handling. On success `first`/`length` describe the
+// slice to send; otherwise `early` holds the 304/416 response.
+struct ServePlan {
+    std::shared_ptr<http_response> early;
+    int code = 200;
+    uint64_t first = 0;
+    uint64_t length = 0;
+    std::string contentRange;
+};
+
+static ServePlan planResponse(const http_request& req, uint64_t size, const std::string& etag, const std::string& contentType) {
+    ServePlan plan;
+    plan.length = size;
+
+    std::string_view ifNoneMatch = req.get_header("If-None-Match");
+    if (!ifNoneMatch.empty() && etagMatches(ifNoneMatch, etag)) {
+        plan.early = std::make_shared<string_response>("", 304, contentType);
+        plan.early->with_header("ETag", etag);
+        return plan;
+    }
+
+    uint64_t first = 0, last = 0;
+    RangeResult range = RangeResult::Full;
+    std::string_view rangeHeader = req.get_header("Range");
+    std::string_view ifRange = req.get_header("If-Range");
+    if (!rangeHeader.empty() && (ifRange.empty() || ifRange == etag)) {
+        range = parseRange(rangeHeader, size, first, last);
+    }
+
+    if (range == RangeResult::Unsatisfiable) {
+        plan.early = std::make_shared<string_response>("", 416, contentType);
+        plan.early->with_header("Content-Range", "bytes */" + std::to_string(size));
+    } else if (range == RangeResult::Partial) {
+        plan.code = 206;
+        plan.first = first;
+        plan.length = last - first + 1;
+        plan.contentRange = "bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + std::to_string(size);
+    }
+    return plan;
+}
+
+static void decorate(http_response& response, const ServePlan& plan, const std::string& etag) {
+    if (!plan.contentRange.empty()) response.with_header("Content-Range", plan.contentRange);
+    response.with_header("ETag", etag);
+    response.with_header("Accept-Ranges", "bytes");
+}
+
+std::shared_ptr<http_response> serveFile(const http_request& req, const std::string& path, const std::string& contentType) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::make_shared<string_response>("File not found", 404, "text/plain");
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return std::make_shared<string_response>("File not found", 404, "text/plain");
+    }
+
+    std::string etag = fileETag(st);
+    ServePlan plan = planResponse(req, static_cast<uint64_t>(st.st_size), etag, contentType);
+    if (plan.early) {
+        close(fd);
+        return plan.early;
+    }
+
+    auto response = std::make_shared<ranged_file_response>(fd, plan.first, plan.length, plan.code, contentType);
+    decorate(*response, plan, etag);
+    return response;
+}
+
+std::shared_ptr<http_response> serveBuffer(const http_request& req, std::shared_ptr<const std::string> body, const std::string& etag, const std::string& contentType) {
+    ServePlan plan = planResponse(req, body->size(), etag, contentType);
+    if (plan.early) return plan.early;
+
+    auto response = std::make_shared<shared_buffer_response>(std::move(body), plan.first, plan.length, plan.code, contentType);
+    decorate(*response, plan, etag);
+    return response;
+}
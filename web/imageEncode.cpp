@@ -0,0 +1,235 @@
+#include "../include/imageEncode.h"
+#include "../include/pngStripe.h"
+#include "../include/imgBPCSEmbed.h"
+#include "../include/workerPool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <cerrno>
+#include <zlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static_assert(sizeof(RGB) == 3, "PNG rows are written straight from the pixel buffer");
+
+bool parseOutputFormat(std::string_view name, OutputFormat& format) {
+    if (name.empty()) return true;
+    if (name == "bmp") {
+        format = OutputFormat::BMP;
+        return true;
+    }
+    if (name == "png") {
+        format = OutputFormat::PNG;
+        return true;
+    }
+    return false;
+}
+
+const char* outputContentType(OutputFormat format) {
+    return format == OutputFormat::PNG ? "image/png" : "image/bmp";
+}
+
+std::string resultName(const std::string& fileId, OutputFormat format) {
+    return format == OutputFormat::PNG ? fileId + ".png" : fileId;
+}
+
+std::string encodePNG(const std::vector<RGB>& pixels, int width, int height, int level, WorkerPool* pool) {
+    if (width <= 0 || height <= 0 || pixels.size() < static_cast<size_t>(width) * height) {
+        throw std::runtime_error("Invalid image for PNG encoding");
+    }
+    level = std::clamp(level, 0, 9);
+
+    std::vector<const uint8_t*> rows(static_cast<size_t>(height));
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(pixels.data());
+    for (int y = 0; y < height; ++y) rows[static_cast<size_t>(y)] = base + static_cast<size_t>(y) * width * 3;
+
+    int stripeRows = pngStripeRows(width, 3);
+    int stripes = (height + stripeRows - 1) / stripeRows;
+
+    std::vector<PngStripe> encoded(static_cast<size_t>(stripes));
+    auto encode = [&rows, &encoded, width, height, stripeRows, stripes, level](int s) {
+        int y0 = s * stripeRows;
+        int y1 = std::min(height, y0 + stripeRows);
+        if (!encodePngStripe(rows.data(), width, 3, false, y0, y1, level, s == stripes - 1, encoded[static_cast<size_t>(s)])) {
+            throw std::runtime_error("Failed to encode PNG");
+        }
+    };
+    if (pool && stripes > 1) {
+        std::vector<std::future<void>> pending;
+        pending.reserve(static_cast<size_t>(stripes));
+        for (int s = 0; s < stripes; ++s) {
+            pending.push_back(pool->submit([&encode, s] { encode(s); }));
+        }
+        // Drain every future before rethrowing: the tasks borrow `rows` and `encoded`
+        std::exception_ptr failure;
+        for (auto& task : pending) {
+            try {
+                task.get();
+            } catch (...) {
+                if (!failure) failure = std::current_exception();
+            }
+        }
+        if (failure) std::rethrow_exception(failure);
+    } else {
+        for (int s = 0; s < stripes; ++s) encode(s);
+    }
+    finishPngStripes(encoded);
+
+    size_t total = 0;
+    for (const auto& stripe : encoded) total += stripe.deflated.size();
+
+    // One IDAT per stripe keeps every chunk small
+    std::string png;
+    png.reserve(8 + 25 + total + 12 * encoded.size() + 12);
+    appendPngHeader(png, width, height, 3);
+    for (const auto& stripe : encoded) appendPngChunk(png, "IDAT", stripe.deflated.data(), stripe.deflated.size());
+    appendPngChunk(png, "IEND", nullptr, 0);
+    return png;
+}
+
+std::string encodeImage(const std::vector<RGB>& pixels, int width, int height, const OutputOptions& options) {
+    if (options.format == OutputFormat::PNG) {
+        return encodePNG(pixels, width, height, options.level, options.encoders);
+    }
+    return encodeBMP(pixels, width, height);
+}
+
+// Encoded bytes are gathered up to this much before each write
+static const size_t WRITE_BUFFER_BYTES = 1024 * 1024;
+// Deflate output per IDAT chunk
+static const size_t IDAT_BYTES = 256 * 1024;
+
+RowEncoder::RowEncoder(const std::string& path, int width, int height, const OutputOptions& options)
+    : format(options.format), width(width), height(height), io(options.io) {
+    if (width <= 0 || height <= 0) throw std::runtime_error("Invalid image for encoding");
+    std::memset(&zs, 0, sizeof(zs));
+
+    if (format == OutputFormat::BMP) {
+        rowSize = (static_cast<size_t>(width) * 3 + 3) & ~static_cast<size_t>(3);
+        uint64_t headerSize = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader);
+        uint64_t fileSize = headerSize + static_cast<uint64_t>(rowSize) * height;
+        // The BMP header can't describe a file past 4 GiB
+        if (fileSize > UINT32_MAX) throw std::runtime_error("Result too large for BMP; use format=png");
+
+        BMPFileHeader fileHeader;
+        fileHeader.fileSize = static_cast<uint32_t>(fileSize);
+        fileHeader.offsetData = static_cast<uint32_t>(headerSize);
+        BMPInfoHeader infoHeader;
+        infoHeader.width = width;
+        infoHeader.height = -height;
+        buffer.append(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+        buffer.append(reinterpret_cast<const char*>(&infoHeader), sizeof(infoHeader));
+    } else {
+        rowSize = static_cast<size_t>(width) * 3;
+        if (deflateInit2(&zs, std::clamp(options.level, 0, 9), Z_DEFLATED, 15, 8, Z_FILTERED) != Z_OK) {
+            throw std::runtime_error("Failed to initialise PNG encoder");
+        }
+        deflating = true;
+        previous.resize(rowSize);
+        filtered.resize(rowSize + 1);
+        idat.resize(IDAT_BYTES);
+        zs.next_out = idat.data();
+        zs.avail_out = static_cast<uInt>(idat.size());
+
+        appendPngHeader(buffer, width, height, 3);
+    }
+
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        if (deflating) deflateEnd(&zs);
+        throw std::runtime_error("Failed to create result file");
+    }
+}
+
+RowEncoder::~RowEncoder() {
+    // The write in flight borrows `writing` and `fd`
+    pending = PendingWrite();
+    if (deflating) deflateEnd(&zs);
+    if (fd >= 0) close(fd);
+}
+
+void RowEncoder::writeRows(const RGB* rows, int count) {
+    if (count > height - rowsWritten) throw std::runtime_error("Wrote past the end of the image");
+
+    for (int i = 0; i < count; ++i, ++rowsWritten) {
+        const RGB* src = rows + static_cast<size_t>(i) * width;
+        if (format == OutputFormat::BMP) {
+            size_t start = buffer.size();
+            buffer.resize(start + rowSize, '\0');
+            uint8_t* row = reinterpret_cast<uint8_t*>(&buffer[start]);
+            for (int x = 0; x < width; ++x) {
+                row[x * 3 + 0] = src[x].b;
+                row[x * 3 + 1] = src[x].g;
+                row[x * 3 + 2] = src[x].r;
+            }
+        } else {
+            const uint8_t* row = reinterpret_cast<const uint8_t*>(src);
+            pngFilterRow(row, rowsWritten > 0 ? previous.data() : nullptr, rowSize, 3, filtered.data(), scratch);
+            std::memcpy(previous.data(), row, rowSize);
+            deflateInput(filtered.data(), filtered.size(), Z_NO_FLUSH);
+        }
+        if (buffer.size() >= WRITE_BUFFER_BYTES) flush();
+    }
+}
+
+void RowEncoder::finish() {
+    if (rowsWritten != height) throw std::runtime_error("Image incomplete");
+    if (format == OutputFormat::PNG) {
+        deflateInput(nullptr, 0, Z_FINISH);
+        emitIDAT();
+        appendPngChunk(buffer, "IEND", nullptr, 0);
+    }
+    flush();
+    if (pending.wait() != 0) throw std::runtime_error("Failed to write result file");
+    int rc = close(fd);
+    fd = -1;
+    if (rc != 0) throw std::runtime_error("Failed to write result file");
+}
+
+void RowEncoder::deflateInput(const uint8_t* data, size_t size, int flush) {
+    zs.next_in = const_cast<Bytef*>(data);
+    zs.avail_in = static_cast<uInt>(size);
+    for (;;) {
+        int rc = deflate(&zs, flush);
+        if (rc == Z_STREAM_ERROR) throw std::runtime_error("Failed to encode PNG");
+        if (zs.avail_out == 0) {
+            emitIDAT();
+            continue;
+        }
+        if (flush == Z_FINISH ? rc == Z_STREAM_END : zs.avail_in == 0) break;
+    }
+}
+
+void RowEncoder::emitIDAT() {
+    size_t produced = idat.size() - zs.avail_out;
+    if (produced == 0) return;
+    appendPngChunk(buffer, "IDAT", idat.data(), produced);
+    zs.next_out = idat.data();
+    zs.avail_out = static_cast<uInt>(idat.size());
+}
+
+void RowEncoder::flush() {
+    if (io) {
+        // Only one buffer is in flight: wait for it before handing over the next
+        if (pending.wait() != 0) throw std::runtime_error("Failed to write result file");
+        std::swap(buffer, writing);
+        buffer.clear();
+        pending = io->writeAt(fd, writing.data(), writing.size(), bytesOut);
+        bytesOut += writing.size();
+        return;
+    }
+
+    const char* p = buffer.data();
+    size_t remaining = buffer.size();
+    while (remaining > 0) {
+        ssize_t n = write(fd, p, remaining);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) throw std::runtime_error("Failed to write result file");
+        p += n;
+        remaining -= static_cast<size_t>(n);
+    }
+    bytesOut += buffer.size();
+    buffer.clear();
+}
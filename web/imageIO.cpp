@@ -0,0 +1,459 @@
+#include "../include/imageIO.h"
+#include "../include/requestArena.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "../include/stb_image.h"
+#include <vector>
+#include <climits>
+#include <cstring>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <atomic>
+#include <zlib.h>
+#ifdef STEGONINJA_JPEG_TURBO
+#include <csetjmp>
+#include <cstdio>
+#include <jpeglib.h>
+#endif
+
+// Where the rows of an uncompressed 24-bit BMP sit in the upload
+struct BMP24Layout {
+    int width;
+    int height;
+    size_t rowSize;
+    const uint8_t* pixels;
+    bool bottomUp;
+
+    const uint8_t* row(int y) const {
+        return pixels + rowSize * static_cast<size_t>(bottomUp ? height - 1 - y : y);
+    }
+};
+
+// False for any other BMP flavour so stb can take it; throws when the header is broken
+static bool parseBMP24(const uint8_t* data, size_t length, BMP24Layout& layout) {
+    BMPFileHeader fileHeader;
+    BMPInfoHeader infoHeader;
+    if (length < sizeof(fileHeader) + sizeof(infoHeader)) return false;
+    std::memcpy(&fileHeader, data, sizeof(fileHeader));
+    std::memcpy(&infoHeader, data + sizeof(fileHeader), sizeof(infoHeader));
+
+    if (fileHeader.fileType != 0x4D42 || infoHeader.headerSize < 40 || infoHeader.planes != 1 ||
+        infoHeader.bitCount != 24 || infoHeader.compression != 0) {
+        return false;
+    }
+    if (infoHeader.width <= 0 || infoHeader.height == 0 || infoHeader.height == INT32_MIN ||
+        infoHeader.width > (1 << 24) || std::abs(infoHeader.height) > (1 << 24)) {
+        throw std::runtime_error("Invalid BMP dimensions");
+    }
+
+    layout.width = infoHeader.width;
+    layout.height = std::abs(infoHeader.height);
+    layout.rowSize = (static_cast<size_t>(layout.width) * 3 + 3) & ~static_cast<size_t>(3);
+    if (fileHeader.offsetData > length || layout.rowSize * layout.height > length - fileHeader.offsetData) {
+        throw std::runtime_error("BMP data truncated");
+    }
+    layout.pixels = data + fileHeader.offsetData;
+    layout.bottomUp = infoHeader.height > 0;
+    return true;
+}
+
+static void convertBGRRow(const uint8_t* row, RGB* out, int width) {
+    for (int x = 0; x < width; ++x) {
+        out[x].r = row[x * 3 + 2];
+        out[x].g = row[x * 3 + 1];
+        out[x].b = row[x * 3 + 0];
+    }
+}
+
+// Uncompressed 24-bit BMP, the format results are served in, decoded straight into the
+// pooled buffer. Returns false for any other BMP flavour so stb can take it.
+static bool decodeBMP24(const uint8_t* data, size_t length, int& width, int& height, std::vector<RGB>& pixels) {
+    BMP24Layout layout;
+    if (!parseBMP24(data, length, layout)) return false;
+
+    width = layout.width;
+    height = layout.height;
+    pixels = acquirePixels(static_cast<size_t>(width) * height);
+    for (int y = 0; y < height; ++y) {
+        convertBGRRow(layout.row(y), pixels.data() + static_cast<size_t>(y) * width, width);
+    }
+    return true;
+}
+
+#ifdef STEGONINJA_JPEG_TURBO
+static bool isJPEG(const uint8_t* data, size_t length) {
+    return length >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+}
+
+// libjpeg reports fatal errors through error_exit, which must not return. It jumps back into
+// whichever decoder call started the failing libjpeg call, and that call throws.
+struct JPEGErrorManager {
+    jpeg_error_mgr base;
+    std::jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+};
+
+static void jpegErrorExit(j_common_ptr cinfo) {
+    JPEGErrorManager* err = reinterpret_cast<JPEGErrorManager*>(cinfo->err);
+    (*cinfo->err->format_message)(cinfo, err->message);
+    std::longjmp(err->jump, 1);
+}
+
+// Warnings (a truncated scan, say) are not worth a line on stderr per request
+static void jpegQuiet(j_common_ptr) {}
+
+// Baseline and progressive JPEG through libjpeg-turbo, whose IDCT, upsampling and colour
+// conversion are SIMD. Scanlines are decoded straight into the caller's rows as RGB.
+class JPEGRowDecoder : public RowDecoder {
+public:
+    JPEGRowDecoder(const uint8_t* data, size_t length) : data(data), length(length) {
+        std::memset(&cinfo, 0, sizeof(cinfo));
+        cinfo.err = jpeg_std_error(&err.base);
+        err.base.error_exit = jpegErrorExit;
+        err.base.output_message = jpegQuiet;
+        err.message[0] = '\0';
+    }
+
+    ~JPEGRowDecoder() override {
+        if (created) jpeg_destroy_decompress(&cinfo);
+    }
+
+    void open() {
+        if (setjmp(err.jump)) fail();
+        jpeg_create_decompress(&cinfo);
+        created = true;
+        jpeg_mem_src(&cinfo, data, static_cast<unsigned long>(length));
+        jpeg_read_header(&cinfo, TRUE);
+        cinfo.out_color_space = JCS_RGB;
+        jpeg_start_decompress(&cinfo);
+
+        if (cinfo.output_components != 3 || cinfo.output_width == 0 || cinfo.output_height == 0 ||
+            cinfo.output_width > (1u << 24) || cinfo.output_height > (1u << 24)) {
+            throw std::runtime_error("Unsupported JPEG");
+        }
+        imageWidth = static_cast<int>(cinfo.output_width);
+        imageHeight = static_cast<int>(cinfo.output_height);
+    }
+
+    void readRows(RGB* out, int count) override {
+        if (count > imageHeight - static_cast<int>(cinfo.output_scanline)) throw std::runtime_error("Read past the end of the image");
+        if (setjmp(err.jump)) fail();
+        for (int i = 0; i < count; ++i) {
+            JSAMPROW row = reinterpret_cast<JSAMPROW>(out + static_cast<size_t>(i) * imageWidth);
+            if (jpeg_read_scanlines(&cinfo, &row, 1) != 1) throw std::runtime_error("JPEG data truncated");
+        }
+    }
+
+private:
+    [[noreturn]] void fail() {
+        throw std::runtime_error(std::string("Failed to decode JPEG: ") + err.message);
+    }
+
+    const uint8_t* data;
+    size_t length;
+    jpeg_decompress_struct cinfo;
+    JPEGErrorManager err;
+    bool created = false;
+};
+#endif
+
+const char* jpegDecoderName() {
+#ifdef STEGONINJA_JPEG_TURBO
+    return "libjpeg-turbo";
+#else
+    return "stb_image";
+#endif
+}
+
+std::vector<RGB> decodeImage(const uint8_t* data, size_t length, int& width, int& height, ImageDecoder decoder) {
+    // Larger images go through a RowDecoder or not at all
+    if (exceedsStreamThreshold(data, length)) {
+        throw std::runtime_error("Image too large to decode in memory");
+    }
+
+    std::vector<RGB> pixels;
+    if (decoder == ImageDecoder::Auto && decodeBMP24(data, length, width, height, pixels)) {
+        return pixels;
+    }
+
+#ifdef STEGONINJA_JPEG_TURBO
+    // Anything libjpeg-turbo rejects (CMYK, say) still gets a try from stb below
+    if (decoder == ImageDecoder::Auto && isJPEG(data, length)) {
+        try {
+            JPEGRowDecoder jpeg(data, length);
+            jpeg.open();
+            pixels = acquirePixels(static_cast<size_t>(jpeg.width()) * jpeg.height());
+            jpeg.readRows(pixels.data(), jpeg.height());
+            width = jpeg.width();
+            height = jpeg.height();
+            return pixels;
+        } catch (const std::exception&) {
+            releasePixels(std::move(pixels));
+            pixels.clear();
+        }
+    }
+#endif
+
+    if (length > static_cast<size_t>(INT_MAX)) {
+        throw std::runtime_error("Image too large");
+    }
+
+    // Ask stb for three channels so alpha is dropped and grey is expanded during decode
+    int channels;
+    std::unique_ptr<unsigned char, void (*)(void*)> imageData(
+        stbi_load_from_memory(data, static_cast<int>(length), &width, &height, &channels, 3), stbi_image_free);
+    if (!imageData) {
+        throw std::runtime_error("Failed to decode image");
+    }
+
+    pixels = acquirePixels(static_cast<size_t>(width) * height);
+    std::memcpy(pixels.data(), imageData.get(), pixels.size() * sizeof(RGB));
+    return pixels;
+}
+
+bool imageDimensions(const uint8_t* data, size_t length, int& width, int& height) {
+    if (length > static_cast<size_t>(INT_MAX)) return false;
+
+    int channels;
+    if (stbi_info_from_memory(data, static_cast<int>(length), &width, &height, &channels) != 1) return false;
+
+    // stb reports a top-down BMP with its negative header height
+    height = std::abs(height);
+    return width > 0 && height > 0;
+}
+
+
+static std::atomic<uint64_t> streamThreshold{64ull * 1000 * 1000};
+
+void setStreamThreshold(uint64_t pixels) {
+    streamThreshold.store(pixels, std::memory_order_relaxed);
+}
+
+bool exceedsStreamThreshold(const uint8_t* data, size_t length) {
+    int width, height;
+    if (!imageDimensions(data, length, width, height)) return false;
+    return static_cast<uint64_t>(width) * static_cast<uint64_t>(height) > streamThreshold.load(std::memory_order_relaxed);
+}
+
+class BMPRowDecoder : public RowDecoder {
+public:
+    explicit BMPRowDecoder(const BMP24Layout& layout) : layout(layout) {
+        imageWidth = layout.width;
+        imageHeight = layout.height;
+    }
+
+    void readRows(RGB* out, int count) override {
+        if (count > imageHeight - nextRow) throw std::runtime_error("Read past the end of the image");
+        for (int i = 0; i < count; ++i, ++nextRow) {
+            convertBGRRow(layout.row(nextRow), out + static_cast<size_t>(i) * imageWidth, imageWidth);
+        }
+    }
+
+private:
+    BMP24Layout layout;
+    int nextRow = 0;
+};
+
+static const uint8_t PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+static uint32_t readU32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 8 | p[3];
+}
+
+static inline uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return static_cast<uint8_t>(a);
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+// Non-interlaced 8-bit PNG, inflated one scanline at a time from the IDAT chunks in place.
+// Alpha is dropped and grey or palette samples expanded, as stb does for three channels.
+class PNGRowDecoder : public RowDecoder {
+public:
+    PNGRowDecoder(const uint8_t* data, size_t length) : data(data), length(length) {
+        std::memset(&zs, 0, sizeof(zs));
+    }
+
+    ~PNGRowDecoder() override {
+        if (inflating) inflateEnd(&zs);
+    }
+
+    // False when the image is a PNG this decoder doesn't handle; throws when it is corrupt
+    bool open() {
+        if (length < sizeof(PNG_SIGNATURE) || std::memcmp(data, PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) != 0) return false;
+        pos = sizeof(PNG_SIGNATURE);
+
+        const uint8_t* chunk;
+        uint32_t chunkLength;
+        if (!nextChunk(chunk, chunkLength) || std::memcmp(chunk - 4, "IHDR", 4) != 0 || chunkLength < 13) {
+            throw std::runtime_error("Invalid PNG header");
+        }
+        uint32_t w = readU32(chunk), h = readU32(chunk + 4);
+        uint8_t bitDepth = chunk[8], colorType = chunk[9], interlace = chunk[12];
+        if (w == 0 || h == 0 || w > (1u << 24) || h > (1u << 30)) throw std::runtime_error("Invalid PNG dimensions");
+        if (bitDepth != 8 || interlace != 0) return false;
+
+        switch (colorType) {
+            case 0: channels = 1; break;
+            case 2: channels = 3; break;
+            case 3: channels = 1; break;
+            case 4: channels = 2; break;
+            case 6: channels = 4; break;
+            default: throw std::runtime_error("Invalid PNG colour type");
+        }
+        paletted = colorType == 3;
+        imageWidth = static_cast<int>(w);
+        imageHeight = static_cast<int>(h);
+        rowBytes = static_cast<size_t>(w) * channels;
+
+        // Everything up to the first IDAT; only the palette matters here
+        while (nextChunk(chunk, chunkLength)) {
+            if (std::memcmp(chunk - 4, "PLTE", 4) == 0) {
+                palette.assign(chunk, chunk + std::min<uint32_t>(chunkLength, 768));
+            } else if (std::memcmp(chunk - 4, "IDAT", 4) == 0) {
+                zs.next_in = const_cast<Bytef*>(chunk);
+                zs.avail_in = chunkLength;
+                break;
+            }
+        }
+        if (zs.next_in == nullptr) throw std::runtime_error("PNG has no image data");
+        if (paletted && palette.empty()) throw std::runtime_error("PNG palette missing");
+        palette.resize(768, 0);
+
+        if (inflateInit(&zs) != Z_OK) throw std::runtime_error("Failed to initialise PNG decoder");
+        inflating = true;
+        current.resize(rowBytes + 1);
+        previous.assign(rowBytes, 0);
+        return true;
+    }
+
+    void readRows(RGB* out, int count) override {
+        if (count > imageHeight - nextRow) throw std::runtime_error("Read past the end of the image");
+        for (int i = 0; i < count; ++i, ++nextRow) {
+            inflateRow();
+            unfilter();
+            convert(out + static_cast<size_t>(i) * imageWidth);
+            std::memcpy(previous.data(), current.data() + 1, rowBytes);
+        }
+    }
+
+private:
+    // Steps over the next chunk; `chunk` points at its payload, just past the type
+    bool nextChunk(const uint8_t*& chunk, uint32_t& chunkLength) {
+        if (length - pos < 12) return false;
+        chunkLength = readU32(data + pos);
+        if (chunkLength > length - pos - 12) throw std::runtime_error("PNG data truncated");
+        chunk = data + pos + 8;
+        pos += 12 + static_cast<size_t>(chunkLength);
+        return true;
+    }
+
+    // The zlib stream may be split over any number of consecutive IDAT chunks
+    bool nextIDAT() {
+        const uint8_t* chunk;
+        uint32_t chunkLength;
+        while (nextChunk(chunk, chunkLength)) {
+            if (std::memcmp(chunk - 4, "IDAT", 4) == 0) {
+                zs.next_in = const_cast<Bytef*>(chunk);
+                zs.avail_in = chunkLength;
+                return true;
+            }
+            if (std::memcmp(chunk - 4, "IEND", 4) == 0) return false;
+        }
+        return false;
+    }
+
+    void inflateRow() {
+        zs.next_out = current.data();
+        zs.avail_out = static_cast<uInt>(current.size());
+        while (zs.avail_out > 0) {
+            if (zs.avail_in == 0 && !nextIDAT()) throw std::runtime_error("PNG data truncated");
+            int rc = inflate(&zs, Z_NO_FLUSH);
+            if (rc == Z_STREAM_END) {
+                if (zs.avail_out > 0) throw std::runtime_error("PNG data truncated");
+                break;
+            }
+            if (rc != Z_OK && rc != Z_BUF_ERROR) throw std::runtime_error("Failed to decode PNG");
+        }
+    }
+
+    void unfilter() {
+        uint8_t filter = current[0];
+        uint8_t* row = current.data() + 1;
+        const uint8_t* prev = previous.data();
+        size_t bpp = channels;
+        switch (filter) {
+            case 0:
+                break;
+            case 1:
+                for (size_t i = bpp; i < rowBytes; ++i) row[i] = static_cast<uint8_t>(row[i] + row[i - bpp]);
+                break;
+            case 2:
+                for (size_t i = 0; i < rowBytes; ++i) row[i] = static_cast<uint8_t>(row[i] + prev[i]);
+                break;
+            case 3:
+                for (size_t i = 0; i < rowBytes; ++i) {
+                    int left = i >= bpp ? row[i - bpp] : 0;
+                    row[i] = static_cast<uint8_t>(row[i] + ((left + prev[i]) >> 1));
+                }
+                break;
+            case 4:
+                for (size_t i = 0; i < rowBytes; ++i) {
+                    int left = i >= bpp ? row[i - bpp] : 0;
+                    int diag = i >= bpp ? prev[i - bpp] : 0;
+                    row[i] = static_cast<uint8_t>(row[i] + paeth(left, prev[i], diag));
+                }
+                break;
+            default:
+                throw std::runtime_error("Invalid PNG filter");
+        }
+    }
+
+    void convert(RGB* out) {
+        const uint8_t* row = current.data() + 1;
+        for (int x = 0; x < imageWidth; ++x) {
+            const uint8_t* sample = row + static_cast<size_t>(x) * channels;
+            if (paletted) {
+                const uint8_t* entry = palette.data() + sample[0] * 3;
+                out[x] = {entry[0], entry[1], entry[2]};
+            } else if (channels >= 3) {
+                out[x] = {sample[0], sample[1], sample[2]};
+            } else {
+                out[x] = {sample[0], sample[0], sample[0]};
+            }
+        }
+    }
+
+    const uint8_t* data;
+    size_t length;
+    size_t pos = 0;
+    z_stream zs;
+    bool inflating = false;
+    int channels = 3;
+    bool paletted = false;
+    size_t rowBytes = 0;
+    std::vector<uint8_t> palette;
+    std::vector<uint8_t> current;
+    std::vector<uint8_t> previous;
+    int nextRow = 0;
+};
+
+std::unique_ptr<RowDecoder> openRowDecoder(const uint8_t* data, size_t length) {
+    BMP24Layout layout;
+    if (parseBMP24(data, length, layout)) {
+        return std::make_unique<BMPRowDecoder>(layout);
+    }
+
+    auto png = std::make_unique<PNGRowDecoder>(data, length);
+    if (png->open()) return png;
+
+#ifdef STEGONINJA_JPEG_TURBO
+    if (isJPEG(data, length)) {
+        auto jpeg = std::make_unique<JPEGRowDecoder>(data, length);
+        jpeg->open();
+        return jpeg;
+    }
+#endif
+    return nullptr;
+}
@@ -8,9 +8,16 @@
 #include <filesystem>
 #include <cmath>
 #include <stdexcept>
+#include <cstring>
 
 #include "../include/BMPstruct.h"
 #include "../include/imgBPCSEmbed.h"
+#include "../include/resultStore.h"
+#include "../include/coverCache.h"
+#include "../include/metrics.h"
+#include "../include/jobs.h"
+#include "../include/imageEncode.h"
+#include "../include/requestArena.h"
 
 // std::vector<RGB> readBMP(const std::string& filename, int& width, int& height) {
 //     std::ifstream file(filename, std::ios::binary);
@@ -53,230 +60,191 @@
 //     return pixels;
 // }
 
-void writeBMP(const std::string& filename, const std::vector<RGB>& pixels, int width, int height) {
-    std::ofstream file(filename, std::ios::binary);
-    if (!file) throw std::runtime_error("Failed to create BMP file");
-
+std::string encodeBMP(const std::vector<RGB>& pixels, int width, int height) {
     int rowSize = (width * 3 + 3) & ~3;
-    int dataSize = rowSize * height;
-    int fileSize = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader) + dataSize;
+    size_t dataSize = static_cast<size_t>(rowSize) * height;
+    size_t headerSize = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader);
 
     BMPFileHeader fileHeader;
-    fileHeader.fileSize = fileSize;
-    fileHeader.offsetData = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader);
+    fileHeader.fileSize = headerSize + dataSize;
+    fileHeader.offsetData = headerSize;
 
     BMPInfoHeader infoHeader;
     infoHeader.width = width;
     infoHeader.height = -height;
 
-    file.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
-    file.write(reinterpret_cast<const char*>(&infoHeader), sizeof(infoHeader));
+    // Padding bytes stay zero from the initial fill
+    std::string bmp(headerSize + dataSize, '\0');
+    std::memcpy(&bmp[0], &fileHeader, sizeof(fileHeader));
+    std::memcpy(&bmp[sizeof(fileHeader)], &infoHeader, sizeof(infoHeader));
 
-    std::vector<uint8_t> row(rowSize);
-    
     for (int y = 0; y < height; ++y) {
-        const RGB* srcRow = pixels.data() + y * width;
-        
+        const RGB* srcRow = pixels.data() + static_cast<size_t>(y) * width;
+        uint8_t* row = reinterpret_cast<uint8_t*>(&bmp[headerSize + static_cast<size_t>(y) * rowSize]);
+
         for (int x = 0; x < width; ++x) {
             row[x * 3 + 0] = srcRow[x].b;
             row[x * 3 + 1] = srcRow[x].g;
             row[x * 3 + 2] = srcRow[x].r;
         }
-        
-        std::fill(row.begin() + width * 3, row.end(), 0);
-        file.write(reinterpret_cast<const char*>(row.data()), rowSize);
     }
-}
 
-std::vector<uint8_t> readSecretFile(const std::string& filename) {
-    std::ifstream file(filename, std::ios::binary | std::ios::ate);
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
-    
-    std::vector<uint8_t> buffer(size);
-    if (!file.read(reinterpret_cast<char*>(buffer.data()), size)) {
-        throw std::runtime_error("Failed to read secret file");
-    }
-    
-    return buffer;
+    return bmp;
 }
 
-std::vector<uint8_t> vigenereEncrypt(const std::vector<uint8_t>& data, const std::string& key) {
-    std::vector<uint8_t> result(data.size());
-    for (size_t i = 0; i < data.size(); ++i) {
-        uint8_t keyByte = key.empty() ? 0 : key[i % key.size()];
-        result[i] = (data[i] + keyByte) % 256;
+std::pmr::vector<uint8_t> buildPayload(const uint8_t* secretData, size_t secretSize, const std::string& secretFilename, const std::string& password, bool encrypt) {
+    std::pmr::vector<uint8_t> dataToEmbed(requestMemory());
+    dataToEmbed.reserve(1 + secretFilename.size() + 4 + secretSize);
+
+    // Add filename
+    if (secretFilename.size() > 255) {
+        throw std::runtime_error("Filename exceeds maximum length of 255 characters");
     }
-    return result;
+    uint8_t filenameLength = static_cast<uint8_t>(secretFilename.size());
+    dataToEmbed.push_back(filenameLength); // Store as single byte
+    dataToEmbed.insert(dataToEmbed.end(), secretFilename.begin(), secretFilename.end());
+
+    // Add secret data length and data
+    uint32_t secretLength = secretSize;
+    dataToEmbed.insert(dataToEmbed.end(), reinterpret_cast<uint8_t*>(&secretLength), 
+                    reinterpret_cast<uint8_t*>(&secretLength) + 4);
+    dataToEmbed.insert(dataToEmbed.end(), secretData, secretData + secretSize);
+
+    // Encrypt if needed, in place: Vigenere over bytes, adding the password byte mod 256
+    if (encrypt && !password.empty()) {
+        for (size_t i = 0; i < dataToEmbed.size(); ++i) {
+            dataToEmbed[i] = static_cast<uint8_t>(dataToEmbed[i] + static_cast<uint8_t>(password[i % password.size()]));
+        }
+    }
+    return dataToEmbed;
 }
 
-std::tuple<std::string, int> imgBPCSEmbed(const std::string& fileId, const std::string& coverFilename, const std::string& secretFilename, const std::string& password, bool encrypt, bool randomize) {
-    try {
-        std::string coverFile = "/app/uploads/" + fileId;
-        std::string secretFile = "/app/secrets/" + fileId;
-        std::string outputFile = "/app/results/" + fileId;
-
-        // Get secret filename
-        // std::string secretFilename = std::filesystem::path(secretFile).filename().string();
+BPCSEmbedResult bpcsEmbed(const CoverEntry& cover, const uint8_t* secretData, size_t secretSize, const std::string& secretFilename, const std::string& password, bool encrypt, bool randomize) {
+    BPCSEmbedResult result;
 
-        int width, height;
-        std::vector<RGB> originalPixels = readBMP(coverFile, width, height);
-        std::vector<RGB> pixels = originalPixels; // Working copy for modification
+    int width = cover.width, height = cover.height;
+    const std::vector<RGB>& originalPixels = cover.pixels;
 
-        std::vector<uint8_t> secretData = readSecretFile(secretFile);
+    // Prepare data to embed
+    std::pmr::vector<uint8_t> dataToEmbed = buildPayload(secretData, secretSize, secretFilename, password, encrypt);
 
-        // Prompt for password
-        // std::string password;
-        // std::cout << "Enter password (leave blank for no encryption/randomization): ";
-        // std::getline(std::cin, password);
-        // bool useEncryption = !password.empty();
-        // bool useRandomization = !password.empty();
+    // Eligible blocks come from the cached complexity scan of the cover
+    std::pmr::vector<BlockPosition> shuffledBlocks(requestMemory());
+    const BlockPosition* blocks = cover.eligibleBlocks.data();
+    size_t blockTotal = cover.eligibleBlocks.size();
 
-        // Prepare data to embed
-        std::vector<uint8_t> dataToEmbed;
-
-        // Add filename
-        if (secretFilename.size() > 255) {
-            throw std::runtime_error("Filename exceeds maximum length of 255 characters");
-        }
-        uint8_t filenameLength = static_cast<uint8_t>(secretFilename.size());
-        dataToEmbed.push_back(filenameLength); // Store as single byte
-        dataToEmbed.insert(dataToEmbed.end(), secretFilename.begin(), secretFilename.end());
-
-        // Add secret data length and data
-        uint32_t secretLength = secretData.size();
-        dataToEmbed.insert(dataToEmbed.end(), reinterpret_cast<uint8_t*>(&secretLength), 
-                        reinterpret_cast<uint8_t*>(&secretLength) + 4);
-        dataToEmbed.insert(dataToEmbed.end(), secretData.begin(), secretData.end());
-
-        // Encrypt if needed
-        if (encrypt) {
-            dataToEmbed = vigenereEncrypt(dataToEmbed, password);
-        }
-
-        // Convert to bitstream
-        std::vector<bool> secretBitstream;
-        for (uint8_t byte : dataToEmbed) {
-            for (int i = 7; i >= 0; --i) {
-                secretBitstream.push_back((byte >> i) & 1);
-            }
-        }
+    // Check capacity
+    size_t availableBits = blockTotal * 64;
+    size_t requiredBits = dataToEmbed.size() * 8;
+    
+    if (requiredBits > availableBits) {
+        result.code = 400;
+        result.message = "{\"status\":\"error\",\"message\":\"Secret data too large. Maximum capacity: " + std::to_string(availableBits / 8) + " bytes\",\"data\":{\"maxCapacity\":\"" + std::to_string(availableBits / 8) + "\"}}";
+        return result;
+    }
 
-        // Collect eligible blocks
-        std::vector<BlockPosition> eligibleBlocks;
-        const int threshold = 34;
-
-        for (int channel = 0; channel < 3; ++channel) {
-            for (int bitPlane = 7; bitPlane >= 0; --bitPlane) {
-                for (int y = 0; y < height; y += 8) {
-                    for (int x = 0; x < width; x += 8) {
-                        std::vector<std::vector<bool>> block(8, std::vector<bool>(8));
-                        
-                        // Extract block bits
-                        for (int i = 0; i < 8; ++i) {
-                            for (int j = 0; j < 8; ++j) {
-                                int pixelIndex = (y + i) * width + (x + j);
-                                uint8_t value = (channel == 0) ? pixels[pixelIndex].r :
-                                                (channel == 1) ? pixels[pixelIndex].g : pixels[pixelIndex].b;
-                                block[i][j] = (value >> (7 - bitPlane)) & 1;
-                            }
-                        }
-
-                        // Calculate complexity
-                        int complexity = 0;
-                        for (int i = 0; i < 8; ++i) {
-                            for (int j = 0; j < 8; ++j) {
-                                if (j < 7 && block[i][j] != block[i][j + 1]) complexity++;
-                                if (i < 7 && block[i][j] != block[i + 1][j]) complexity++;
-                            }
-                        }
-
-                        if (complexity >= threshold) {
-                            eligibleBlocks.push_back({channel, bitPlane, x, y});
-                        }
-                    }
-                }
-            }
+    // Shuffle if needed
+    if (randomize) {
+        unsigned int seed = 0;
+        for (char c : password) {
+            seed += static_cast<unsigned int>(c);
         }
+        shuffledBlocks.assign(cover.eligibleBlocks.begin(), cover.eligibleBlocks.end());
+        std::shuffle(shuffledBlocks.begin(), shuffledBlocks.end(), std::default_random_engine(seed));
+        blocks = shuffledBlocks.data();
+    }
 
-        // Check capacity
-        size_t availableBits = eligibleBlocks.size() * 64;
-        size_t requiredBits = secretBitstream.size();
-        
-        if (requiredBits > availableBits) {
-            // throw std::runtime_error("Secret data too large. Maximum capacity: " + std::to_string(availableBits / 8) + " bytes");
-            return std::make_tuple("{\"status\":\"error\",\"message\":\"Secret data too large. Maximum capacity: " + std::to_string(availableBits / 8) + " bytes\",\"data\":{\"maxCapacity\":\"" + std::to_string(availableBits / 8) + "\"}}", 400);
-        }
+    // Working copy for modification, in a recycled buffer when one fits
+    std::vector<RGB>& pixels = result.pixels;
+    pixels = acquirePixels(originalPixels.size());
+    std::copy(originalPixels.begin(), originalPixels.end(), pixels.begin());
 
-        // Shuffle if needed
-        if (randomize) {
-            unsigned int seed = 0;
-            for (char c : password) {
-                seed += static_cast<unsigned int>(c);
-            }
-            std::shuffle(eligibleBlocks.begin(), eligibleBlocks.end(), std::default_random_engine(seed));
-        }
+    JobProgress* job = currentJob();
+    if (job) {
+        setJobPhase(job, JobPhase::Embedding);
+        job->bitsTotal.store(requiredBits, std::memory_order_relaxed);
+    }
 
-        // Embed data
+    // Embed data, MSB first, row by row within each block
+    {
+        StageTimer timer(Stage::Embed);
         size_t bitIndex = 0;
-        for (const auto& pos : eligibleBlocks) {
-            if (bitIndex >= secretBitstream.size()) break;
-
-            std::vector<std::vector<bool>> block(8, std::vector<bool>(8));
-            
-            // Extract current block bits
-            for (int i = 0; i < 8; ++i) {
-                for (int j = 0; j < 8; ++j) {
-                    int pixelIndex = (pos.y + i) * width + (pos.x + j);
-                    uint8_t value = (pos.channel == 0) ? pixels[pixelIndex].r :
-                                    (pos.channel == 1) ? pixels[pixelIndex].g : pixels[pixelIndex].b;
-                    block[i][j] = (value >> (7 - pos.bitPlane)) & 1;
-                }
-            }
-
-            // Replace bits with secret data
-            for (int i = 0; i < 8 && bitIndex < secretBitstream.size(); ++i) {
-                for (int j = 0; j < 8 && bitIndex < secretBitstream.size(); ++j) {
-                    block[i][j] = secretBitstream[bitIndex++];
-                }
+        size_t blockCount = 0;
+        for (const BlockPosition* it = blocks; it != blocks + blockTotal; ++it) {
+            const BlockPosition& pos = *it;
+            if (bitIndex >= requiredBits) break;
+            if (job && (blockCount++ & 255) == 0) {
+                checkCancelled(job);
+                job->bitsEmbedded.store(bitIndex, std::memory_order_relaxed);
             }
 
-            // Update pixels
-            for (int i = 0; i < 8; ++i) {
-                for (int j = 0; j < 8; ++j) {
+            int shift = 7 - pos.bitPlane;
+            for (int i = 0; i < 8 && bitIndex < requiredBits; ++i) {
+                for (int j = 0; j < 8 && bitIndex < requiredBits; ++j) {
                     int pixelIndex = (pos.y + i) * width + (pos.x + j);
                     uint8_t& value = (pos.channel == 0) ? pixels[pixelIndex].r :
                                     (pos.channel == 1) ? pixels[pixelIndex].g : pixels[pixelIndex].b;
-                    value &= ~(1 << (7 - pos.bitPlane));
-                    value |= (block[i][j] << (7 - pos.bitPlane));
+                    uint8_t bit = (dataToEmbed[bitIndex / 8] >> (7 - bitIndex % 8)) & 1;
+                    value = (value & ~(1 << shift)) | (bit << shift);
+                    ++bitIndex;
                 }
             }
         }
+        if (job) job->bitsEmbedded.store(bitIndex, std::memory_order_relaxed);
+    }
 
-        // Calculate PSNR
-        double sum = 0.0;
+    // Calculate PSNR
+    double sum = 0.0;
+    {
+        StageTimer timer(Stage::PSNR);
         for (size_t i = 0; i < pixels.size(); ++i) {
             sum += std::pow(originalPixels[i].r - pixels[i].r, 2);
             sum += std::pow(originalPixels[i].g - pixels[i].g, 2);
             sum += std::pow(originalPixels[i].b - pixels[i].b, 2);
         }
-        
-        double mse = sum / (3 * width * height);
-        double rms = std::sqrt(mse);
-        double psnr = 0.0;
-        
-        if (mse == 0) {
-            // std::cout << "PSNR: Infinite dB (no changes made)" << std::endl;
-            return std::make_tuple("{\"status\":\"error\",\"message\":\"PSNR: Infinite dB (no changes made)\",\"data\":{}}", 400);
-        } else {
-            psnr = 20 * std::log10(256.0 / rms);
-            // std::cout << "PSNR: " << psnr << " dB" << std::endl;
+    }
+    
+    double mse = sum / (3.0 * width * height);
+    double rms = std::sqrt(mse);
+    
+    if (mse == 0) {
+        result.code = 400;
+        result.message = "{\"status\":\"error\",\"message\":\"PSNR: Infinite dB (no changes made)\",\"data\":{}}";
+        releasePixels(std::move(result.pixels));
+        return result;
+    }
+    result.psnr = 20 * std::log10(256.0 / rms);
+    return result;
+}
+
+std::tuple<std::string, int> imgBPCSEmbed(const std::string& fileId, const CoverEntry& cover, const std::string& coverFilename, const uint8_t* secretData, size_t secretSize, const std::string& secretFilename, const std::string& password, bool encrypt, bool randomize, const OutputOptions& output, ResultStore& store) {
+    try {
+        BPCSEmbedResult result = bpcsEmbed(cover, secretData, secretSize, secretFilename, password, encrypt, randomize);
+        if (result.code != 200) {
+            return std::make_tuple(result.message, result.code);
         }
 
-        writeBMP(outputFile, pixels, width, height);
-        // std::cout << "Data embedded successfully: " << outputFile << std::endl;
+        JobProgress* job = currentJob();
+        setJobPhase(job, JobPhase::Writing);
+
+        std::shared_ptr<const std::string> encoded;
+        {
+            StageTimer timer(output.format == OutputFormat::PNG ? Stage::EncodePNG : Stage::WriteBMP);
+            encoded = std::make_shared<const std::string>(encodeImage(result.pixels, cover.width, cover.height, output));
+        }
+        releasePixels(std::move(result.pixels));
+        addCounter(Counter::ResultBytes, encoded->size());
+        uint64_t encodedSize = encoded->size();
+        std::string name = resultName(fileId, output.format);
+        {
+            StageTimer timer(Stage::Publish);
+            if (!store.publish(name, std::move(encoded))) {
+                return std::make_tuple("{\"status\":\"error\",\"message\":\"Failed to save result\",\"data\":{}}", 500);
+            }
+        }
+        if (job) job->bytesWritten.store(encodedSize, std::memory_order_relaxed);
 
-        return std::make_tuple("{\"status\":\"success\",\"message\":\"Data embedded successfully\",\"data\":{\"result\":\"/results/" + fileId + "\",\"originalFilename\":\"" + coverFilename + "\",\"psnr\":\"" + std::to_string(psnr) + "\"}}", 200);
+        return std::make_tuple("{\"status\":\"success\",\"message\":\"Data embedded successfully\",\"data\":{\"result\":\"/results/" + name + "\",\"originalFilename\":\"" + coverFilename + "\",\"psnr\":\"" + std::to_string(result.psnr) + "\"}}", 200);
     } catch (const std::exception& e) {
         return std::make_tuple("{\"status\":\"error\",\"message\":\"" + std::string(e.what()) + "\",\"data\":{}}", 400);
     }
@@ -6,9 +6,17 @@
 #include <algorithm>
 #include <random>
 #include <filesystem>
+#include <cstring>
 
 #include "../include/BMPstruct.h"
 #include "../include/imgBPCSExtract.h"
+#include "../include/bpcsScan.h"
+#include "../include/metrics.h"
+#include "../include/jobs.h"
+#include "../include/resultStore.h"
+#include "../include/requestArena.h"
+#include "../include/imageIO.h"
+#include "../include/bpcsStream.h"
 
 // std::vector<RGB> readBMP(const std::string& filename, int& width, int& height) {
 //     std::ifstream file(filename, std::ios::binary);
@@ -51,165 +59,140 @@
 //     return pixels;
 // }
 
-std::vector<uint8_t> vigenereDecrypt(const std::vector<uint8_t>& data, const std::string& key) {
-    std::vector<uint8_t> result(data.size());
-    for (size_t i = 0; i < data.size(); ++i) {
-        uint8_t keyByte = key.empty() ? 0 : key[i % key.size()];
-        result[i] = (data[i] - keyByte + 256) % 256;
+BPCSExtractResult bpcsExtract(const std::vector<RGB>& pixels, int width, int height, const std::string& password, bool encrypt, bool randomize) {
+    BPCSExtractResult result;
+
+    // Reconstruct eligible blocks
+    std::vector<BlockPosition> eligibleBlocks;
+    {
+        StageTimer timer(Stage::ComplexityScan);
+        eligibleBlocks = findEligibleBlocks(pixels, width, height);
     }
-    return result;
-}
 
-std::tuple<std::string, int> imgBPCSExtract(const std::string& fileId, const std::string& password, bool encrypt, bool randomize) {
-    try {
-        std::string stegoFile = "/app/uploads/" + fileId;
-
-        // std::string stegoFile = argv[1];
-        // std::string outputDir = argv[2];
-        std::filesystem::path outputPath("extract");
-
-        int width, height;
-        std::vector<RGB> pixels = readBMP(stegoFile, width, height);
-
-        // std::string password;
-        // std::cout << "Enter password (leave blank if none): ";
-        // std::getline(std::cin, password);
-        // bool useDecryption = !password.empty();
-
-        // Reconstruct eligible blocks
-        std::vector<BlockPosition> eligibleBlocks;
-        const int threshold = 34;
-
-        for (int channel = 0; channel < 3; ++channel) {
-            for (int bitPlane = 7; bitPlane >= 0; --bitPlane) {
-                for (int y = 0; y < height; y += 8) {
-                    for (int x = 0; x < width; x += 8) {
-                        std::vector<std::vector<bool>> block(8, std::vector<bool>(8));
-                        
-                        // Extract block bits
-                        for (int i = 0; i < 8; ++i) {
-                            for (int j = 0; j < 8; ++j) {
-                                int pixelIndex = (y + i) * width + (x + j);
-                                uint8_t value = (channel == 0) ? pixels[pixelIndex].r :
-                                                (channel == 1) ? pixels[pixelIndex].g : pixels[pixelIndex].b;
-                                block[i][j] = (value >> (7 - bitPlane)) & 1;
-                            }
-                        }
-
-                        // Calculate complexity
-                        int complexity = 0;
-                        for (int i = 0; i < 8; ++i) {
-                            for (int j = 0; j < 8; ++j) {
-                                if (j < 7 && block[i][j] != block[i][j + 1]) complexity++;
-                                if (i < 7 && block[i][j] != block[i + 1][j]) complexity++;
-                            }
-                        }
-
-                        if (complexity >= threshold) {
-                            eligibleBlocks.push_back({channel, bitPlane, x, y});
-                        }
-                    }
-                }
-            }
+    // Shuffle if needed
+    if (randomize) {
+        unsigned int seed = 0;
+        for (char c : password) {
+            seed += static_cast<unsigned int>(c);
         }
+        std::shuffle(eligibleBlocks.begin(), eligibleBlocks.end(), std::default_random_engine(seed));
+    }
 
-        // Shuffle if needed
-        if (encrypt) {
-            unsigned int seed = 0;
-            for (char c : password) {
-                seed += static_cast<unsigned int>(c);
+    StageTimer timer(Stage::Extract);
+    JobProgress* job = currentJob();
+    setJobPhase(job, JobPhase::Extracting);
+
+    // Blocks are only read as far as the header says the payload goes. Each block
+    // yields 8 bytes, MSB first, and the cipher is positional so bytes can be
+    // decrypted as they arrive.
+    std::pmr::vector<uint8_t> decrypted(requestMemory());
+    size_t nextBlock = 0;
+    auto extractUpTo = [&](size_t count) {
+        if (job) job->bitsTotal.store(count * 8, std::memory_order_relaxed);
+        while (decrypted.size() < count && nextBlock < eligibleBlocks.size()) {
+            if (job && (nextBlock & 255) == 0) {
+                checkCancelled(job);
+                job->bitsEmbedded.store(decrypted.size() * 8, std::memory_order_relaxed);
             }
-            std::shuffle(eligibleBlocks.begin(), eligibleBlocks.end(), std::default_random_engine(seed));
-        }
-
-        // Extract bitstream
-        std::vector<bool> extractedBitstream;
-        for (const auto& pos : eligibleBlocks) {
-            std::vector<std::vector<bool>> block(8, std::vector<bool>(8));
-            
-            // Extract current block bits
+            const BlockPosition& pos = eligibleBlocks[nextBlock++];
+            uint64_t bits = packBlock(pixels, width, pos.channel, pos.bitPlane, pos.x, pos.y);
             for (int i = 0; i < 8; ++i) {
+                uint8_t rowBits = (bits >> (i * 8)) & 0xFF;
+                uint8_t byte = 0;
                 for (int j = 0; j < 8; ++j) {
-                    int pixelIndex = (pos.y + i) * width + (pos.x + j);
-                    uint8_t value = (pos.channel == 0) ? pixels[pixelIndex].r :
-                                    (pos.channel == 1) ? pixels[pixelIndex].g : pixels[pixelIndex].b;
-                    block[i][j] = (value >> (7 - pos.bitPlane)) & 1;
+                    byte |= ((rowBits >> j) & 1) << (7 - j);
                 }
-            }
-
-            // Add all 64 bits from the block
-            for (int i = 0; i < 8; ++i) {
-                for (int j = 0; j < 8; ++j) {
-                    extractedBitstream.push_back(block[i][j]);
+                // Decrypt if needed
+                if (encrypt && !password.empty()) {
+                    byte = static_cast<uint8_t>(byte - static_cast<uint8_t>(password[decrypted.size() % password.size()]));
                 }
+                decrypted.push_back(byte);
             }
         }
+        if (job) job->bitsEmbedded.store(decrypted.size() * 8, std::memory_order_relaxed);
+        return decrypted.size() >= count;
+    };
+
+    // Parse decrypted data
+    if (!extractUpTo(8)) {
+        result.code = 400;
+        result.message = "{\"status\":\"error\",\"message\":\"Invalid data: too short\",\"data\":{}}";
+        return result;
+    }
 
-        // Convert to bytes
-        std::vector<uint8_t> encryptedData;
-        for (size_t i = 0; i < extractedBitstream.size(); i += 8) {
-            uint8_t byte = 0;
-            for (int j = 0; j < 8 && (i + j) < extractedBitstream.size(); ++j) {
-                byte |= (extractedBitstream[i + j] << (7 - j));
-            }
-            encryptedData.push_back(byte);
-        }
+    // Read filename length
+    uint8_t filenameLength = decrypted[0]; // Read single byte
+    if (filenameLength == 0) {
+        throw std::runtime_error("Invalid filename length");
+    }
 
-        // Decrypt if needed
-        if (randomize) {
-            encryptedData = vigenereDecrypt(encryptedData, password);
-        }
+    // Verify total data length
+    size_t headerSize = 1 + filenameLength + 4; // 1 byte length + filename + 4 bytes secret length
+    if (!extractUpTo(headerSize)) {
+        throw std::runtime_error("Data truncated");
+    }
 
-        // Parse decrypted data
-        if (encryptedData.size() < 8) {
-            return std::make_tuple("{\"status\":\"error\",\"message\":\"Invalid data: too short\",\"data\":{}}", 400);
-        }
+    // Extract filename
+    result.filename.assign(decrypted.begin() + 1, decrypted.begin() + 1 + filenameLength);
 
-        // Read filename length
-        uint8_t filenameLength = encryptedData[0]; // Read single byte
-        if (filenameLength == 0) {
-            throw std::runtime_error("Invalid filename length");
-        }
+    // Read secret data length
+    uint32_t secretLength;
+    std::memcpy(&secretLength, &decrypted[1 + filenameLength], sizeof(secretLength));
 
-        // Verify total data length
-        size_t headerSize = 1 + filenameLength + 4; // 1 byte length + filename + 4 bytes secret length
-        if (encryptedData.size() < headerSize) {
-            throw std::runtime_error("Data truncated");
-        }
+    // Verify secret data presence. The length is untrusted, so check it against
+    // the image before reserving anything for it.
+    size_t totalSize = headerSize + secretLength;
+    if (totalSize > eligibleBlocks.size() * 8) {
+        throw std::runtime_error("Data truncated");
+    }
+    decrypted.reserve(totalSize + 8);
+    if (!extractUpTo(totalSize)) {
+        throw std::runtime_error("Data truncated");
+    }
 
-        // Extract filename
-        std::string filename(encryptedData.begin() + 1, 
-                            encryptedData.begin() + 1 + filenameLength);
+    // Extract secret data
+    result.data.assign(decrypted.begin() + headerSize, decrypted.begin() + totalSize);
+    return result;
+}
 
-        // Read secret data length
-        uint32_t secretLength = *reinterpret_cast<const uint32_t*>(&encryptedData[1 + filenameLength]);
+BPCSExtractResult bpcsExtractImage(const uint8_t* stegoData, size_t stegoSize, const std::string& password, bool encrypt, bool randomize) {
+    if (exceedsStreamThreshold(stegoData, stegoSize)) {
+        return bpcsExtractStreamed(stegoData, stegoSize, password, encrypt, randomize);
+    }
 
-        // Verify secret data presence
-        size_t totalSize = headerSize + secretLength;
-        if (encryptedData.size() < totalSize) {
-            throw std::runtime_error("Data truncated");
-        }
+    int width, height;
+    std::vector<RGB> pixels;
+    setJobPhase(currentJob(), JobPhase::Decoding);
+    {
+        StageTimer timer(Stage::Decode);
+        pixels = decodeImage(stegoData, stegoSize, width, height);
+    }
+
+    BPCSExtractResult result = bpcsExtract(pixels, width, height, password, encrypt, randomize);
+    releasePixels(std::move(pixels));
+    return result;
+}
 
-        // Extract secret data
-        std::vector<uint8_t> secretData(
-            encryptedData.begin() + headerSize,
-            encryptedData.begin() + totalSize
-        );
-
-        // Create output directory if needed
-        // if (!std::filesystem::exists(outputPath)) {
-        //     std::filesystem::create_directories(outputPath);
-        // }
-
-        std::filesystem::path fullOutputPath = outputPath / filename;
-        std::ofstream outFile(fullOutputPath, std::ios::binary);
-        if (!outFile) {
-            return std::make_tuple("{\"status\":\"error\",\"message\":\"Failed to create output file\",\"data\":{}}", 400);
+std::tuple<std::string, int> imgBPCSExtract(const std::string& fileId, const uint8_t* stegoData, size_t stegoSize, const std::string& password, bool encrypt, bool randomize, ResultStore& store) {
+    try {
+        BPCSExtractResult result = bpcsExtractImage(stegoData, stegoSize, password, encrypt, randomize);
+        if (result.code != 200) {
+            return std::make_tuple(result.message, result.code);
         }
 
-        outFile.write(reinterpret_cast<const char*>(secretData.data()), secretData.size());
+        // Stored under the request id; the embedded filename only travels back in the JSON
+        setJobPhase(currentJob(), JobPhase::Writing);
+        size_t extractedSize = result.data.size();
+        {
+            StageTimer timer(Stage::Publish);
+            if (!store.publish(fileId, std::make_shared<const std::string>(std::move(result.data)))) {
+                return std::make_tuple("{\"status\":\"error\",\"message\":\"Failed to save extracted file\",\"data\":{}}", 500);
+            }
+        }
+        if (JobProgress* job = currentJob()) job->bytesWritten.store(extractedSize, std::memory_order_relaxed);
+        addCounter(Counter::ExtractedBytes, extractedSize);
 
-        return std::make_tuple("{\"status\":\"success\",\"message\":\"Data extracted successfully\",\"data\":{\"result\":\"/extracts/" + fileId + "\",\"originalFilename\":\"" + filename + "\"}}", 200);
+        return std::make_tuple("{\"status\":\"success\",\"message\":\"Data extracted successfully\",\"data\":{\"result\":\"/extracts/" + fileId + "\",\"originalFilename\":\"" + result.filename + "\"}}", 200);
     } catch (const std::exception& e) {
         return std::make_tuple("{\"status\":\"error\",\"message\":\"" + std::string(e.what()) + "\",\"data\":{}}", 400);
     }
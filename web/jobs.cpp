@@ -0,0 +1,99 @@
+#include "../include/jobs.h"
+#include <cstdio>
+
+// How long a finished job stays visible, and how long a job may wait for its request
+static const std::chrono::seconds FINISHED_TTL(60);
+static const std::chrono::seconds WAITING_TTL(600);
+
+static thread_local JobProgress* activeJob = nullptr;
+
+const char* jobPhaseName(JobPhase phase) {
+    switch (phase) {
+        case JobPhase::Waiting: return "waiting";
+        case JobPhase::Decoding: return "decoding";
+        case JobPhase::Scanning: return "scanning";
+        case JobPhase::Embedding: return "embedding";
+        case JobPhase::Extracting: return "extracting";
+        case JobPhase::Writing: return "writing";
+        case JobPhase::Done: return "done";
+        case JobPhase::Failed: return "failed";
+        case JobPhase::Cancelled: return "cancelled";
+    }
+    return "unknown";
+}
+
+std::string jobSnapshot(const JobProgress& job) {
+    char buf[320];
+    std::snprintf(buf, sizeof(buf),
+                  "{\"phase\":\"%s\",\"blocksScanned\":%llu,\"blocksTotal\":%llu,\"bitsEmbedded\":%llu,"
+                  "\"bitsTotal\":%llu,\"bytesWritten\":%llu,\"code\":%d}",
+                  jobPhaseName(static_cast<JobPhase>(job.phase.load(std::memory_order_relaxed))),
+                  static_cast<unsigned long long>(job.blocksScanned.load(std::memory_order_relaxed)),
+                  static_cast<unsigned long long>(job.blocksTotal.load(std::memory_order_relaxed)),
+                  static_cast<unsigned long long>(job.bitsEmbedded.load(std::memory_order_relaxed)),
+                  static_cast<unsigned long long>(job.bitsTotal.load(std::memory_order_relaxed)),
+                  static_cast<unsigned long long>(job.bytesWritten.load(std::memory_order_relaxed)),
+                  job.code.load(std::memory_order_relaxed));
+    return buf;
+}
+
+void JobRegistry::purge() {
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = jobs.begin(); it != jobs.end();) {
+        const JobProgress& job = *it->second;
+        int64_t finishedAt = job.finishedAt.load(std::memory_order_acquire);
+        bool expired = finishedAt != 0
+            ? now.time_since_epoch().count() - finishedAt > std::chrono::duration_cast<std::chrono::steady_clock::duration>(FINISHED_TTL).count()
+            : !job.started.load(std::memory_order_relaxed) && now - job.created > WAITING_TTL;
+        it = expired ? jobs.erase(it) : std::next(it);
+    }
+}
+
+std::shared_ptr<JobProgress> JobRegistry::acquire(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = jobs.find(id);
+    if (it != jobs.end()) return it->second;
+
+    purge();
+    if (jobs.size() >= maxJobs) return nullptr;
+    auto job = std::make_shared<JobProgress>();
+    jobs.emplace(id, job);
+    return job;
+}
+
+bool JobRegistry::cancel(const std::string& id) {
+    // Cancelling before the work arrives is allowed; the request then stops at its first checkpoint
+    std::shared_ptr<JobProgress> job = acquire(id);
+    if (!job || job->finishedAt.load(std::memory_order_acquire) != 0) return false;
+    job->cancelled.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+JobScope::JobScope(std::shared_ptr<JobProgress> job) : job(std::move(job)), previous(activeJob) {
+    if (this->job) {
+        this->job->started.store(true, std::memory_order_relaxed);
+        activeJob = this->job.get();
+    }
+}
+
+JobScope::~JobScope() {
+    if (!job) return;
+    if (!finished) finish(500);
+    activeJob = previous;
+}
+
+void JobScope::finish(int code) {
+    if (!job || finished) return;
+    finished = true;
+
+    // A cancel that lands after the last checkpoint doesn't undo a finished job
+    JobPhase phase = code == 200 ? JobPhase::Done
+                   : job->cancelled.load(std::memory_order_relaxed) ? JobPhase::Cancelled : JobPhase::Failed;
+    job->code.store(code, std::memory_order_relaxed);
+    job->phase.store(static_cast<int>(phase), std::memory_order_relaxed);
+    job->finishedAt.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_release);
+}
+
+JobProgress* currentJob() {
+    return activeJob;
+}
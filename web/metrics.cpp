@@ -0,0 +1,238 @@
+#include "../include/metrics.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+static const size_t STAGE_COUNT = static_cast<size_t>(Stage::COUNT);
+static const size_t COUNTER_COUNT = static_cast<size_t>(Counter::COUNT);
+static const size_t ENDPOINT_COUNT = static_cast<size_t>(Endpoint::COUNT);
+static const size_t WORK_CLASS_COUNT = static_cast<size_t>(WorkClass::COUNT);
+
+static const char* STAGE_NAMES[STAGE_COUNT] = {
+    "multipart_parse", "decode", "complexity_scan",
+    "embed", "psnr", "write_bmp", "encode_png", "publish", "extract", "queue_wait",
+};
+
+struct CounterInfo {
+    const char* family;
+    const char* label;
+};
+
+static const CounterInfo COUNTER_INFO[COUNTER_COUNT] = {
+    {"stegoninja_bytes_processed_total", "kind=\"cover\""},
+    {"stegoninja_bytes_processed_total", "kind=\"secret\""},
+    {"stegoninja_bytes_processed_total", "kind=\"stego\""},
+    {"stegoninja_bytes_processed_total", "kind=\"result\""},
+    {"stegoninja_bytes_processed_total", "kind=\"extracted\""},
+    {"stegoninja_cover_cache_lookups_total", "result=\"hit\""},
+    {"stegoninja_cover_cache_lookups_total", "result=\"miss\""},
+    {"stegoninja_admission_rejected_total", "class=\"static\""},
+    {"stegoninja_admission_rejected_total", "class=\"extract\""},
+    {"stegoninja_admission_rejected_total", "class=\"capacity\""},
+    {"stegoninja_admission_rejected_total", "class=\"embed\""},
+};
+
+static const char* ENDPOINT_NAMES[ENDPOINT_COUNT] = {
+    "index", "embed", "extract", "result", "metrics", "embed_raw", "extract_raw", "embed_batch", "capacity",
+    "job_events", "job_cancel", "extract_result",
+};
+
+static const char* WORK_CLASS_NAMES[WORK_CLASS_COUNT] = {
+    "static", "extract", "capacity", "embed",
+};
+
+// Upper bounds in seconds; the implicit last bucket is +Inf
+static const std::array<double, 16> BUCKETS = {
+    0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+    0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0, 60.0,
+};
+
+struct Histogram {
+    std::atomic<uint64_t> buckets[BUCKETS.size() + 1];
+    std::atomic<uint64_t> sumNanos;
+    std::atomic<uint64_t> count;
+};
+
+struct Shard {
+    Histogram stages[STAGE_COUNT];
+    std::atomic<uint64_t> counters[COUNTER_COUNT];
+
+    Shard() {
+        for (auto& h : stages) {
+            for (auto& b : h.buckets) b.store(0, std::memory_order_relaxed);
+            h.sumNanos.store(0, std::memory_order_relaxed);
+            h.count.store(0, std::memory_order_relaxed);
+        }
+        for (auto& c : counters) c.store(0, std::memory_order_relaxed);
+    }
+};
+
+// Only the owning thread writes a shard, so a plain load/store pair is enough
+static inline void bump(std::atomic<uint64_t>& cell, uint64_t amount) {
+    cell.store(cell.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+static std::mutex shardsMutex;
+static std::vector<std::unique_ptr<Shard>> allShards;
+static std::vector<Shard*> freeShards;
+
+static std::atomic<uint64_t> requestsTotal[ENDPOINT_COUNT];
+static std::atomic<int64_t> inFlight[ENDPOINT_COUNT];
+static std::atomic<int64_t> queueDepth[WORK_CLASS_COUNT];
+static std::atomic<int64_t> admitted[WORK_CLASS_COUNT];
+
+// Shards outlive their threads: totals are cumulative, so a finished thread's
+// shard is handed to the next new thread instead of being merged or freed.
+struct ShardHandle {
+    Shard* shard;
+
+    ShardHandle() {
+        std::lock_guard<std::mutex> lock(shardsMutex);
+        if (!freeShards.empty()) {
+            shard = freeShards.back();
+            freeShards.pop_back();
+        } else {
+            allShards.push_back(std::make_unique<Shard>());
+            shard = allShards.back().get();
+        }
+    }
+
+    ~ShardHandle() {
+        std::lock_guard<std::mutex> lock(shardsMutex);
+        freeShards.push_back(shard);
+    }
+};
+
+static Shard& localShard() {
+    thread_local ShardHandle handle;
+    return *handle.shard;
+}
+
+void observeStage(Stage stage, std::chrono::nanoseconds elapsed) {
+    Histogram& h = localShard().stages[static_cast<size_t>(stage)];
+    double seconds = std::chrono::duration<double>(elapsed).count();
+
+    size_t bucket = 0;
+    while (bucket < BUCKETS.size() && seconds > BUCKETS[bucket]) ++bucket;
+
+    bump(h.buckets[bucket], 1);
+    bump(h.sumNanos, static_cast<uint64_t>(elapsed.count()));
+    bump(h.count, 1);
+}
+
+void addCounter(Counter counter, uint64_t amount) {
+    bump(localShard().counters[static_cast<size_t>(counter)], amount);
+}
+
+void setAdmissionGauges(WorkClass workClass, int64_t queued, int64_t running) {
+    size_t w = static_cast<size_t>(workClass);
+    queueDepth[w].store(queued, std::memory_order_relaxed);
+    admitted[w].store(running, std::memory_order_relaxed);
+}
+
+InFlightRequest::InFlightRequest(Endpoint endpoint) : endpoint(endpoint) {
+    requestsTotal[static_cast<size_t>(endpoint)].fetch_add(1, std::memory_order_relaxed);
+    inFlight[static_cast<size_t>(endpoint)].fetch_add(1, std::memory_order_relaxed);
+}
+
+InFlightRequest::~InFlightRequest() {
+    inFlight[static_cast<size_t>(endpoint)].fetch_sub(1, std::memory_order_relaxed);
+}
+
+static void appendf(std::string& out, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void appendf(std::string& out, const char* fmt, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = std::vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n > 0) out.append(buf, std::min(static_cast<size_t>(n), sizeof(buf) - 1));
+}
+
+std::string renderMetrics() {
+    uint64_t buckets[STAGE_COUNT][BUCKETS.size() + 1] = {};
+    uint64_t sumNanos[STAGE_COUNT] = {};
+    uint64_t counts[STAGE_COUNT] = {};
+    uint64_t counters[COUNTER_COUNT] = {};
+
+    {
+        std::lock_guard<std::mutex> lock(shardsMutex);
+        for (const auto& shard : allShards) {
+            for (size_t s = 0; s < STAGE_COUNT; ++s) {
+                const Histogram& h = shard->stages[s];
+                for (size_t b = 0; b <= BUCKETS.size(); ++b) {
+                    buckets[s][b] += h.buckets[b].load(std::memory_order_relaxed);
+                }
+                sumNanos[s] += h.sumNanos.load(std::memory_order_relaxed);
+                counts[s] += h.count.load(std::memory_order_relaxed);
+            }
+            for (size_t c = 0; c < COUNTER_COUNT; ++c) {
+                counters[c] += shard->counters[c].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::string out;
+    out.reserve(16 * 1024);
+
+    out += "# HELP stegoninja_stage_duration_seconds Time spent in each processing stage.\n";
+    out += "# TYPE stegoninja_stage_duration_seconds histogram\n";
+    for (size_t s = 0; s < STAGE_COUNT; ++s) {
+        // Buckets are stored per range and exposed cumulatively
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < BUCKETS.size(); ++b) {
+            cumulative += buckets[s][b];
+            appendf(out, "stegoninja_stage_duration_seconds_bucket{stage=\"%s\",le=\"%g\"} %llu\n",
+                    STAGE_NAMES[s], BUCKETS[b], static_cast<unsigned long long>(cumulative));
+        }
+        cumulative += buckets[s][BUCKETS.size()];
+        appendf(out, "stegoninja_stage_duration_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n",
+                STAGE_NAMES[s], static_cast<unsigned long long>(cumulative));
+        appendf(out, "stegoninja_stage_duration_seconds_sum{stage=\"%s\"} %.9f\n",
+                STAGE_NAMES[s], static_cast<double>(sumNanos[s]) / 1e9);
+        appendf(out, "stegoninja_stage_duration_seconds_count{stage=\"%s\"} %llu\n",
+                STAGE_NAMES[s], static_cast<unsigned long long>(counts[s]));
+    }
+
+    const char* lastFamily = "";
+    for (size_t c = 0; c < COUNTER_COUNT; ++c) {
+        const CounterInfo& info = COUNTER_INFO[c];
+        if (std::string(info.family) != lastFamily) {
+            appendf(out, "# TYPE %s counter\n", info.family);
+            lastFamily = info.family;
+        }
+        appendf(out, "%s{%s} %llu\n", info.family, info.label, static_cast<unsigned long long>(counters[c]));
+    }
+
+    out += "# TYPE stegoninja_requests_total counter\n";
+    for (size_t e = 0; e < ENDPOINT_COUNT; ++e) {
+        appendf(out, "stegoninja_requests_total{endpoint=\"%s\"} %llu\n", ENDPOINT_NAMES[e],
+                static_cast<unsigned long long>(requestsTotal[e].load(std::memory_order_relaxed)));
+    }
+
+    out += "# TYPE stegoninja_requests_in_flight gauge\n";
+    for (size_t e = 0; e < ENDPOINT_COUNT; ++e) {
+        appendf(out, "stegoninja_requests_in_flight{endpoint=\"%s\"} %lld\n", ENDPOINT_NAMES[e],
+                static_cast<long long>(inFlight[e].load(std::memory_order_relaxed)));
+    }
+
+    out += "# TYPE stegoninja_queue_depth gauge\n";
+    for (size_t w = 0; w < WORK_CLASS_COUNT; ++w) {
+        appendf(out, "stegoninja_queue_depth{class=\"%s\"} %lld\n", WORK_CLASS_NAMES[w],
+                static_cast<long long>(queueDepth[w].load(std::memory_order_relaxed)));
+    }
+
+    out += "# TYPE stegoninja_admitted gauge\n";
+    for (size_t w = 0; w < WORK_CLASS_COUNT; ++w) {
+        appendf(out, "stegoninja_admitted{class=\"%s\"} %lld\n", WORK_CLASS_NAMES[w],
+                static_cast<long long>(admitted[w].load(std::memory_order_relaxed)));
+    }
+
+    return out;
+}
@@ -1,38 +1,44 @@
 #include "../include/parse_multipart.h"
 #include <vector>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <optional>
 
-std::vector<std::pair<std::string, std::string>> parse_multipart(const std::string& body, const std::string& boundary) {
-    std::vector<std::pair<std::string, std::string>> files; // To store multiple files
-
+// Walks the parts between boundary delimiters, calling `visit(name, filename, content)` for
+// each file part until it returns false. Only the part headers are searched for attributes.
+template <class Visit>
+static void for_each_file_part(std::string_view body, const std::string& boundary, Visit visit) {
     std::string delimiter = "--" + boundary;
     size_t start = body.find(delimiter);
+    if (start == std::string_view::npos) return;
     size_t end = body.find(delimiter, start + delimiter.size());
 
-    while (end != std::string::npos) {
-        std::string part = body.substr(start, end - start);
-
-        // Check if this part contains a file
-        size_t disposition_pos = part.find("Content-Disposition:");
-        if (disposition_pos != std::string::npos) {
-            size_t filename_pos = part.find("filename=\"", disposition_pos);
-            if (filename_pos != std::string::npos) {
-                // Extract file name
-                size_t filename_start = filename_pos + 10; // Skip "filename=\""
-                size_t filename_end = part.find("\"", filename_start);
-                std::string file_name = part.substr(filename_start, filename_end - filename_start);
-
-                // Extract file content
-                size_t content_start = part.find("\r\n\r\n", filename_end);
-                if (content_start != std::string::npos) {
-                    content_start += 4; // Skip "\r\n\r\n"
-                    size_t content_end = part.size() - 2; // Exclude trailing "\r\n"
-                    std::string file_content = part.substr(content_start, content_end - content_start);
-
-                    // Store the file name and content
-                    files.emplace_back(file_name, file_content);
+    while (end != std::string_view::npos) {
+        // Headers end at the first blank line of the part
+        size_t headers_end = body.find("\r\n\r\n", start);
+        if (headers_end != std::string_view::npos && headers_end < end) {
+            std::string_view headers = body.substr(start, headers_end - start);
+            size_t disposition_pos = headers.find("Content-Disposition:");
+            if (disposition_pos != std::string_view::npos) {
+                size_t name_pos = headers.find(" name=\"", disposition_pos);
+                if (name_pos == std::string_view::npos) name_pos = headers.find(";name=\"", disposition_pos);
+                size_t filename_pos = headers.find("filename=\"", disposition_pos);
+                if (name_pos != std::string_view::npos && filename_pos != std::string_view::npos) {
+                    size_t name_start = name_pos + 7; // Skip " name=\""
+                    size_t name_end = headers.find('"', name_start);
+                    size_t filename_start = filename_pos + 10; // Skip "filename=\""
+                    size_t filename_end = headers.find('"', filename_start);
+
+                    size_t content_start = headers_end + 4; // Skip "\r\n\r\n"
+                    size_t content_end = end - 2;           // Exclude trailing "\r\n"
+                    if (name_end != std::string_view::npos && filename_end != std::string_view::npos && content_end >= content_start) {
+                        if (!visit(headers.substr(name_start, name_end - name_start),
+                                   headers.substr(filename_start, filename_end - filename_start),
+                                   body.substr(content_start, content_end - content_start))) {
+                            return;
+                        }
+                    }
                 }
             }
         }
@@ -41,61 +47,42 @@ std::vector<std::pair<std::string, std::string>> parse_multipart(const std::stri
         start = end;
         end = body.find(delimiter, start + delimiter.size());
     }
+}
 
+std::vector<MultipartFile> parse_multipart(std::string_view body, const std::string& boundary) {
+    std::vector<MultipartFile> files; // To store multiple files
+    for_each_file_part(body, boundary, [&](std::string_view, std::string_view filename, std::string_view content) {
+        files.emplace_back(std::string(filename), content);
+        return true;
+    });
     return files; // Return all extracted files
 }
 
-std::optional<std::pair<std::string, std::string>> get_file_by_name(
-    const std::string& body,
+std::optional<MultipartFile> get_file_by_name(
+    std::string_view body,
     const std::string& boundary,
     const std::string& target_name) {
 
-    std::string delimiter = "--" + boundary;
-    size_t start = body.find(delimiter);
-    size_t end = body.find(delimiter, start + delimiter.size());
-
-    while (end != std::string::npos) {
-        std::string part = body.substr(start, end - start);
-
-        // Check if this part contains a file
-        size_t disposition_pos = part.find("Content-Disposition:");
-        if (disposition_pos != std::string::npos) {
-            // Extract the "name" attribute
-            size_t name_pos = part.find("name=\"", disposition_pos);
-            if (name_pos != std::string::npos) {
-                size_t name_start = name_pos + 6; // Skip "name=\""
-                size_t name_end = part.find("\"", name_start);
-                std::string name = part.substr(name_start, name_end - name_start);
-
-                // Check if the name matches the target
-                if (name == target_name) {
-                    // Extract file name
-                    size_t filename_pos = part.find("filename=\"", name_end);
-                    if (filename_pos != std::string::npos) {
-                        size_t filename_start = filename_pos + 10; // Skip "filename=\""
-                        size_t filename_end = part.find("\"", filename_start);
-                        std::string file_name = part.substr(filename_start, filename_end - filename_start);
-
-                        // Extract file content
-                        size_t content_start = part.find("\r\n\r\n", filename_end);
-                        if (content_start != std::string::npos) {
-                            content_start += 4; // Skip "\r\n\r\n"
-                            size_t content_end = part.size() - 2; // Exclude trailing "\r\n"
-                            std::string file_content = part.substr(content_start, content_end - content_start);
+    std::optional<MultipartFile> file;
+    for_each_file_part(body, boundary, [&](std::string_view name, std::string_view filename, std::string_view content) {
+        if (name != target_name) return true;
+        file.emplace(std::string(filename), content);
+        return false;
+    });
 
-                            // Return the matching file pair
-                            return std::make_pair(file_name, file_content);
-                        }
-                    }
-                }
-            }
-        }
+    // Empty if no match is found
+    return file;
+}
 
-        // Move to the next part
-        start = end;
-        end = body.find(delimiter, start + delimiter.size());
-    }
+std::vector<MultipartFile> get_files_by_name(
+    std::string_view body,
+    const std::string& boundary,
+    const std::string& target_name) {
 
-    // Return an empty optional if no match is found
-    return std::nullopt;
-}
\ No newline at end of file
+    std::vector<MultipartFile> files;
+    for_each_file_part(body, boundary, [&](std::string_view name, std::string_view filename, std::string_view content) {
+        if (name == target_name) files.emplace_back(std::string(filename), content);
+        return true;
+    });
+    return files;
+}
@@ -0,0 +1,159 @@
+// Included by name rather than through ../include: the CLI build compiles this file too and
+// finds the header in include-web
+#include "pngStripe.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// Filtered bytes per stripe; small enough to spread a 12 MP image over a dozen workers,
+// large enough that the dictionary reset at each stripe costs well under 1%.
+static const size_t STRIPE_BYTES = 512 * 1024;
+
+static const uint8_t PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+static void putU32(std::string& out, uint32_t v) {
+    char b[4] = {static_cast<char>(v >> 24), static_cast<char>(v >> 16), static_cast<char>(v >> 8), static_cast<char>(v)};
+    out.append(b, 4);
+}
+
+static inline uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return static_cast<uint8_t>(a);
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+// BGR(A) row into PNG's RGB(A) order
+static void toPngOrder(const uint8_t* row, int channels, size_t rowBytes, uint8_t* out) {
+    std::memcpy(out, row, rowBytes);
+    for (size_t i = 0; i < rowBytes; i += static_cast<size_t>(channels)) std::swap(out[i], out[i + 2]);
+}
+
+int pngStripeRows(int width, int channels) {
+    size_t rowBytes = static_cast<size_t>(width) * channels + 1;
+    return static_cast<int>(std::max<size_t>(1, STRIPE_BYTES / rowBytes));
+}
+
+void pngFilterRow(const uint8_t* row, const uint8_t* prev, size_t rowBytes, int bpp, uint8_t* out, std::vector<uint8_t>& scratch) {
+    scratch.resize(rowBytes * 3);
+    uint8_t* sub = scratch.data();
+    uint8_t* up = sub + rowBytes;
+    uint8_t* pa = up + rowBytes;
+    size_t step = static_cast<size_t>(bpp);
+
+    uint64_t costNone = 0, costSub = 0, costUp = 0, costPaeth = 0;
+    for (size_t i = 0; i < rowBytes; ++i) {
+        int left = i >= step ? row[i - step] : 0;
+        int above = prev ? prev[i] : 0;
+        int diag = prev && i >= step ? prev[i - step] : 0;
+
+        sub[i] = static_cast<uint8_t>(row[i] - left);
+        up[i] = static_cast<uint8_t>(row[i] - above);
+        pa[i] = static_cast<uint8_t>(row[i] - paeth(left, above, diag));
+
+        costNone += static_cast<uint64_t>(std::abs(static_cast<int8_t>(row[i])));
+        costSub += static_cast<uint64_t>(std::abs(static_cast<int8_t>(sub[i])));
+        costUp += static_cast<uint64_t>(std::abs(static_cast<int8_t>(up[i])));
+        costPaeth += static_cast<uint64_t>(std::abs(static_cast<int8_t>(pa[i])));
+    }
+
+    uint8_t filter = 0;
+    const uint8_t* best = row;
+    uint64_t bestCost = costNone;
+    if (costSub < bestCost) { filter = 1; best = sub; bestCost = costSub; }
+    if (prev && costUp < bestCost) { filter = 2; best = up; bestCost = costUp; }
+    if (costPaeth < bestCost) { filter = 4; best = pa; }
+
+    out[0] = filter;
+    std::memcpy(out + 1, best, rowBytes);
+}
+
+// Every stripe but the last ends on a sync flush (byte aligned, no final bit) so the raw
+// deflate pieces concatenate into one stream behind the first stripe's zlib header.
+bool encodePngStripe(const uint8_t* const* rows, int width, int channels, bool bgr, int y0, int y1, int level, bool last, PngStripe& stripe) {
+    size_t rowBytes = static_cast<size_t>(width) * channels;
+    bool swap = bgr && channels >= 3;
+
+    std::vector<uint8_t> filtered(static_cast<size_t>(y1 - y0) * (rowBytes + 1));
+    std::vector<uint8_t> current, previous, scratch;
+    if (swap) {
+        current.resize(rowBytes);
+        previous.resize(rowBytes);
+        if (y0 > 0) toPngOrder(rows[y0 - 1], channels, rowBytes, previous.data());
+    }
+    for (int y = y0; y < y1; ++y) {
+        const uint8_t* row = rows[y];
+        const uint8_t* prev = y > 0 ? rows[y - 1] : nullptr;
+        if (swap) {
+            toPngOrder(row, channels, rowBytes, current.data());
+            row = current.data();
+            prev = y > 0 ? previous.data() : nullptr;
+        }
+        pngFilterRow(row, prev, rowBytes, channels, filtered.data() + static_cast<size_t>(y - y0) * (rowBytes + 1), scratch);
+        if (swap) std::swap(current, previous);
+    }
+
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_FILTERED) != Z_OK) return false;
+
+    stripe.rawLength = filtered.size();
+    stripe.adler = adler32(adler32(0L, Z_NULL, 0), filtered.data(), static_cast<uInt>(filtered.size()));
+    // Room for the zlib header and the sync flush's empty stored block on top of the one-shot bound
+    stripe.deflated.resize(deflateBound(&zs, static_cast<uLong>(filtered.size())) + 16);
+
+    size_t headerBytes = 0;
+    if (y0 == 0) {
+        // 32K window, FLEVEL from the compression level
+        uint8_t flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+        uint16_t header = static_cast<uint16_t>(0x78 << 8 | flevel << 6);
+        header = static_cast<uint16_t>(header + (31 - header % 31) % 31);
+        stripe.deflated[0] = static_cast<uint8_t>(header >> 8);
+        stripe.deflated[1] = static_cast<uint8_t>(header & 0xff);
+        headerBytes = 2;
+    }
+
+    zs.next_in = filtered.data();
+    zs.avail_in = static_cast<uInt>(filtered.size());
+    zs.next_out = stripe.deflated.data() + headerBytes;
+    zs.avail_out = static_cast<uInt>(stripe.deflated.size() - headerBytes);
+    int rc = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+    bool complete = last ? rc == Z_STREAM_END : rc == Z_OK && zs.avail_in == 0 && zs.avail_out > 0;
+    stripe.deflated.resize(headerBytes + zs.total_out);
+    deflateEnd(&zs);
+    return complete;
+}
+
+void finishPngStripes(std::vector<PngStripe>& stripes) {
+    if (stripes.empty()) return;
+    uLong adler = adler32(0L, Z_NULL, 0);
+    for (const auto& stripe : stripes) {
+        adler = adler32_combine(adler, stripe.adler, static_cast<z_off_t>(stripe.rawLength));
+    }
+    std::vector<uint8_t>& tail = stripes.back().deflated;
+    for (int shift = 24; shift >= 0; shift -= 8) tail.push_back(static_cast<uint8_t>(adler >> shift));
+}
+
+void appendPngHeader(std::string& out, int width, int height, int channels) {
+    static const char COLOUR_TYPES[5] = {0, 0, 4, 2, 6};
+    uint8_t ihdr[13];
+    for (int i = 0; i < 4; ++i) {
+        ihdr[i] = static_cast<uint8_t>(static_cast<uint32_t>(width) >> (24 - 8 * i));
+        ihdr[4 + i] = static_cast<uint8_t>(static_cast<uint32_t>(height) >> (24 - 8 * i));
+    }
+    ihdr[8] = 8;  // bit depth
+    ihdr[9] = static_cast<uint8_t>(COLOUR_TYPES[channels]);
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;  // deflate, adaptive filtering, no interlace
+
+    out.append(reinterpret_cast<const char*>(PNG_SIGNATURE), sizeof(PNG_SIGNATURE));
+    appendPngChunk(out, "IHDR", ihdr, sizeof(ihdr));
+}
+
+void appendPngChunk(std::string& out, const char* type, const uint8_t* data, size_t size) {
+    putU32(out, static_cast<uint32_t>(size));
+    size_t start = out.size();
+    out.append(type, 4);
+    if (size > 0) out.append(reinterpret_cast<const char*>(data), size);
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(out.data() + start), static_cast<uInt>(size + 4));
+    putU32(out, static_cast<uint32_t>(crc));
+}
@@ -0,0 +1,207 @@
+#include "../include/prefork.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sched.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// A worker that dies sooner than this after starting counts towards the restart backoff
+static const std::chrono::seconds HEALTHY_UPTIME(10);
+static const int MAX_BACKOFF_SECONDS = 30;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onStopSignal(int) {
+    stopRequested = 1;
+}
+
+CpuPinning parsePinning(const std::string& name) {
+    if (name == "cores") return CpuPinning::Cores;
+    if (name == "numa") return CpuPinning::Numa;
+    return CpuPinning::None;
+}
+
+static std::vector<int> allowedCpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+size_t availableCpus() {
+    size_t count = allowedCpus().size();
+    return count ? count : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Parse a sysfs cpulist such as "0-7,16-23"
+static std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t comma = list.find(',', pos);
+        std::string range = list.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        size_t dash = range.find('-');
+        int first = std::atoi(range.c_str());
+        int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+        if (comma == std::string::npos) break;
+        pos = comma + 1;
+    }
+    return cpus;
+}
+
+static std::vector<std::vector<int>> numaNodes() {
+    std::vector<std::vector<int>> nodes;
+    for (int node = 0;; ++node) {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!file) break;
+        std::string list;
+        std::getline(file, list);
+        nodes.push_back(parseCpuList(list));
+    }
+    return nodes;
+}
+
+// Memory is not bound explicitly; once pinned, first-touch allocation keeps it on the local node
+static void pinWorker(size_t index, size_t workers, CpuPinning pinning) {
+    if (pinning == CpuPinning::None) return;
+
+    std::vector<int> allowed = allowedCpus();
+    if (allowed.empty()) return;
+    std::vector<int> chosen;
+
+    std::vector<std::vector<int>> nodes = pinning == CpuPinning::Numa ? numaNodes() : std::vector<std::vector<int>>();
+    if (nodes.size() > 1) {
+        for (int cpu : nodes[index % nodes.size()]) {
+            if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) chosen.push_back(cpu);
+        }
+    } else {
+        size_t slice = std::max<size_t>(1, allowed.size() / workers);
+        for (size_t i = 0; i < slice; ++i) {
+            chosen.push_back(allowed[(index * slice + i) % allowed.size()]);
+        }
+    }
+    if (chosen.empty()) return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : chosen) CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        std::cerr << "Worker " << index << ": failed to set CPU affinity: " << std::strerror(errno) << std::endl;
+    }
+}
+
+int reusePortSocket(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    int on = 1;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0 ||
+        bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+int runPrefork(size_t workers, CpuPinning pinning, const std::function<int(size_t)>& serve) {
+    struct sigaction action{};
+    action.sa_handler = onStopSignal;
+    sigemptyset(&action.sa_mask);
+    // No SA_RESTART: waitpid has to return so the loop sees the request to stop
+    sigaction(SIGTERM, &action, nullptr);
+    sigaction(SIGINT, &action, nullptr);
+
+    pid_t supervisor = getpid();
+    std::vector<pid_t> pids(workers, -1);
+    std::vector<std::chrono::steady_clock::time_point> startedAt(workers);
+    std::vector<int> quickDeaths(workers, 0);
+
+    auto spawn = [&](size_t index) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "Failed to fork worker " << index << ": " << std::strerror(errno) << std::endl;
+            return;
+        }
+        if (pid == 0) {
+            signal(SIGTERM, SIG_DFL);
+            signal(SIGINT, SIG_DFL);
+            // Don't outlive the supervisor, including when it died before prctl ran
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            if (getppid() != supervisor) _exit(0);
+
+            pinWorker(index, workers, pinning);
+            std::exit(serve(index));
+        }
+        pids[index] = pid;
+        startedAt[index] = std::chrono::steady_clock::now();
+        std::cout << "Worker " << index << " started (pid " << pid << ")" << std::endl;
+    };
+
+    for (size_t i = 0; i < workers; ++i) spawn(i);
+
+    while (!stopRequested) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        auto it = std::find(pids.begin(), pids.end(), pid);
+        if (it == pids.end()) continue;
+        size_t index = it - pids.begin();
+        pids[index] = -1;
+
+        if (WIFSIGNALED(status)) {
+            std::cerr << "Worker " << index << " killed by signal " << WTERMSIG(status) << std::endl;
+        } else {
+            std::cerr << "Worker " << index << " exited with status " << WEXITSTATUS(status) << std::endl;
+        }
+        if (stopRequested) break;
+
+        // Back off exponentially while a worker keeps crashing on startup
+        bool quick = std::chrono::steady_clock::now() - startedAt[index] < HEALTHY_UPTIME;
+        quickDeaths[index] = quick ? quickDeaths[index] + 1 : 0;
+        if (quickDeaths[index] > 0) {
+            int delay = std::min(MAX_BACKOFF_SECONDS, 1 << std::min(quickDeaths[index] - 1, 5));
+            sleep(delay);
+            if (stopRequested) break;
+        }
+        spawn(index);
+    }
+
+    for (pid_t pid : pids) {
+        if (pid > 0) kill(pid, SIGTERM);
+    }
+    for (pid_t pid : pids) {
+        if (pid > 0) waitpid(pid, nullptr, 0);
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include "../include/requestArena.h"
+#include <mutex>
+
+// First arena block per thread; covers the payload of a typical embed or extract
+static const size_t THREAD_BUFFER_BYTES = 256 * 1024;
+
+// Buffers smaller than this are cheap to allocate and not worth holding on to
+static const size_t MIN_POOLED_BYTES = 256 * 1024;
+static const size_t MAX_POOLED_BUFFERS = 32;
+
+thread_local RequestArena* activeArena = nullptr;
+
+static std::byte* threadBuffer() {
+    thread_local std::unique_ptr<std::byte[]> buffer(new std::byte[THREAD_BUFFER_BYTES]);
+    return buffer.get();
+}
+
+// An arena opened inside another on the same thread can't share the thread buffer, so it brings its own
+RequestArena::RequestArena()
+    : ownBuffer(activeArena ? new std::byte[THREAD_BUFFER_BYTES] : nullptr),
+      arena(ownBuffer ? ownBuffer.get() : threadBuffer(), THREAD_BUFFER_BYTES),
+      previous(activeArena) {
+    activeArena = this;
+}
+
+RequestArena::~RequestArena() {
+    activeArena = previous;
+}
+
+std::pmr::memory_resource* requestMemory() {
+    return activeArena ? activeArena->resource() : std::pmr::get_default_resource();
+}
+
+static std::mutex poolMutex;
+static std::vector<std::vector<RGB>> pooled;
+static uint64_t pooledBytes = 0;
+static uint64_t poolBudget = 256ull * 1024 * 1024;
+
+static uint64_t bytesOf(const std::vector<RGB>& pixels) {
+    return pixels.capacity() * sizeof(RGB);
+}
+
+// Moves the oldest buffers into `evicted` until `incoming` more bytes fit; poolMutex must be held.
+// Freeing a large buffer takes a while, so callers let `evicted` go only after unlocking.
+static void evictFor(uint64_t incoming, size_t maxBuffers, std::vector<std::vector<RGB>>& evicted) {
+    size_t drop = 0;
+    uint64_t bytes = pooledBytes;
+    while (drop < pooled.size() && (bytes + incoming > poolBudget || pooled.size() - drop > maxBuffers)) {
+        bytes -= bytesOf(pooled[drop]);
+        ++drop;
+    }
+    evicted.insert(evicted.end(), std::make_move_iterator(pooled.begin()), std::make_move_iterator(pooled.begin() + drop));
+    pooled.erase(pooled.begin(), pooled.begin() + drop);
+    pooledBytes = bytes;
+}
+
+void setPixelPoolBudget(uint64_t bytes) {
+    std::vector<std::vector<RGB>> evicted;
+    std::lock_guard<std::mutex> lock(poolMutex);
+    poolBudget = bytes;
+    evictFor(0, MAX_POOLED_BUFFERS, evicted);
+}
+
+std::vector<RGB> acquirePixels(size_t count) {
+    std::vector<RGB> pixels;
+    if (count * sizeof(RGB) >= MIN_POOLED_BYTES) {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        // Best fit, so a small image doesn't pin the largest buffer
+        auto best = pooled.end();
+        for (auto it = pooled.begin(); it != pooled.end(); ++it) {
+            if (it->capacity() >= count && (best == pooled.end() || it->capacity() < best->capacity())) best = it;
+        }
+        if (best != pooled.end()) {
+            pooledBytes -= bytesOf(*best);
+            pixels = std::move(*best);
+            pooled.erase(best);
+        }
+    }
+    pixels.resize(count);
+    return pixels;
+}
+
+void releasePixels(std::vector<RGB>&& pixels) {
+    // Declared ahead of the lock, so whatever is dropped is destroyed after it is released
+    std::vector<std::vector<RGB>> evicted;
+    std::vector<RGB> buffer = std::move(pixels);
+    uint64_t bytes = bytesOf(buffer);
+    if (bytes < MIN_POOLED_BYTES) return;
+
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if (bytes > poolBudget) return;
+    // Oldest buffers make room
+    evictFor(bytes, MAX_POOLED_BUFFERS - 1, evicted);
+    pooledBytes += bytes;
+    pooled.push_back(std::move(buffer));
+}
@@ -0,0 +1,266 @@
+#include "../include/resultStore.h"
+#include "../include/fileResponse.h"
+#include "../include/asyncIO.h"
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <iostream>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+static const char* TEMP_PREFIX = ".tmp-";
+
+ResultStore::ResultStore(std::string root, uint64_t byteBudget, std::chrono::seconds ttl, uint64_t hotBudget)
+    : root(std::move(root)), byteBudget(byteBudget), ttl(ttl), hotBudget(hotBudget) {
+    std::error_code ec;
+    fs::create_directories(this->root, ec);
+}
+
+ResultStore::~ResultStore() {
+    stopJanitor();
+}
+
+void ResultStore::startJanitor(std::chrono::seconds interval) {
+    if (janitor.joinable()) return;
+    janitorStop = false;
+    janitor = std::thread(&ResultStore::janitorLoop, this, interval);
+}
+
+void ResultStore::stopJanitor() {
+    {
+        std::lock_guard<std::mutex> lock(janitorMutex);
+        janitorStop = true;
+    }
+    janitorWake.notify_all();
+    if (janitor.joinable()) janitor.join();
+}
+
+std::string ResultStore::path(const std::string& id) const {
+    return root + "/" + id;
+}
+
+bool ResultStore::publish(const std::string& id, std::shared_ptr<const std::string> data) {
+    std::string finalPath = path(id);
+    std::string tempPath = stagingPath(id);
+
+    uint64_t size = data->size();
+    bool written;
+    if (io) {
+        written = io->writeFile(tempPath, data->data(), data->size()).wait() == 0;
+    } else {
+        int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            std::cerr << "Error: Failed to create result file: " << tempPath << std::endl;
+            return false;
+        }
+
+        const char* p = data->data();
+        size_t remaining = data->size();
+        while (remaining > 0) {
+            ssize_t n = write(fd, p, remaining);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            p += n;
+            remaining -= static_cast<size_t>(n);
+        }
+        written = close(fd) == 0 && remaining == 0;
+    }
+    if (!written || rename(tempPath.c_str(), finalPath.c_str()) != 0) {
+        std::cerr << "Error: Failed to publish result: " << finalPath << std::endl;
+        unlink(tempPath.c_str());
+        return false;
+    }
+
+    // ETag comes from the published inode so hot and disk hits agree
+    struct stat st;
+    if (stat(finalPath.c_str(), &st) == 0) {
+        auto result = std::make_shared<HotResult>();
+        result->etag = fileETag(st);
+        result->data = std::move(data);
+        insertHot(id, std::move(result));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(janitorMutex);
+        bytesSinceSweep += size;
+        if (bytesSinceSweep > byteBudget / 8) {
+            sweepRequested = true;
+            janitorWake.notify_one();
+        }
+    }
+    return true;
+}
+
+std::string ResultStore::stagingPath(const std::string& id) const {
+    return root + "/" + TEMP_PREFIX + id;
+}
+
+bool ResultStore::publishStaged(const std::string& id) {
+    std::string finalPath = path(id);
+    std::string tempPath = stagingPath(id);
+
+    struct stat st;
+    if (stat(tempPath.c_str(), &st) != 0 || rename(tempPath.c_str(), finalPath.c_str()) != 0) {
+        std::cerr << "Error: Failed to publish result: " << finalPath << std::endl;
+        unlink(tempPath.c_str());
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(janitorMutex);
+        bytesSinceSweep += static_cast<uint64_t>(st.st_size);
+        if (bytesSinceSweep > byteBudget / 8) {
+            sweepRequested = true;
+            janitorWake.notify_one();
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<const HotResult> ResultStore::hot(const std::string& id) {
+    std::lock_guard<std::mutex> lock(hotMutex);
+    auto it = hotSlots.find(id);
+    if (it == hotSlots.end()) return nullptr;
+    if (it->second.expires <= std::chrono::steady_clock::now()) {
+        hotBytes -= it->second.result->data->size();
+        hotOrder.erase(it->second.pos);
+        hotSlots.erase(it);
+        return nullptr;
+    }
+    hotOrder.splice(hotOrder.begin(), hotOrder, it->second.pos);
+    return it->second.result;
+}
+
+void ResultStore::touch(const std::string& id) const {
+    // Bump atime only: mtime feeds the ETag and the TTL
+    struct timespec times[2];
+    times[0].tv_sec = 0;
+    times[0].tv_nsec = UTIME_NOW;
+    times[1].tv_sec = 0;
+    times[1].tv_nsec = UTIME_OMIT;
+    utimensat(AT_FDCWD, path(id).c_str(), times, 0);
+}
+
+void ResultStore::insertHot(const std::string& id, std::shared_ptr<const HotResult> result) {
+    uint64_t size = result->data->size();
+    if (size > hotBudget) return;
+
+    std::lock_guard<std::mutex> lock(hotMutex);
+    auto existing = hotSlots.find(id);
+    if (existing != hotSlots.end()) {
+        hotBytes -= existing->second.result->data->size();
+        hotOrder.erase(existing->second.pos);
+        hotSlots.erase(existing);
+    }
+
+    while (hotBytes + size > hotBudget && !hotOrder.empty()) {
+        auto victim = hotSlots.find(hotOrder.back());
+        hotBytes -= victim->second.result->data->size();
+        hotSlots.erase(victim);
+        hotOrder.pop_back();
+    }
+
+    hotOrder.push_front(id);
+    hotSlots[id] = {std::move(result), std::chrono::steady_clock::now() + ttl, hotOrder.begin()};
+    hotBytes += size;
+}
+
+void ResultStore::dropHot(const std::string& id) {
+    std::lock_guard<std::mutex> lock(hotMutex);
+    auto it = hotSlots.find(id);
+    if (it == hotSlots.end()) return;
+    hotBytes -= it->second.result->data->size();
+    hotOrder.erase(it->second.pos);
+    hotSlots.erase(it);
+}
+
+void ResultStore::sweep() {
+    struct Entry {
+        std::string name;
+        uint64_t size;
+        struct timespec atime;
+    };
+
+    auto now = std::chrono::system_clock::now();
+    auto olderThan = [&](const struct timespec& ts, std::chrono::seconds age) {
+        auto t = std::chrono::system_clock::time_point(std::chrono::seconds(ts.tv_sec));
+        return t + age < now;
+    };
+
+    auto scanStart = std::chrono::steady_clock::now();
+    std::vector<Entry> entries;
+    std::unordered_set<std::string> present;
+    uint64_t total = 0;
+    std::error_code ec;
+    for (const auto& dirEntry : fs::directory_iterator(root, ec)) {
+        std::string name = dirEntry.path().filename().string();
+        struct stat st;
+        if (stat(dirEntry.path().c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+        bool isTemp = name.compare(0, std::char_traits<char>::length(TEMP_PREFIX), TEMP_PREFIX) == 0;
+        // Abandoned temp files are only reclaimed once no writer can still own them
+        if (isTemp) {
+            if (olderThan(st.st_mtim, ttl)) unlink(dirEntry.path().c_str());
+            continue;
+        }
+        if (olderThan(st.st_mtim, ttl)) {
+            unlink(dirEntry.path().c_str());
+            dropHot(name);
+            continue;
+        }
+        present.insert(name);
+        entries.push_back({name, static_cast<uint64_t>(st.st_size), st.st_atim});
+        total += static_cast<uint64_t>(st.st_size);
+    }
+
+    if (total > byteBudget) {
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+            if (a.atime.tv_sec != b.atime.tv_sec) return a.atime.tv_sec < b.atime.tv_sec;
+            return a.atime.tv_nsec < b.atime.tv_nsec;
+        });
+        for (const auto& entry : entries) {
+            if (total <= byteBudget) break;
+            if (unlink(path(entry.name).c_str()) == 0 || errno == ENOENT) {
+                total -= entry.size;
+                present.erase(entry.name);
+                dropHot(entry.name);
+            }
+        }
+    }
+
+    // Another process sharing the directory may have evicted results this one still holds in memory
+    {
+        std::lock_guard<std::mutex> lock(hotMutex);
+        for (auto it = hotSlots.begin(); it != hotSlots.end();) {
+            // Entries published after the listing started are simply not in it yet
+            bool insertedBeforeScan = it->second.expires - ttl < scanStart;
+            if (present.count(it->first) || !insertedBeforeScan) {
+                ++it;
+                continue;
+            }
+            hotBytes -= it->second.result->data->size();
+            hotOrder.erase(it->second.pos);
+            it = hotSlots.erase(it);
+        }
+    }
+}
+
+void ResultStore::janitorLoop(std::chrono::seconds interval) {
+    std::unique_lock<std::mutex> lock(janitorMutex);
+    while (!janitorStop) {
+        janitorWake.wait_for(lock, interval, [this] { return janitorStop || sweepRequested; });
+        if (janitorStop) break;
+        sweepRequested = false;
+        bytesSinceSweep = 0;
+
+        lock.unlock();
+        sweep();
+        lock.lock();
+    }
+}
@@ -0,0 +1,79 @@
+#include "../include/scheduler.h"
+#include <algorithm>
+
+static const Counter REJECTED[WORK_CLASS_COUNT] = {
+    Counter::RejectedStatic, Counter::RejectedExtract, Counter::RejectedCapacity, Counter::RejectedEmbed,
+};
+
+AdmissionScheduler::AdmissionScheduler(size_t cpuSlots, const std::array<ClassLimits, WORK_CLASS_COUNT>& limits, std::chrono::milliseconds maxWait)
+    : cpuSlots(std::max<size_t>(cpuSlots, 1)), limits(limits), maxWait(maxWait) {
+    for (auto& l : this->limits) l.running = std::max<size_t>(l.running, 1);
+}
+
+bool AdmissionScheduler::canRun(size_t c, size_t slots) const {
+    return running[c] < limits[c].running && (!limits[c].usesCpu || cpuRunning + slots <= cpuSlots);
+}
+
+// A higher-priority class that is waiting and could run right now takes precedence
+bool AdmissionScheduler::outranked(size_t c) const {
+    for (size_t h = 0; h < c; ++h) {
+        if (!waiting[h].empty() && canRun(h, waiting[h].front().slots)) return true;
+    }
+    return false;
+}
+
+void AdmissionScheduler::publish(size_t c) {
+    setAdmissionGauges(static_cast<WorkClass>(c), waiting[c].size(), running[c]);
+}
+
+AdmissionScheduler::Ticket AdmissionScheduler::admit(WorkClass workClass, size_t slots) {
+    size_t c = static_cast<size_t>(workClass);
+    slots = limits[c].usesCpu ? std::clamp<size_t>(slots, 1, cpuSlots) : 0;
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // The fast path skips the queue entirely when nothing is waiting ahead
+    if (!(waiting[c].empty() && canRun(c, slots) && !outranked(c))) {
+        if (waiting[c].size() >= limits[c].queued) {
+            addCounter(REJECTED[c]);
+            return Ticket();
+        }
+
+        uint64_t id = nextWaiter++;
+        waiting[c].push_back({id, slots});
+        publish(c);
+
+        auto deadline = start + maxWait;
+        auto ready = [&] { return waiting[c].front().id == id && canRun(c, slots) && !outranked(c); };
+        if (!changed.wait_until(lock, deadline, ready)) {
+            waiting[c].erase(std::find_if(waiting[c].begin(), waiting[c].end(), [id](const Waiter& w) { return w.id == id; }));
+            publish(c);
+            addCounter(REJECTED[c]);
+            // Whoever was behind us may now be at the head
+            changed.notify_all();
+            return Ticket();
+        }
+        waiting[c].pop_front();
+    }
+
+    ++running[c];
+    cpuRunning += slots;
+    publish(c);
+    lock.unlock();
+
+    // The next waiter in this or a lower class may be able to run as well
+    changed.notify_all();
+    observeStage(Stage::QueueWait, std::chrono::steady_clock::now() - start);
+    return Ticket(this, workClass, slots);
+}
+
+void AdmissionScheduler::release(WorkClass workClass, size_t slots) {
+    size_t c = static_cast<size_t>(workClass);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        --running[c];
+        cpuRunning -= slots;
+        publish(c);
+    }
+    changed.notify_all();
+}
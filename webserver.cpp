@@ -5,31 +5,107 @@
 #include <sstream>
 #include <vector>
 #include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <chrono>
+#include <optional>
+#include <future>
+#include <thread>
+#include <algorithm>
+#include <array>
 #include "include/parse_multipart.h"
-#include "include/convertToBMP.h"
+#include "include/imageIO.h"
 #include <uuid/uuid.h>
 #include "include/BMPstruct.h"
 #include "include/imgBPCSEmbed.h"
 #include "include/imgBPCSExtract.h"
+#include "include/fileResponse.h"
+#include "include/resultStore.h"
+#include "include/coverCache.h"
+#include "include/metrics.h"
+#include "include/binaryFrame.h"
+#include "include/workerPool.h"
+#include "include/capacity.h"
+#include "include/jobs.h"
+#include "include/scheduler.h"
+#include "include/prefork.h"
+#include "include/asyncIO.h"
+#include "include/imageEncode.h"
+#include "include/requestArena.h"
+#include "include/bpcsStream.h"
 
 using namespace httpserver;
 
+static std::shared_ptr<http_response> jsonError(const std::string& message, int code = 400) {
+    return std::make_shared<string_response>("{\"status\":\"error\",\"message\":\"" + message + "\",\"data\":{}}", code, "application/json");
+}
+
+static bool flagArg(const http_request& req, const char* name) {
+    return req.get_arg_flat(name) == "true";
+}
+
+// Result and job ids are UUIDs; refuse anything that could escape a directory or bloat a map key
+static bool isValidId(const std::string& id) {
+    return !id.empty() && id.size() <= 64 && id.find_first_not_of("0123456789abcdefABCDEF-") == std::string::npos;
+}
+
+static std::shared_ptr<http_response> busy() {
+    auto response = jsonError("Server busy, try again later", 503);
+    response->with_header("Retry-After", "1");
+    return response;
+}
+
+// Result encoding for this request: the server default, overridden by ?format=bmp|png and ?level=0-9
+static bool outputArgs(const http_request& req, const OutputOptions& defaults, OutputOptions& output) {
+    output = defaults;
+    if (!parseOutputFormat(req.get_arg_flat("format"), output.format)) return false;
+    std::string level(req.get_arg_flat("level"));
+    if (level.empty()) return true;
+    if (level.size() != 1 || level[0] < '0' || level[0] > '9') return false;
+    output.level = level[0] - '0';
+    return true;
+}
+
+// The job a request reports progress into, when the client named one with ?jobId=
+static std::shared_ptr<JobProgress> requestJob(const http_request& req, JobRegistry& jobs) {
+    std::string jobId(req.get_arg_flat("jobId"));
+    return isValidId(jobId) ? jobs.acquire(jobId) : nullptr;
+}
+
 class IndexFileHandler : public http_resource {
 public:
-    std::shared_ptr<http_response> render_GET(const http_request&) override {
-        std::ifstream file("index.html", std::ios::in | std::ios::binary);
-        if (!file.is_open()) {
-            return std::make_shared<string_response>("File not found", 404, "text/plain");
-        }
-        
-        std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-        return std::make_shared<string_response>(content, 200, "text/html; charset=UTF-8");
+    explicit IndexFileHandler(AdmissionScheduler& scheduler) : scheduler(scheduler) {}
+
+    std::shared_ptr<http_response> render_GET(const http_request& req) override {
+        InFlightRequest inFlight(Endpoint::Index);
+        auto ticket = scheduler.admit(WorkClass::Static);
+        if (!ticket) return busy();
+        return serveFile(req, "index.html", "text/html; charset=UTF-8");
     }
+
+private:
+    AdmissionScheduler& scheduler;
 };
 
 class ImageBPCSEmbedHandler : public http_resource {
 public:
+    ImageBPCSEmbedHandler(ResultStore& store, CoverCache& covers, JobRegistry& jobs, AdmissionScheduler& scheduler, const OutputOptions& defaults)
+        : store(store), covers(covers), jobs(jobs), scheduler(scheduler), defaults(defaults) {}
+
     std::shared_ptr<http_response> render_POST(const http_request& req) override {
+        InFlightRequest inFlight(Endpoint::Embed);
+        auto ticket = scheduler.admit(WorkClass::Embed);
+        if (!ticket) return busy();
+
+        RequestArena arena;
+        JobScope job(requestJob(req, jobs));
+        std::shared_ptr<http_response> response = embed(req);
+        job.finish(response->get_response_code());
+        return response;
+    }
+
+private:
+    std::shared_ptr<http_response> embed(const http_request& req) {
         uuid_t uuid;
         char uuid_str[37];
         uuid_generate_random(uuid);
@@ -43,7 +119,7 @@ public:
             return std::make_shared<string_response>("{\"status\":\"error\",\"message\":\"Invalid content type\",\"data\":{}}", 400, "application/json");
         }
     
-        std::string encryptForm(req.get_arg_flat("password"));
+        std::string encryptForm(req.get_arg_flat("encrypt"));
         bool encrypt = encryptForm == "true" ? true : false;
 
         std::string randomizeForm(req.get_arg_flat("randomize"));
@@ -53,16 +129,25 @@ public:
         std::string password(password_raw);
         password = password.empty() ? "" : password;
 
+        OutputOptions output;
+        if (!outputArgs(req, defaults, output)) {
+            return std::make_shared<string_response>("{\"status\":\"error\",\"message\":\"Invalid output format\",\"data\":{}}", 400, "application/json");
+        }
+
         std::string boundary(content_type.substr(boundary_pos + 9));
 
-        auto body_sv = req.get_content();
-        std::string body(body_sv);
+        // Parts are views into the request body, which outlives this handler call
+        std::string_view body = req.get_content();
 
-        auto cover_file = get_file_by_name(body, boundary, "cover");
+        std::optional<MultipartFile> cover_file, secret_file;
+        {
+            StageTimer timer(Stage::MultipartParse);
+            cover_file = get_file_by_name(body, boundary, "cover");
+            secret_file = get_file_by_name(body, boundary, "secret");
+        }
         if (!cover_file.has_value()) {
             return std::make_shared<string_response>("{\"status\":\"error\",\"message\":\"No Cover Image Sent\",\"data\":{}}", 400, "application/json");
         }
-        auto secret_file = get_file_by_name(body, boundary, "secret");
         if (!secret_file.has_value()) {
             return std::make_shared<string_response>("{\"status\":\"error\",\"message\":\"No Secret File Sent\",\"data\":{}}", 400, "application/json");
         }
@@ -74,33 +159,69 @@ public:
             return std::make_shared<string_response>("{\"status\":\"error\",\"message\":\"No Secret File uploaded\",\"data\":{}}", 400, "application/json");
         }
 
-        std::ofstream cover_file_fs(std::string("/app/uploads/") + uuid_str, std::ios::binary);
-        if (!cover_file_fs.is_open()) {
-            return std::make_shared<string_response>("{\"status\":\"error\",\"message\":\"Failed to save Cover file\",\"data\":{}}", 400, "application/json");
-        }
-        cover_file_fs << cover_file->second;
-        cover_file_fs.close();
+        addCounter(Counter::CoverBytes, cover_file->second.size());
+        addCounter(Counter::SecretBytes, secret_file->second.size());
 
-        std::ofstream secret_file_fs(std::string("/app/secrets/") + uuid_str, std::ios::binary);
-        if (!secret_file_fs.is_open()) {
-            return std::make_shared<string_response>("{\"status\":\"error\",\"message\":\"Failed to save Secret file\",\"data\":{}}", 400, "application/json");
-        }
-        secret_file_fs << secret_file->second;
-        secret_file_fs.close();
+        // A cover we have already decoded and scanned skips straight to embedding
+        std::string_view coverBytes = cover_file->second;
+        uint64_t coverHash = contentHash(coverBytes.data(), coverBytes.size());
+        std::shared_ptr<const CoverEntry> cover = covers.find(coverHash, coverBytes.size());
+        addCounter(cover ? Counter::CoverCacheHits : Counter::CoverCacheMisses);
 
-        if (convertToBMP(("uploads/" + std::string(uuid_str)).c_str(), ("results/" + std::string(uuid_str)).c_str())) {
-            auto [message, code] = imgBPCSEmbed(std::string(uuid_str), cover_file->first, secret_file->first, password, encrypt, randomize);
-            return std::make_shared<string_response>(message, code, "application/json");
-            // return std::make_shared<string_response>("{\"status\":\"success\",\"message\":\"Image converted successfully\",\"data\":{\"resultId\":\"" + std::string(uuid_str) + "\",\"originalFilename\":\"" + cover_file->first + "\"}}", 200, "application/json");
+        // The embed works from the uploaded secret in memory; it never touches disk
+        std::string_view secretBytes = secret_file->second;
+
+        std::string message;
+        int code;
+        const uint8_t* coverData = reinterpret_cast<const uint8_t*>(coverBytes.data());
+        if (!cover && exceedsStreamThreshold(coverData, coverBytes.size())) {
+            // Too large to decode whole: embedded a block row at a time straight into the result file
+            std::tie(message, code) = imgBPCSEmbedStreamed(std::string(uuid_str), coverData, coverBytes.size(), cover_file->first,
+                                                           reinterpret_cast<const uint8_t*>(secretBytes.data()), secretBytes.size(),
+                                                           secret_file->first, password, encrypt, randomize, output, store);
         } else {
-            return std::make_shared<string_response>("{\"status\":\"error\",\"message\":\"Failed to convert image to BMP!\",\"data\":{}}", 400, "application/json");
+            if (!cover) {
+                // Decoded once, from the upload in memory, straight into the engine's pixel layout
+                try {
+                    cover = decodeCover(coverData, coverBytes.size());
+                } catch (const std::exception& e) {
+                    return std::make_shared<string_response>("{\"status\":\"error\",\"message\":\"" + std::string(e.what()) + "\",\"data\":{}}", 400, "application/json");
+                }
+                covers.insert(coverHash, coverBytes.size(), cover);
+            }
+
+            std::tie(message, code) = imgBPCSEmbed(std::string(uuid_str), *cover, cover_file->first,
+                                                   reinterpret_cast<const uint8_t*>(secretBytes.data()), secretBytes.size(),
+                                                   secret_file->first, password, encrypt, randomize, output, store);
         }
+        return std::make_shared<string_response>(message, code, "application/json");
     }
+
+    ResultStore& store;
+    CoverCache& covers;
+    JobRegistry& jobs;
+    AdmissionScheduler& scheduler;
+    const OutputOptions& defaults;
 };
 
 class ImageBPCSExtractHandler : public http_resource {
     public:
+        ImageBPCSExtractHandler(ResultStore& extracts, JobRegistry& jobs, AdmissionScheduler& scheduler) : extracts(extracts), jobs(jobs), scheduler(scheduler) {}
+
         std::shared_ptr<http_response> render_POST(const http_request& req) override {
+            InFlightRequest inFlight(Endpoint::Extract);
+            auto ticket = scheduler.admit(WorkClass::Extract);
+            if (!ticket) return busy();
+
+            RequestArena arena;
+            JobScope job(requestJob(req, jobs));
+            std::shared_ptr<http_response> response = extract(req);
+            job.finish(response->get_response_code());
+            return response;
+        }
+
+    private:
+        std::shared_ptr<http_response> extract(const http_request& req) {
             uuid_t uuid;
             char uuid_str[37];
             uuid_generate_random(uuid);
@@ -114,7 +235,7 @@ class ImageBPCSExtractHandler : public http_resource {
                 return std::make_shared<string_response>("{\"status\":\"error\",\"message\":\"Invalid content type\",\"data\":{}}", 400, "application/json");
             }
     
-            std::string encryptForm(req.get_arg_flat("password"));
+            std::string encryptForm(req.get_arg_flat("encrypt"));
             bool encrypt = encryptForm == "true" ? true : false;
     
             std::string randomizeForm(req.get_arg_flat("randomize"));
@@ -126,10 +247,13 @@ class ImageBPCSExtractHandler : public http_resource {
     
             std::string boundary(content_type.substr(boundary_pos + 9));
     
-            auto body_sv = req.get_content();
-            std::string body(body_sv);
+            std::string_view body = req.get_content();
     
-            auto stego_file = get_file_by_name(body, boundary, "stego");
+            std::optional<MultipartFile> stego_file;
+            {
+                StageTimer timer(Stage::MultipartParse);
+                stego_file = get_file_by_name(body, boundary, "stego");
+            }
             if (!stego_file.has_value()) {
                 return std::make_shared<string_response>("{\"status\":\"error\",\"message\":\"No Stego Image Sent\",\"data\":{}}", 400, "application/json");
             }
@@ -137,54 +261,660 @@ class ImageBPCSExtractHandler : public http_resource {
             if ((stego_file->first).empty() || (stego_file->second).empty()) {
                 return std::make_shared<string_response>("{\"status\":\"error\",\"message\":\"No Stego Image uploaded\",\"data\":{}}", 400, "application/json");
             }
-    
-            std::ofstream stego_file_fs(std::string("/app/uploads/") + uuid_str, std::ios::binary);
-            if (!stego_file_fs.is_open()) {
-                return std::make_shared<string_response>("{\"status\":\"error\",\"message\":\"Failed to save Stego file\",\"data\":{}}", 400, "application/json");
+
+            // ?deliver=inline answers with the secret itself, straight from the decoded upload
+            if (req.get_arg_flat("deliver") == "inline") {
+                addCounter(Counter::StegoBytes, stego_file->second.size());
+                return extractInline(stego_file->second, password, encrypt, randomize);
             }
-            stego_file_fs << stego_file->second;
-            stego_file_fs.close();
     
-            auto [message, code] = imgBPCSExtract(std::string(uuid_str), password, encrypt, randomize);
+            addCounter(Counter::StegoBytes, stego_file->second.size());
+    
+            auto [message, code] = imgBPCSExtract(std::string(uuid_str), reinterpret_cast<const uint8_t*>(stego_file->second.data()), stego_file->second.size(), password, encrypt, randomize, extracts);
             return std::make_shared<string_response>(message, code, "application/json");
         }
+
+        std::shared_ptr<http_response> extractInline(std::string_view stego, const std::string& password, bool encrypt, bool randomize) {
+            try {
+                BPCSExtractResult result = bpcsExtractImage(reinterpret_cast<const uint8_t*>(stego.data()), stego.size(), password, encrypt, randomize);
+                if (result.code != 200) {
+                    return std::make_shared<string_response>(result.message, result.code, "application/json");
+                }
+                setJobPhase(currentJob(), JobPhase::Writing);
+                if (JobProgress* job = currentJob()) job->bytesWritten.store(result.data.size(), std::memory_order_relaxed);
+                addCounter(Counter::ExtractedBytes, result.data.size());
+
+                auto response = std::make_shared<string_response>(std::move(result.data), 200, "application/octet-stream");
+                response->with_header("Content-Disposition", attachmentDisposition(result.filename));
+                return response;
+            } catch (const std::exception& e) {
+                return jsonError(e.what());
+            }
+        }
+
+        ResultStore& extracts;
+        JobRegistry& jobs;
+        AdmissionScheduler& scheduler;
 };
 
+// Upper bound on covers in one batch request; each one holds a decoded copy while it is embedded
+static const size_t MAX_BATCH_COVERS = 64;
+
+// Embeds one secret (shared) or one secret per cover into many covers in a single request.
+// Covers are decoded in memory and fanned out across the CPU worker pool.
+class ImageBPCSEmbedBatchHandler : public http_resource {
+public:
+    ImageBPCSEmbedBatchHandler(ResultStore& store, CoverCache& covers, WorkerPool& pool, AdmissionScheduler& scheduler, const OutputOptions& defaults)
+        : store(store), covers(covers), pool(pool), scheduler(scheduler), defaults(defaults) {}
+
+    std::shared_ptr<http_response> render_POST(const http_request& req) override {
+        InFlightRequest inFlight(Endpoint::EmbedBatch);
+
+        std::string content_type(req.get_header("Content-Type"));
+        size_t boundary_pos = content_type.find("boundary=");
+        if (content_type.find("multipart/form-data") == std::string::npos || boundary_pos == std::string::npos) {
+            return jsonError("Invalid content type");
+        }
+        std::string boundary(content_type.substr(boundary_pos + 9));
+
+        bool encrypt = flagArg(req, "encrypt");
+        bool randomize = flagArg(req, "randomize");
+        std::string password(req.get_arg_flat("password"));
+        OutputOptions output;
+        if (!outputArgs(req, defaults, output)) {
+            return jsonError("Invalid output format");
+        }
+
+        std::string_view body = req.get_content();
+
+        std::vector<MultipartFile> coverParts, secretParts;
+        {
+            StageTimer timer(Stage::MultipartParse);
+            coverParts = get_files_by_name(body, boundary, "cover");
+            secretParts = get_files_by_name(body, boundary, "secret");
+        }
+        if (coverParts.empty()) {
+            return jsonError("No Cover Image Sent");
+        }
+        if (coverParts.size() > MAX_BATCH_COVERS) {
+            return jsonError("Too many covers in one batch. Maximum: " + std::to_string(MAX_BATCH_COVERS));
+        }
+        if (secretParts.empty()) {
+            return jsonError("No Secret File Sent");
+        }
+        if (secretParts.size() != 1 && secretParts.size() != coverParts.size()) {
+            return jsonError("Send one secret for all covers or one secret per cover");
+        }
+        for (const auto& secret : secretParts) {
+            if (secret.first.empty() || secret.second.empty()) {
+                return jsonError("No Secret File uploaded");
+            }
+        }
+
+        // The covers run on up to pool.size() threads at once, each of which is a CPU slot. Admission
+        // waits until the parts are counted; parsing only locates them in the received body.
+        auto ticket = scheduler.admit(WorkClass::Embed, std::min(coverParts.size(), pool.size()));
+        if (!ticket) return busy();
+
+        for (const auto& cover : coverParts) addCounter(Counter::CoverBytes, cover.second.size());
+        for (const auto& secret : secretParts) addCounter(Counter::SecretBytes, secret.second.size());
+
+        // Jobs borrow the parsed parts and the request body by reference; every future is drained
+        // before they go out of scope, below or when a submit throws partway through
+        std::vector<std::future<std::tuple<std::string, int>>> jobs;
+        jobs.reserve(coverParts.size());
+        try {
+            for (size_t i = 0; i < coverParts.size(); ++i) {
+                const auto& coverPart = coverParts[i];
+                const auto& secretPart = secretParts.size() == 1 ? secretParts[0] : secretParts[i];
+                jobs.push_back(pool.submit([&, password]() {
+                    RequestArena arena;
+                    return embedOne(coverPart, secretPart, password, encrypt, randomize, output);
+                }));
+            }
+        } catch (...) {
+            for (auto& job : jobs) job.wait();
+            throw;
+        }
+
+        std::string results;
+        size_t succeeded = 0;
+        for (auto& job : jobs) {
+            std::string message;
+            int code;
+            try {
+                std::tie(message, code) = job.get();
+            } catch (const std::exception& e) {
+                message = "{\"status\":\"error\",\"message\":\"" + std::string(e.what()) + "\",\"data\":{}}";
+                code = 500;
+            }
+            if (code == 200) ++succeeded;
+            if (!results.empty()) results += ",";
+            results += message;
+        }
+
+        int status = succeeded == 0 ? 400 : 200;
+        return std::make_shared<string_response>("{\"status\":\"" + std::string(succeeded == 0 ? "error" : "success") +
+                                                 "\",\"message\":\"Embedded " + std::to_string(succeeded) + " of " + std::to_string(jobs.size()) +
+                                                 " covers\",\"data\":{\"results\":[" + results + "]}}", status, "application/json");
+    }
+
+private:
+    std::tuple<std::string, int> embedOne(const MultipartFile& coverPart, const MultipartFile& secretPart,
+                                          const std::string& password, bool encrypt, bool randomize, const OutputOptions& output) {
+        if (coverPart.first.empty() || coverPart.second.empty()) {
+            return std::make_tuple("{\"status\":\"error\",\"message\":\"No Cover Image uploaded\",\"data\":{}}", 400);
+        }
+
+        uuid_t uuid;
+        char uuid_str[37];
+        uuid_generate_random(uuid);
+        uuid_unparse(uuid, uuid_str);
+
+        try {
+            const uint8_t* coverData = reinterpret_cast<const uint8_t*>(coverPart.second.data());
+            uint64_t coverHash = contentHash(coverData, coverPart.second.size());
+            std::shared_ptr<const CoverEntry> cover = covers.find(coverHash, coverPart.second.size());
+            addCounter(cover ? Counter::CoverCacheHits : Counter::CoverCacheMisses);
+            if (!cover) {
+                cover = decodeCover(coverData, coverPart.second.size());
+                covers.insert(coverHash, coverPart.second.size(), cover);
+            }
+
+            return imgBPCSEmbed(std::string(uuid_str), *cover, coverPart.first,
+                                reinterpret_cast<const uint8_t*>(secretPart.second.data()), secretPart.second.size(),
+                                secretPart.first, password, encrypt, randomize, output, store);
+        } catch (const std::exception& e) {
+            return std::make_tuple("{\"status\":\"error\",\"message\":\"" + std::string(e.what()) + "\",\"data\":{\"originalFilename\":\"" + coverPart.first + "\"}}", 400);
+        }
+    }
+
+    ResultStore& store;
+    CoverCache& covers;
+    WorkerPool& pool;
+    AdmissionScheduler& scheduler;
+    const OutputOptions& defaults;
+};
+
+// Service-to-service embed: a framed octet-stream body in, the stego image out.
+// No multipart parsing, no scratch files and no follow-up GET.
+class ImageBPCSEmbedRawHandler : public http_resource {
+public:
+    ImageBPCSEmbedRawHandler(CoverCache& covers, AdmissionScheduler& scheduler, const OutputOptions& defaults)
+        : covers(covers), scheduler(scheduler), defaults(defaults) {}
+
+    std::shared_ptr<http_response> render_POST(const http_request& req) override {
+        InFlightRequest inFlight(Endpoint::EmbedRaw);
+        auto ticket = scheduler.admit(WorkClass::Embed);
+        if (!ticket) return busy();
+        RequestArena arena;
+
+        EmbedFrame frame;
+        std::string error;
+        if (!parseEmbedFrame(req.get_content(), frame, error)) {
+            return jsonError(error);
+        }
+
+        std::string secretFilename(req.get_arg_flat("filename"));
+        if (secretFilename.empty()) secretFilename = "secret.bin";
+        std::string password(req.get_arg_flat("password"));
+        bool encrypt = flagArg(req, "encrypt");
+        bool randomize = flagArg(req, "randomize");
+        OutputOptions output;
+        if (!outputArgs(req, defaults, output)) {
+            return jsonError("Invalid output format");
+        }
+
+        addCounter(Counter::CoverBytes, frame.cover.size());
+        addCounter(Counter::SecretBytes, frame.secret.size());
+
+        try {
+            const uint8_t* coverData = reinterpret_cast<const uint8_t*>(frame.cover.data());
+            // The stego image comes back in the response body, which a striped embed can't fill
+            if (exceedsStreamThreshold(coverData, frame.cover.size())) {
+                return jsonError("Cover too large for a raw embed; use /image/bpcs/embed", 413);
+            }
+            uint64_t coverHash = contentHash(coverData, frame.cover.size());
+            std::shared_ptr<const CoverEntry> cover = covers.find(coverHash, frame.cover.size());
+            addCounter(cover ? Counter::CoverCacheHits : Counter::CoverCacheMisses);
+            if (!cover) {
+                cover = decodeCover(coverData, frame.cover.size());
+                covers.insert(coverHash, frame.cover.size(), cover);
+            }
+
+            BPCSEmbedResult result = bpcsEmbed(*cover, reinterpret_cast<const uint8_t*>(frame.secret.data()), frame.secret.size(),
+                                               secretFilename, password, encrypt, randomize);
+            if (result.code != 200) {
+                return std::make_shared<string_response>(result.message, result.code, "application/json");
+            }
+
+            std::string encoded;
+            {
+                StageTimer timer(output.format == OutputFormat::PNG ? Stage::EncodePNG : Stage::WriteBMP);
+                encoded = encodeImage(result.pixels, cover->width, cover->height, output);
+            }
+            releasePixels(std::move(result.pixels));
+            addCounter(Counter::ResultBytes, encoded.size());
+
+            auto response = std::make_shared<string_response>(std::move(encoded), 200, outputContentType(output.format));
+            response->with_header("X-PSNR", std::to_string(result.psnr));
+            return response;
+        } catch (const std::exception& e) {
+            return jsonError(e.what());
+        }
+    }
+
+private:
+    CoverCache& covers;
+    AdmissionScheduler& scheduler;
+    const OutputOptions& defaults;
+};
+
+// Service-to-service extract: the stego image as the whole body, the secret back as the response.
+class ImageBPCSExtractRawHandler : public http_resource {
+public:
+    explicit ImageBPCSExtractRawHandler(AdmissionScheduler& scheduler) : scheduler(scheduler) {}
+
+    std::shared_ptr<http_response> render_POST(const http_request& req) override {
+        InFlightRequest inFlight(Endpoint::ExtractRaw);
+        auto ticket = scheduler.admit(WorkClass::Extract);
+        if (!ticket) return busy();
+        RequestArena arena;
+
+        std::string_view body = req.get_content();
+        if (body.empty()) {
+            return jsonError("No Stego Image uploaded");
+        }
+        addCounter(Counter::StegoBytes, body.size());
+
+        std::string password(req.get_arg_flat("password"));
+        bool encrypt = flagArg(req, "encrypt");
+        bool randomize = flagArg(req, "randomize");
+
+        try {
+            BPCSExtractResult result = bpcsExtractImage(reinterpret_cast<const uint8_t*>(body.data()), body.size(), password, encrypt, randomize);
+            if (result.code != 200) {
+                return std::make_shared<string_response>(result.message, result.code, "application/json");
+            }
+            addCounter(Counter::ExtractedBytes, result.data.size());
+
+            auto response = std::make_shared<string_response>(std::move(result.data), 200, "application/octet-stream");
+            response->with_header("Content-Disposition", attachmentDisposition(result.filename));
+            return response;
+        } catch (const std::exception& e) {
+            return jsonError(e.what());
+        }
+    }
+
+private:
+    AdmissionScheduler& scheduler;
+};
+
+// Block rows sampled for a quick estimate when the caller doesn't ask for an exact figure
+static const int CAPACITY_SAMPLE_ROWS = 32;
+
+// How much a cover can hold, answered before the client uploads a secret. The cover is either
+// a `cover` multipart part or the whole request body. Without `exact=true` only the image header
+// is read (plus a strided block sample for BMP); with it the cover is decoded, scanned and cached
+// so the embed that follows skips that work.
+class ImageBPCSCapacityHandler : public http_resource {
+public:
+    ImageBPCSCapacityHandler(CoverCache& covers, AdmissionScheduler& scheduler) : covers(covers), scheduler(scheduler) {}
+
+    std::shared_ptr<http_response> render_POST(const http_request& req) override {
+        InFlightRequest inFlight(Endpoint::Capacity);
+        auto ticket = scheduler.admit(WorkClass::Capacity);
+        if (!ticket) return busy();
+
+        std::string content_type(req.get_header("Content-Type"));
+        std::string_view coverBytes = req.get_content();
+        std::optional<MultipartFile> cover_file;
+        if (content_type.find("multipart/form-data") != std::string::npos) {
+            size_t boundary_pos = content_type.find("boundary=");
+            if (boundary_pos == std::string::npos) {
+                return jsonError("Invalid content type");
+            }
+            {
+                StageTimer timer(Stage::MultipartParse);
+                cover_file = get_file_by_name(coverBytes, content_type.substr(boundary_pos + 9), "cover");
+            }
+            if (!cover_file.has_value()) {
+                return jsonError("No Cover Image Sent");
+            }
+            coverBytes = cover_file->second;
+        }
+        if (coverBytes.empty()) {
+            return jsonError("No Cover Image uploaded");
+        }
+
+        const uint8_t* coverData = reinterpret_cast<const uint8_t*>(coverBytes.data());
+        bool exact = flagArg(req, "exact");
+
+        try {
+            CapacityEstimate estimate;
+            uint64_t coverHash = contentHash(coverData, coverBytes.size());
+            std::shared_ptr<const CoverEntry> cover = covers.find(coverHash, coverBytes.size());
+
+            if (cover) {
+                estimate = coverCapacity(*cover, "cache");
+            } else if (exact && exceedsStreamThreshold(coverData, coverBytes.size())) {
+                // Counted a block row at a time; too large to keep in the cover cache anyway
+                if (!streamedCapacity(coverData, coverBytes.size(), estimate)) {
+                    return jsonError("Image too large to decode in memory; send it as a non-interlaced PNG or an uncompressed BMP", 413);
+                }
+            } else if (exact) {
+                cover = decodeCover(coverData, coverBytes.size());
+                covers.insert(coverHash, coverBytes.size(), cover);
+                estimate = coverCapacity(*cover, "scan");
+            } else if (!estimateCapacity(coverData, coverBytes.size(), CAPACITY_SAMPLE_ROWS, estimate)) {
+                return jsonError("Unsupported image format");
+            }
+
+            return std::make_shared<string_response>("{\"status\":\"success\",\"message\":\"Capacity " + std::string(estimate.exact ? "measured" : "estimated") +
+                                                     "\",\"data\":{\"width\":" + std::to_string(estimate.width) + ",\"height\":" + std::to_string(estimate.height) +
+                                                     ",\"maxCapacity\":\"" + std::to_string(estimate.capacity) + "\",\"upperBound\":\"" + std::to_string(estimate.upperBound) +
+                                                     "\",\"exact\":" + (estimate.exact ? "true" : "false") + ",\"method\":\"" + estimate.method + "\"}}",
+                                                     200, "application/json");
+        } catch (const std::exception& e) {
+            return jsonError(e.what());
+        }
+    }
+
+private:
+    CoverCache& covers;
+    AdmissionScheduler& scheduler;
+};
+
+// Serves a ResultStore by id. Extracted secrets are sent as downloads since their
+// original name and type only travel in the extract response.
 class ResultHandler : public http_resource {
     public:
+        ResultHandler(ResultStore& store, AdmissionScheduler& scheduler, Endpoint endpoint, std::string contentType, bool attachment = false)
+            : store(store), scheduler(scheduler), endpoint(endpoint), contentType(std::move(contentType)), attachment(attachment) {}
+
         std::shared_ptr<http_response> render_GET(const http_request& req) override {
+            InFlightRequest inFlight(endpoint);
+            auto ticket = scheduler.admit(WorkClass::Static);
+            if (!ticket) return busy();
+
             std::string fileId(req.get_arg("fileId"));
+            std::string type = contentType;
+            // PNG results are stored and linked with their extension
+            OutputFormat format = OutputFormat::BMP;
+            size_t dot = fileId.find('.');
+            std::string id = fileId.substr(0, dot);
+            if (dot != std::string::npos && (!parseOutputFormat(std::string_view(fileId).substr(dot + 1), format) || format != OutputFormat::PNG)) {
+                return std::make_shared<string_response>("File not found", 404, "text/plain");
+            }
+            if (dot != std::string::npos) type = outputContentType(format);
             // if (!fileId) {
             //     return std::make_shared<string_response>("fileId not found", 404, "text/plain");
             // }
 
-            std::ifstream file("results/" + fileId, std::ios::in | std::ios::binary);
-            if (!file.is_open()) {
+            if (!isValidId(id)) {
                 return std::make_shared<string_response>("File not found", 404, "text/plain");
             }
-            
-            std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-            return std::make_shared<string_response>(content, 200, "image/bmp");
+
+            std::shared_ptr<http_response> response;
+            store.touch(fileId);
+            if (auto hot = store.hot(fileId)) {
+                response = serveBuffer(req, hot->data, hot->etag, type);
+            } else {
+                response = serveFile(req, store.path(fileId), type);
+            }
+            if (attachment && response->get_response_code() < 300) {
+                response->with_header("Content-Disposition", "attachment");
+            }
+            return response;
         }
+
+    private:
+        ResultStore& store;
+        AdmissionScheduler& scheduler;
+        Endpoint endpoint;
+        std::string contentType;
+        bool attachment;
 };
 
-int main() {
-    webserver ws = create_webserver(8080)
-        .max_threads(5)
+// How often a watched job is polled, and how long a quiet stream goes before a keep-alive comment
+static const std::chrono::milliseconds JOB_POLL_INTERVAL(200);
+static const std::chrono::seconds JOB_KEEPALIVE(15);
+// A stream for a job whose request never shows up is closed after this long
+static const std::chrono::seconds JOB_START_TIMEOUT(60);
+
+struct JobStream {
+    std::shared_ptr<JobProgress> job;
+    std::string pending;
+    size_t sent = 0;
+    std::string lastSnapshot;
+    std::chrono::steady_clock::time_point lastWrite = std::chrono::steady_clock::now();
+    bool ended = false;
+};
+
+// Cycle callback for the event stream. MHD pulls from it on the connection's thread, so it
+// blocks for at most a keep-alive period waiting for the job to move.
+static ssize_t jobEvents(std::shared_ptr<JobStream> stream, char* buf, size_t max) {
+    while (stream->sent == stream->pending.size()) {
+        if (stream->ended) return MHD_CONTENT_READER_END_OF_STREAM;
+
+        stream->pending.clear();
+        stream->sent = 0;
+        const JobProgress& job = *stream->job;
+        bool finished = job.finishedAt.load(std::memory_order_acquire) != 0;
+        std::string snapshot = jobSnapshot(job);
+        auto now = std::chrono::steady_clock::now();
+
+        if (finished) {
+            stream->pending = "event: done\ndata: " + snapshot + "\n\n";
+            stream->ended = true;
+        } else if (!job.started.load(std::memory_order_relaxed) && now - job.created > JOB_START_TIMEOUT) {
+            stream->pending = "event: expired\ndata: " + snapshot + "\n\n";
+            stream->ended = true;
+        } else if (snapshot != stream->lastSnapshot) {
+            stream->pending = "event: progress\ndata: " + snapshot + "\n\n";
+            stream->lastSnapshot = std::move(snapshot);
+        } else if (now - stream->lastWrite >= JOB_KEEPALIVE) {
+            stream->pending = ": keep-alive\n\n";
+        } else {
+            std::this_thread::sleep_for(JOB_POLL_INTERVAL);
+        }
+    }
+
+    size_t n = std::min(max, stream->pending.size() - stream->sent);
+    std::memcpy(buf, stream->pending.data() + stream->sent, n);
+    stream->sent += n;
+    stream->lastWrite = std::chrono::steady_clock::now();
+    return static_cast<ssize_t>(n);
+}
+
+// Server-sent events for a job named by the client, opened alongside the embed or extract POST
+class JobEventsHandler : public http_resource {
+public:
+    explicit JobEventsHandler(JobRegistry& jobs) : jobs(jobs) {}
+
+    std::shared_ptr<http_response> render_GET(const http_request& req) override {
+        InFlightRequest inFlight(Endpoint::JobEvents);
+
+        std::string jobId(req.get_arg("jobId"));
+        if (!isValidId(jobId)) {
+            return jsonError("Invalid job id", 404);
+        }
+        auto stream = std::make_shared<JobStream>();
+        stream->job = jobs.acquire(jobId);
+        if (!stream->job) {
+            return jsonError("Too many jobs in progress", 503);
+        }
+
+        auto response = std::make_shared<deferred_response<JobStream>>(jobEvents, stream, "", 200, "text/event-stream");
+        response->with_header("Cache-Control", "no-cache");
+        return response;
+    }
+
+private:
+    JobRegistry& jobs;
+};
+
+class JobCancelHandler : public http_resource {
+public:
+    explicit JobCancelHandler(JobRegistry& jobs) : jobs(jobs) {}
+
+    std::shared_ptr<http_response> render_POST(const http_request& req) override {
+        InFlightRequest inFlight(Endpoint::JobCancel);
+
+        std::string jobId(req.get_arg("jobId"));
+        if (!isValidId(jobId)) {
+            return jsonError("Invalid job id", 404);
+        }
+        if (!jobs.cancel(jobId)) {
+            return jsonError("Job already finished", 409);
+        }
+        return std::make_shared<string_response>("{\"status\":\"success\",\"message\":\"Job cancelled\",\"data\":{}}", 200, "application/json");
+    }
+
+private:
+    JobRegistry& jobs;
+};
+
+class MetricsHandler : public http_resource {
+    public:
+        std::shared_ptr<http_response> render_GET(const http_request&) override {
+            InFlightRequest inFlight(Endpoint::Metrics);
+            return std::make_shared<string_response>(renderMetrics(), 200, "text/plain; version=0.0.4; charset=utf-8");
+        }
+};
+
+static uint64_t envOr(const char* name, uint64_t fallback) {
+    const char* value = std::getenv(name);
+    if (!value || !*value) return fallback;
+    try {
+        return std::stoull(value);
+    } catch (const std::exception&) {
+        std::cerr << "Ignoring invalid " << name << "=" << value << std::endl;
+        return fallback;
+    }
+}
+
+static const uint16_t PORT = 8080;
+
+// One server instance. In pre-fork mode every worker process runs this with its own
+// SO_REUSEPORT listening socket; otherwise listenFd is -1 and the server binds the port itself.
+static int serve(size_t worker, int listenFd) {
+    // A thread per connection, so a request waiting for admission only holds up its own
+    // connection; how much work runs at once is up to the scheduler below.
+    create_webserver config = create_webserver(PORT)
+        .start_method(http::http_utils::THREAD_PER_CONNECTION)
+        .max_connections(envOr("STEGONINJA_MAX_CONNECTIONS", 256))
         .content_size_limit(1024 * 1024 * 256);
+    if (listenFd >= 0) {
+        config.bind_socket(listenFd);
+    }
+    webserver ws = config;
+
+    // Static files never wait for CPU; embeds leave at least one CPU slot to the cheaper classes.
+    // A pinned worker only counts the CPUs it was given.
+    size_t cpuSlots = envOr("STEGONINJA_CPU_SLOTS", availableCpus());
+    std::array<ClassLimits, WORK_CLASS_COUNT> limits = {{
+        {envOr("STEGONINJA_STATIC_CONCURRENCY", 64), 256, false},
+        {envOr("STEGONINJA_EXTRACT_CONCURRENCY", cpuSlots), 128, true},
+        {envOr("STEGONINJA_CAPACITY_CONCURRENCY", std::max<size_t>(1, cpuSlots / 2)), 64, true},
+        {envOr("STEGONINJA_EMBED_CONCURRENCY", std::max<size_t>(1, cpuSlots - 1)), 32, true},
+    }};
+    AdmissionScheduler scheduler(cpuSlots, limits, std::chrono::milliseconds(envOr("STEGONINJA_QUEUE_TIMEOUT_MS", 30000)));
+
+    // Result writes go through io_uring unless STEGONINJA_IO_URING=0
+    AsyncFileIO io(256, envOr("STEGONINJA_IO_URING", 1) != 0);
+    std::cout << "File I/O backend: " << io.backend() << std::endl;
+    std::cout << "JPEG decoder: " << jpegDecoderName() << std::endl;
+
+    // Results live for STEGONINJA_RESULT_TTL seconds within STEGONINJA_RESULT_BUDGET_MB on disk;
+    // the most recent ones are also kept in memory up to STEGONINJA_HOT_BUDGET_MB.
+    ResultStore store("results",
+                      envOr("STEGONINJA_RESULT_BUDGET_MB", 2048) * 1024 * 1024,
+                      std::chrono::seconds(envOr("STEGONINJA_RESULT_TTL", 3600)),
+                      envOr("STEGONINJA_HOT_BUDGET_MB", 128) * 1024 * 1024);
+    store.setFileIO(&io);
+    store.startJanitor(std::chrono::seconds(30));
 
-    IndexFileHandler index;
-    ImageBPCSEmbedHandler imgBPCSEm;
-    ImageBPCSExtractHandler imgBPCSEx;
-    ResultHandler results;
+    // Secrets recovered by the link-mode extract, under the same TTL and a quarter of the budgets
+    ResultStore extracts("extracts",
+                         envOr("STEGONINJA_RESULT_BUDGET_MB", 2048) * 1024 * 1024 / 4,
+                         std::chrono::seconds(envOr("STEGONINJA_RESULT_TTL", 3600)),
+                         envOr("STEGONINJA_HOT_BUDGET_MB", 128) * 1024 * 1024 / 4);
+    extracts.setFileIO(&io);
+    extracts.startJanitor(std::chrono::seconds(30));
+
+    // Decoded covers and their complexity scans, bounded by STEGONINJA_COVER_CACHE_MB
+    CoverCache covers(envOr("STEGONINJA_COVER_CACHE_MB", 256) * 1024 * 1024);
+    WorkerPool pool(envOr("STEGONINJA_WORKERS", availableCpus()));
+
+    // Recycled whole-image pixel buffers, bounded by STEGONINJA_PIXEL_POOL_MB
+    setPixelPoolBudget(envOr("STEGONINJA_PIXEL_POOL_MB", 256) * 1024 * 1024);
+
+    // Images over STEGONINJA_STREAM_MEGAPIXELS are never decoded whole; BPCS runs over them in stripes
+    setStreamThreshold(envOr("STEGONINJA_STREAM_MEGAPIXELS", 64) * 1000 * 1000);
+
+    // PNG results are deflated in row stripes on their own pool, so batch workers can wait on it.
+    // STEGONINJA_OUTPUT_FORMAT and STEGONINJA_PNG_LEVEL set the default for requests that don't ask.
+    WorkerPool encoders(envOr("STEGONINJA_ENCODE_THREADS", availableCpus()));
+    OutputOptions output;
+    const char* outputFormat = std::getenv("STEGONINJA_OUTPUT_FORMAT");
+    if (outputFormat && !parseOutputFormat(outputFormat, output.format)) {
+        std::cerr << "Unknown STEGONINJA_OUTPUT_FORMAT '" << outputFormat << "', using bmp" << std::endl;
+    }
+    output.level = static_cast<int>(std::min<uint64_t>(9, envOr("STEGONINJA_PNG_LEVEL", 6)));
+    output.encoders = &encoders;
+    output.io = &io;
+
+    // Progress of client-named embed and extract jobs
+    JobRegistry jobs(1024);
+
+    IndexFileHandler index(scheduler);
+    ImageBPCSEmbedHandler imgBPCSEm(store, covers, jobs, scheduler, output);
+    ImageBPCSExtractHandler imgBPCSEx(extracts, jobs, scheduler);
+    ImageBPCSEmbedBatchHandler imgBPCSEmBatch(store, covers, pool, scheduler, output);
+    ImageBPCSEmbedRawHandler imgBPCSEmRaw(covers, scheduler, output);
+    ImageBPCSExtractRawHandler imgBPCSExRaw(scheduler);
+    ImageBPCSCapacityHandler imgBPCSCapacity(covers, scheduler);
+    ResultHandler results(store, scheduler, Endpoint::Result, "image/bmp");
+    ResultHandler extractResults(extracts, scheduler, Endpoint::ExtractResult, "application/octet-stream", true);
+    JobEventsHandler jobEvents(jobs);
+    JobCancelHandler jobCancel(jobs);
+    MetricsHandler metrics;
 
     ws.register_resource("/", &index);
     ws.register_resource("/image/bpcs/embed", &imgBPCSEm);
     ws.register_resource("/image/bpcs/extract", &imgBPCSEx);
+    ws.register_resource("/image/bpcs/embed/batch", &imgBPCSEmBatch);
+    ws.register_resource("/image/bpcs/embed/raw", &imgBPCSEmRaw);
+    ws.register_resource("/image/bpcs/extract/raw", &imgBPCSExRaw);
+    ws.register_resource("/image/bpcs/capacity", &imgBPCSCapacity);
     ws.register_resource("/results/{fileId}", &results);
+    ws.register_resource("/extracts/{fileId}", &extractResults);
+    ws.register_resource("/jobs/{jobId}/events", &jobEvents);
+    ws.register_resource("/jobs/{jobId}/cancel", &jobCancel);
+    ws.register_resource("/metrics", &metrics);
 
-    std::cout << "Server started on port 8080" << std::endl;
+    std::cout << "Server started on port " << PORT << " (worker " << worker << ")" << std::endl;
     ws.start(true);
 
     return 0;
+}
+
+int main() {
+    // STEGONINJA_PROCESSES > 1 pre-forks that many workers sharing the port. Results are shared
+    // through the store's directory; cover caches, hot results and job progress stay per process.
+    size_t processes = envOr("STEGONINJA_PROCESSES", 1);
+    if (processes <= 1) {
+        return serve(0, -1);
+    }
+
+    const char* pin = std::getenv("STEGONINJA_PIN");
+    return runPrefork(processes, parsePinning(pin ? pin : ""), [](size_t worker) {
+        int fd = reusePortSocket(PORT);
+        if (fd < 0) {
+            std::cerr << "Worker " << worker << ": failed to listen on port " << PORT << ": " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+        return serve(worker, fd);
+    });
 }
\ No newline at end of file